@@ -0,0 +1,18 @@
+#pragma once
+
+/*
+ *
+ *  Shared by the benchmarks
+ *
+ */
+
+
+#include <chrono>
+
+
+// average time per iteration since started
+static double nanosecondsSince(std::chrono::steady_clock::time_point started, size_t iterations) {
+
+  return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now() - started).count() / iterations;
+
+}
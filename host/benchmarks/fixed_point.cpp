@@ -0,0 +1,82 @@
+/*
+ *
+ *  The per-report arithmetic, fixed point against the original
+ *  floating point code (see tests/Reference.h)
+ *
+ *  - the sea level correction: the Q28 series against pow();
+ *  - the trend: adding an observation to the running sums and the t²
+ *    test against shifting the history along and re-fitting it in
+ *    doubles.
+ *
+ *  The times are for this host, which has a floating point unit. The
+ *  ESP8266 has none, so there the gap is far wider - but the ratio
+ *  here still shows whether a change has made either path slower.
+ *
+ *      fixed_point [iterations]        (default 10000000)
+ *
+ */
+
+
+#include "Defines.h"
+#include "Reference.h"
+
+#include "Benchmark.h"
+
+
+int main(int argc, char * argv[]) {
+
+  size_t iterations = (argc > 1) ? strtoul(argv[1],nullptr,10) : 10000000;
+
+  // inputs which change every time, so nothing can be hoisted out of the loops
+  const size_t Inputs = 1024;
+  uint32_t pascals_x256[Inputs];
+  int32_t celsius_x100[Inputs];
+
+  for (size_t i = 0; i < Inputs; i++) {
+    pascals_x256[i] = (97000 + (i * 7919) % 2000) * 256 + i;
+    celsius_x100[i] = -500 + (int32_t)((i * 104729) % 4000);
+  }
+
+  volatile uint64_t sink = 0;
+
+  auto started = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    sink = sink + equivalentPressureAtSeaLevel(pascals_x256[i % Inputs],celsius_x100[i % Inputs]);
+  }
+  double fixedSeaLevel_ns = nanosecondsSince(started,iterations);
+
+  volatile float floatSink = 0;
+
+  started = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    floatSink = floatSink + referenceSeaLevel(pascals_x256[i % Inputs] / 25600.0f,celsius_x100[i % Inputs] / 100.0f);
+  }
+  double floatSeaLevel_ns = nanosecondsSince(started,iterations);
+
+  PressureHistory history = { };
+
+  started = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    sink = sink + trendCode(pressureAnalysisIncluding(history,pascals_x256[i % Inputs]));
+  }
+  double fixedTrend_ns = nanosecondsSince(started,iterations);
+
+  double window[PressureHistorySize] = { };
+  double tObserved = 0;
+
+  started = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    for (size_t j = 1; j < PressureHistorySize; j++) { window[j - 1] = window[j]; }
+    window[PressureHistorySize - 1] = pascals_x256[i % Inputs] / 25600.0;
+    sink = sink + referenceTrend(window,Critical_t_value,tObserved);
+  }
+  double doubleTrend_ns = nanosecondsSince(started,iterations);
+
+  printf("%zu iterations, ns per call\n\n",iterations);
+  printf("                 fixed    float    ratio\n");
+  printf("sea level     %8.1f %8.1f %8.2f\n",fixedSeaLevel_ns,floatSeaLevel_ns,floatSeaLevel_ns / fixedSeaLevel_ns);
+  printf("trend         %8.1f %8.1f %8.2f\n",fixedTrend_ns,doubleTrend_ns,doubleTrend_ns / fixedTrend_ns);
+
+  return 0;
+
+}
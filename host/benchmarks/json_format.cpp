@@ -0,0 +1,84 @@
+/*
+ *
+ *  Building a pressure payload with the JSON writer's integer
+ *  formatting, against the original sprintf() of floats
+ *
+ *  The times are for this host. On the ESP8266, sprintf() of a float
+ *  goes through software floating point as well, so the gap there is
+ *  far wider.
+ *
+ *      json_format [iterations]        (default 2000000)
+ *
+ */
+
+
+#include "Defines.h"
+
+#include "Benchmark.h"
+
+
+int main(int argc, char * argv[]) {
+
+  size_t iterations = (argc > 1) ? strtoul(argv[1],nullptr,10) : 2000000;
+
+  char payload[TelemetryPayloadMax_bytes + 1];
+  volatile size_t sink = 0;
+
+  // readings which change every time, in the units the sketch carries them in
+  auto pascals = [](size_t i) { return (int32_t)(97000 + (i * 7919) % 2000); };
+  auto celsius = [](size_t i) { return (int32_t)(-500 + (i * 104729) % 4000); };
+
+  auto started = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < iterations; i++) {
+
+    JSONWriter json(payload,sizeof(payload));
+    json.beginObject();
+    json.key(PayloadTimeKey);               json.unsignedInteger(1767225600 + i);
+    json.key(PayloadLocalPressureKey);      json.decimal(pascals(i),2);
+    json.key(PayloadSeaLevelPressureKey);   json.decimal(pascals(i) + 4012,2);
+    json.key(PayloadTrendKey);              json.literal(PayloadTrendSteadyValue);
+    json.key(PayloadMinimumPressureKey);    json.decimal(pascals(i) - 3,2);
+    json.key(PayloadMaximumPressureKey);    json.decimal(pascals(i) + 2,2);
+    json.key(PayloadDeviationPressureKey);  json.decimal(celsius(i) & 0xFF,2);
+    json.key(PayloadSamplesKey);            json.unsignedInteger(4);
+    json.endObject();
+
+    sink = sink + json.length();
+
+  }
+
+  double writer_ns = nanosecondsSince(started,iterations);
+  size_t writerLength = strlen(payload);
+
+  started = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < iterations; i++) {
+
+    int length = snprintf(
+      payload,
+      sizeof(payload),
+      "{%s:%u,%s:%0.2f,%s:%0.2f,%s:%s,%s:%0.2f,%s:%0.2f,%s:%0.2f,%s:%u}",
+      PayloadTimeKey, (unsigned)(1767225600 + i),
+      PayloadLocalPressureKey, pascals(i) / 100.0f,
+      PayloadSeaLevelPressureKey, (pascals(i) + 4012) / 100.0f,
+      PayloadTrendKey, PayloadTrendSteadyValue,
+      PayloadMinimumPressureKey, (pascals(i) - 3) / 100.0f,
+      PayloadMaximumPressureKey, (pascals(i) + 2) / 100.0f,
+      PayloadDeviationPressureKey, (celsius(i) & 0xFF) / 100.0f,
+      PayloadSamplesKey, 4u
+    );
+
+    sink = sink + length;
+
+  }
+
+  double sprintf_ns = nanosecondsSince(started,iterations);
+
+  printf("%zu pressure payloads of %zu bytes, ns per payload\n\n",iterations,writerLength);
+  printf("JSONWriter    %8.1f\n",writer_ns);
+  printf("snprintf      %8.1f   (%.2fx)\n",sprintf_ns,sprintf_ns / writer_ns);
+
+  return 0;
+
+}
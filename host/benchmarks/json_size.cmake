@@ -0,0 +1,52 @@
+# Reports the text bytes the JSON writer and snprintf() each add to the
+# baseline json_size build.
+#
+# A static glibc program always carries printf (glibc reports its own
+# errors with it), so the baseline has it too and the difference only
+# covers the call. The snprintf figure adds the C library code a float
+# conversion runs through, sized from the symbol table: the printf
+# engine, the float converter and the multiple precision arithmetic it
+# uses. On the ESP8266 that code is only linked in for the payloads.
+#
+#   cmake -DSIZE=size -DNM=nm -DBASELINE=... -DWRITER=... -DSPRINTF=... -P json_size.cmake
+
+function(text_bytes program result)
+  execute_process(COMMAND ${SIZE} ${program} OUTPUT_VARIABLE output RESULT_VARIABLE status)
+  if(NOT status EQUAL 0 OR NOT output MATCHES "\n[ \t]*([0-9]+)")
+    message(FATAL_ERROR "${SIZE} failed on ${program}")
+  endif()
+  set(${result} ${CMAKE_MATCH_1} PARENT_SCOPE)
+endfunction()
+
+function(float_printf_bytes program result)
+  execute_process(COMMAND ${NM} -S ${program} OUTPUT_VARIABLE output RESULT_VARIABLE status)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${program}")
+  endif()
+  string(REGEX MATCHALL "[0-9a-f]+ [tTrR] (__vfprintf_internal|__printf_fp_l|__mpn_[a-z0-9_]+|_fpioconst_pow10)\n" symbols "${output}")
+  set(bytes 0)
+  foreach(symbol IN LISTS symbols)
+    string(REGEX MATCH "^[0-9a-f]+" hex "${symbol}")
+    math(EXPR bytes "${bytes} + 0x${hex}")
+  endforeach()
+  set(${result} ${bytes} PARENT_SCOPE)
+endfunction()
+
+text_bytes(${BASELINE} baseline)
+text_bytes(${WRITER} writer)
+text_bytes(${SPRINTF} sprintf_call)
+float_printf_bytes(${SPRINTF} library)
+
+math(EXPR writer "${writer} - ${baseline}")
+math(EXPR sprintf_call "${sprintf_call} - ${baseline}")
+math(EXPR sprintf "${sprintf_call} + ${library}")
+if(writer LESS_EQUAL 0 OR library EQUAL 0)
+  message(FATAL_ERROR "JSONWriter adds ${writer} text bytes, the C library's float printf is ${library}")
+endif()
+math(EXPR ratio_x10 "${sprintf} * 10 / ${writer}")
+math(EXPR ratio "${ratio_x10} / 10")
+math(EXPR tenths "${ratio_x10} % 10")
+
+message("pressure payload, text bytes\n")
+message("JSONWriter    ${writer}")
+message("snprintf      ${sprintf}   (${ratio}.${tenths}x, ${sprintf_call} for the call and ${library} in the C library)")
@@ -0,0 +1,75 @@
+/*
+ *
+ *  The code size of building a pressure payload with the JSON writer,
+ *  against the original sprintf() of floats
+ *
+ *  Built three times, statically linked and optimised for size like
+ *  the ESP8266 build: with JSONSizeWriter, with JSONSizeSprintf and
+ *  with neither as the baseline. json_size.cmake reports the text
+ *  size of each less the baseline, and for snprintf() the C library
+ *  code that formats a float as well. The sizes are for this host;
+ *  the ESP8266's printf also carries software floating point.
+ *
+ *      json_size [local_Pa]
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "JSON.h"
+
+
+int main(int argc, char * argv[]) {
+
+  // read at run time so that neither build formats a constant
+  int32_t pascals = (argc > 1) ? (int32_t)strtol(argv[1],nullptr,10) : 101325;
+
+  char payload[256 + 1];  // and a newline
+
+#if defined(JSONSizeWriter)
+
+  JSONWriter json(payload,sizeof(payload) - 1);
+  json.beginObject();
+  json.key("\"time\"");       json.unsignedInteger(1767225600);
+  json.key("\"local_hPa\"");  json.decimal(pascals,2);
+  json.key("\"sea_hPa\"");    json.decimal(pascals + 4012,2);
+  json.key("\"trend\"");      json.literal("\"steady\"");
+  json.key("\"min_hPa\"");    json.decimal(pascals - 3,2);
+  json.key("\"max_hPa\"");    json.decimal(pascals + 2,2);
+  json.key("\"sd_hPa\"");     json.decimal(17,2);
+  json.key("\"samples\"");    json.unsignedInteger(4);
+  json.endObject();
+
+#elif defined(JSONSizeSprintf)
+
+  snprintf(
+    payload,
+    sizeof(payload) - 1,
+    "{\"time\":%u,\"local_hPa\":%0.2f,\"sea_hPa\":%0.2f,\"trend\":\"steady\",\"min_hPa\":%0.2f,\"max_hPa\":%0.2f,\"sd_hPa\":%0.2f,\"samples\":%u}",
+    1767225600u,
+    pascals / 100.0f,
+    (pascals + 4012) / 100.0f,
+    (pascals - 3) / 100.0f,
+    (pascals + 2) / 100.0f,
+    17 / 100.0f,
+    4u
+  );
+
+#else
+
+  payload[0] = (char)pascals;
+  payload[1] = 0;
+
+#endif
+
+  // write() rather than stdio, which would link printf into every build
+  size_t length = strlen(payload);
+  payload[length++] = '\n';
+  return write(1,payload,length) < 0;
+
+}
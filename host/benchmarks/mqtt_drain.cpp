@@ -0,0 +1,174 @@
+/*
+ *
+ *  How fast does a backlog drain?
+ *
+ *  Each scenario boots the sketch's comms (no sensors), waits for
+ *  WiFi, queues a backlog like the one left by a broker outage and
+ *  then runs the WiFi and MQTT handlers and the scheduler until both
+ *  queues are empty, against the broker stand-in with a given latency,
+ *  packet loss and rate of dropped sessions. For each it reports, on
+ *  the virtual clock:
+ *
+ *  - drained/s - messages taken off the queues per second;
+ *  - first_ms - from the start of the run (connecting) to the first
+ *    PUBLISH reaching the broker;
+ *  - run_ms - from the start of the run to both queues being empty;
+ *
+ *  plus what the broker made of it and the host CPU time taken.
+ *
+ *      mqtt_drain [messages]           (default 400)
+ *
+ *  The default backlog is more than the RAM queue holds, so the
+ *  drain includes a backfill from the spill log.
+ *
+ */
+
+
+#include "Defines.h"
+
+#include <chrono>
+
+
+typedef struct {
+  uint32_t latency_ms;
+  uint32_t lossPercent;
+  uint32_t dropPercent;
+} Scenario;
+
+const Scenario scenarios[] = {
+  {   1,  0,  0 },
+  {   5,  0,  0 },
+  {  50,  0,  0 },
+  { 250,  0,  0 },
+  {   5,  5,  0 },
+  {   5, 20,  0 },
+  {   5,  0,  1 },
+  {   5,  0,  5 },
+  {  50,  5,  1 }
+};
+
+// give up on a scenario after this much simulated time
+const uint64_t DrainLimit_ms = 6*60*60*1000ULL;
+
+static uint32_t backlog = 400;
+
+// a typical status-sized payload
+static const char * BacklogPayload =
+  "{\"time\":1767225903,\"ssid\":\"host\",\"mac\":\"02:00:00:00:00:01\",\"ip\":\"192.168.1.100\",\"heap\":40000}";
+
+// per boot (each scenario runs in its own process)
+static uint64_t drainStart_us = 0;
+static uint64_t firstPublish_us = 0;
+static std::chrono::steady_clock::time_point drainStarted;
+
+
+static void onPublish(const char *, const char *, size_t, bool) {
+
+  if (firstPublish_us == 0) { firstPublish_us = host->now_us; }
+
+}
+
+
+static void benchSetup() {
+
+  spillLog.begin();
+
+  // bring WiFi up
+  while (WiFi.status() != WL_CONNECTED || wifiState != WiFiIdleState) {
+    wifi_handle();
+    scheduler_idle();
+  }
+
+  // the backlog
+  for (uint32_t i = 0; i < backlog; i++) {
+
+    size_t capacity = 0;
+    char * payload = try_to_reserve(capacity);
+
+    size_t length = strlen(BacklogPayload);
+    if (!payload || capacity <= length) { fatalError(queuePushError,__func__); }
+
+    memcpy(payload,BacklogPayload,length + 1);
+    try_to_enqueue(__func__,TopicStatusID,length);
+
+  }
+
+  drainStart_us = host->now_us;
+  drainStarted = std::chrono::steady_clock::now();
+
+}
+
+
+static void benchLoop() {
+
+  wifi_handle();
+  mqtt_handle();
+
+  bool isDrained = mqttQueue.isEmpty() && spillLog.isEmpty() && (mqttState == MQTTIdleState);
+  bool isStuck = (host->now_us - drainStart_us) / 1000 > DrainLimit_ms;
+
+  if (isDrained || isStuck) {
+
+    double run_ms = (host->now_us - drainStart_us) / 1000.0;
+    double first_ms = firstPublish_us ? (firstPublish_us - drainStart_us) / 1000.0 : 0;
+    double cpu_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - drainStarted).count();
+
+    const HostBrokerSettings & broker = host->broker;
+    const HostBrokerStats & stats = host->brokerStats;
+
+    printf(
+      "%7u %5u%% %5u%% %10.1f %9.0f %10.0f %9u %5u %5u %8u %8.1f%s\n",
+      broker.latency_ms,
+      broker.lossPercent,
+      broker.dropPercent,
+      backlog * 1000.0 / run_ms,
+      first_ms,
+      run_ms,
+      stats.received - stats.repeats,
+      stats.lost,
+      stats.repeats,
+      stats.connects,
+      cpu_ms,
+      isStuck ? "  (did not drain)" : ""
+    );
+
+    hostStop();
+
+  }
+
+  scheduler_idle();
+
+}
+
+
+int main(int argc, char * argv[]) {
+
+  if (argc > 1) { backlog = strtoul(argv[1],nullptr,10); }
+
+  printf("draining a backlog of %u messages\n\n",backlog);
+  printf("latency   loss   drop  drained/s  first_ms     run_ms delivered  lost  dups connects   cpu_ms\n");
+
+  hostOnPublish = onPublish;
+
+  for (const Scenario & scenario : scenarios) {
+
+    hostBegin();
+
+    host->broker.latency_ms = scenario.latency_ms;
+    host->broker.lossPercent = scenario.lossPercent;
+    host->broker.dropPercent = scenario.dropPercent;
+
+    bool isClean = hostRun(benchSetup,benchLoop,~0ULL);
+
+    hostEnd();
+
+    if (!isClean) {
+      fprintf(stderr,"scenario crashed\n");
+      return 1;
+    }
+
+  }
+
+  return 0;
+
+}
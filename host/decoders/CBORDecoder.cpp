@@ -0,0 +1,184 @@
+/*
+ *
+ *  Decoder for CBOR payloads (see CBORDecoder.h)
+ *
+ */
+
+
+#include "CBORDecoder.h"
+
+#include <math.h>
+
+
+const uint8_t CBORIndefinite = 31;
+const uint8_t CBORBreakByte = 0xFF;
+const uint64_t CBORDecimalFraction = 4;
+
+// deeper than anything the sketch sends
+const int CBORMaxDepth = 16;
+
+
+bool CBORValue::isNumber() const {
+
+  if (isInteger()) { return true; }
+
+  return
+    type == CBORValueTag && argument == CBORDecimalFraction &&
+    items.size() == 1 && items[0].type == CBORValueArray && items[0].items.size() == 2 &&
+    items[0].items[0].isInteger() && items[0].items[1].isInteger();
+
+}
+
+
+double CBORValue::number() const {
+
+  if (isInteger()) { return (double)integer(); }
+
+  if (!isNumber()) { return NAN; }
+
+  return items[0].items[1].integer() * pow(10.0,(double)items[0].items[0].integer());
+
+}
+
+
+const CBORValue * CBORValue::find(uint64_t key) const {
+
+  if (type != CBORValueMap) { return nullptr; }
+
+  for (size_t i = 0; i + 1 < items.size(); i += 2) {
+    if (items[i].type == CBORValueUnsigned && items[i].argument == key) { return &items[i + 1]; }
+  }
+
+  return nullptr;
+
+}
+
+
+class CBORReader {
+
+  public:
+
+    CBORReader(const uint8_t * data, size_t length) : data(data), length(length) { }
+
+    bool isAtEnd() const { return used == length; }
+
+
+    bool item(CBORValue & value, int depth = 0) {
+
+      if (depth > CBORMaxDepth || used >= length) { return false; }
+
+      uint8_t initial = data[used++];
+      uint8_t major = initial >> 5;
+      uint8_t additional = initial & 0x1F;
+
+      value.type = (CBORValueType)major;
+      value.argument = 0;
+      value.bytes.clear();
+      value.items.clear();
+
+      // indefinite-length arrays (MQTTBatchMode) - nothing else is sent that way
+      if (additional == CBORIndefinite) {
+
+        if (value.type != CBORValueArray) { return false; }
+
+        while (true) {
+
+          if (used >= length) { return false; }
+
+          if (data[used] == CBORBreakByte) { used++; return true; }
+
+          value.items.emplace_back();
+
+          if (!item(value.items.back(),depth + 1)) { return false; }
+
+        }
+
+      }
+
+      if (!argument(additional,value.argument)) { return false; }
+
+      switch (value.type) {
+
+        case CBORValueBytes:
+        case CBORValueText:
+
+          if (value.argument > length - used) { return false; }
+
+          value.bytes.assign((const char *)data + used,value.argument);
+          used += value.argument;
+
+          return true;
+
+        case CBORValueArray:
+        case CBORValueMap:
+        {
+
+          uint64_t count = value.argument * ((value.type == CBORValueMap) ? 2 : 1);
+
+          // every item takes at least a byte
+          if (count > length - used) { return false; }
+
+          value.items.resize(count);
+
+          for (uint64_t i = 0; i < count; i++) {
+            if (!item(value.items[i],depth + 1)) { return false; }
+          }
+
+          return true;
+
+        }
+
+        case CBORValueTag:
+
+          value.items.resize(1);
+
+          return item(value.items[0],depth + 1);
+
+        case CBORValueSimple:
+
+          // false, true and null only (no floats)
+          return additional >= 20 && additional <= 22;
+
+        default:
+
+          return true;
+
+      }
+
+    }
+
+
+  private:
+
+    const uint8_t * data;
+    size_t length;
+    size_t used = 0;
+
+
+    bool argument(uint8_t additional, uint64_t & value) {
+
+      if (additional < 24) { value = additional; return true; }
+
+      if (additional > 27) { return false; }
+
+      size_t size = (size_t)1 << (additional - 24);
+
+      if (size > length - used) { return false; }
+
+      value = 0;
+      for (size_t i = 0; i < size; i++) { value = (value << 8) | data[used++]; }
+
+      return true;
+
+    }
+
+};
+
+
+bool decodeCBOR(const uint8_t * data, size_t length, CBORValue & value) {
+
+  CBORReader reader(data,length);
+
+  return reader.item(value) && reader.isAtEnd();
+
+}
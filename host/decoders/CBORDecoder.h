@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ *
+ *  Decoder for the CBOR (RFC 8949) payloads the sketch publishes with
+ *  CBORPayloads (see CBOR.h in the sketch)
+ *
+ *  Decodes everything the sketch's CBORWriter can produce - unsigned
+ *  and negative integers, byte and text strings, arrays (including the
+ *  indefinite-length arrays of MQTTBatchMode), maps, tags and the
+ *  simple values false, true and null - into a tree of CBORValues.
+ *  Floating point items, which the sketch never sends, are rejected.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+
+typedef enum {
+  CBORValueUnsigned,
+  CBORValueNegative,
+  CBORValueBytes,
+  CBORValueText,
+  CBORValueArray,
+  CBORValueMap,
+  CBORValueTag,
+  CBORValueSimple
+} CBORValueType;
+
+
+struct CBORValue {
+
+  CBORValueType type;
+
+  // the integer (unsigned), -1 - the integer (negative), the tag number or the simple value
+  uint64_t argument;
+
+  // byte and text strings
+  std::string bytes;
+
+  // array elements, map keys and values alternately, or the tagged item
+  std::vector<CBORValue> items;
+
+  bool isInteger() const { return type == CBORValueUnsigned || type == CBORValueNegative; }
+
+  int64_t integer() const { return (type == CBORValueNegative) ? -1 - (int64_t)argument : (int64_t)argument; }
+
+  // an integer, or a decimal fraction (tag 4) as the sketch sends fixed-point values
+  bool isNumber() const;
+  double number() const;
+
+  // the value for an unsigned integer key in a map (null if there is none)
+  const CBORValue * find(uint64_t key) const;
+
+  // how many key/value pairs a map has
+  size_t pairs() const { return items.size() / 2; }
+
+};
+
+
+/*
+ * Decode exactly one item from data. Returns false if the data is
+ * truncated, malformed, holds anything after the item or uses a
+ * feature listed above as unsupported.
+ */
+bool decodeCBOR(const uint8_t * data, size_t length, CBORValue & value);
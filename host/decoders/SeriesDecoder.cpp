@@ -0,0 +1,135 @@
+/*
+ *
+ *  Decoder for compressed series blocks (see SeriesDecoder.h)
+ *
+ */
+
+
+#include "SeriesDecoder.h"
+
+#include <string.h>
+
+
+const uint8_t SeriesDecoderVersion = 1;
+
+
+// unsigned LEB128 - false if the block ends first or the value is wider than 32 bits
+static bool varint(const uint8_t * block, size_t length, size_t & i, uint32_t & value) {
+
+  value = 0;
+
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+
+    if (i >= length) { return false; }
+
+    uint8_t byte = block[i++];
+
+    value |= (uint32_t)(byte & 0x7F) << shift;
+
+    if (byte < 0x80) { return true; }
+
+  }
+
+  return false;
+
+}
+
+
+// 0,1,2,3,4... back to 0,-1,1,-2,2...
+static int32_t unzigzag(uint32_t value) {
+
+  return (int32_t)((value >> 1) ^ (0 - (value & 1)));
+
+}
+
+
+bool decodeSeriesBlock(const uint8_t * block, size_t length, SeriesDecoded & series) {
+
+  series.readings.clear();
+
+  if (length < 4) { return false; }
+
+  series.version = block[0];
+  series.timebase = block[1];
+  series.channels = block[2];
+
+  uint8_t count = block[3];
+
+  if (series.version != SeriesDecoderVersion) { return false; }
+
+  size_t i = 4;
+  uint32_t time_s = 0;
+
+  if (!varint(block,length,i,time_s)) { return false; }
+
+  uint32_t delta = 0;
+  std::vector<uint32_t> values(series.channels,0);
+
+  for (uint8_t r = 0; r < count; r++) {
+
+    uint32_t encoded = 0;
+
+    if (!varint(block,length,i,encoded)) { return false; }
+
+    delta += unzigzag(encoded);
+    time_s += delta;
+
+    SeriesReading reading = { time_s, { } };
+
+    for (uint8_t c = 0; c < series.channels; c++) {
+
+      if (!varint(block,length,i,encoded)) { return false; }
+
+      values[c] += unzigzag(encoded);
+      reading.values.push_back((int32_t)values[c]);
+
+    }
+
+    series.readings.push_back(reading);
+
+  }
+
+  return i == length;
+
+}
+
+
+bool decodeBase64(const char * text, std::vector<uint8_t> & data) {
+
+  const char * alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  data.clear();
+
+  size_t length = strlen(text);
+
+  if (length % 4 != 0) { return false; }
+
+  for (size_t i = 0; i < length; i += 4) {
+
+    uint32_t group = 0;
+    uint8_t padding = 0;
+
+    for (size_t j = 0; j < 4; j++) {
+
+      char c = text[i + j];
+
+      // padding only at the very end
+      if (c == '=' && i + 4 == length && j >= 2) { padding++; group <<= 6; continue; }
+
+      const char * found = (c && !padding) ? strchr(alphabet,c) : nullptr;
+
+      if (!found) { return false; }
+
+      group = (group << 6) | (uint32_t)(found - alphabet);
+
+    }
+
+    data.push_back(group >> 16);
+    if (padding < 2) { data.push_back((group >> 8) & 0xFF); }
+    if (padding < 1) { data.push_back(group & 0xFF); }
+
+  }
+
+  return true;
+
+}
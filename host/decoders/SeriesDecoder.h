@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ *
+ *  Decoder for the compressed series blocks the sketch publishes with
+ *  CompressedBacklog (the format is described in Series.h in the
+ *  sketch and in the README)
+ *
+ *  Times and values are rebuilt with 32-bit wrapping arithmetic, as
+ *  the encoder computed its deltas, so a device clock which wraps
+ *  past 2^32 within a block decodes correctly.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+typedef struct {
+  uint32_t time_s;
+  std::vector<int32_t> values;        // one per channel
+} SeriesReading;
+
+typedef struct {
+  uint8_t version;
+  uint8_t timebase;                   // 1 = Unix time, 0 = the device's own clock
+  uint8_t channels;
+  std::vector<SeriesReading> readings;
+} SeriesDecoded;
+
+
+/*
+ * Decode a block. Returns false (and leaves series incomplete) if the
+ * block is truncated, has bytes left over, or is a version this
+ * decoder doesn't know.
+ */
+bool decodeSeriesBlock(const uint8_t * block, size_t length, SeriesDecoded & series);
+
+// the "block" member of a JSON series payload (RFC 4648 base64) - false if malformed
+bool decodeBase64(const char * text, std::vector<uint8_t> & data);
@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for the Adafruit BMP280 library
+ *
+ *  The sketch only uses it to find and configure the sensor. begin()
+ *  reads the chip ID through the simulated I2C bus (see Wire.h).
+ *
+ */
+
+
+#include <Adafruit_Sensor.h>
+#include <Wire.h>
+
+
+#define BMP280_ADDRESS 0x77
+#define BMP280_ADDRESS_ALT 0x76
+#define BMP280_CHIPID 0x58
+
+
+class Adafruit_BMP280 {
+
+  public:
+
+    enum sensor_sampling {
+      SAMPLING_NONE = 0x00,
+      SAMPLING_X1 = 0x01,
+      SAMPLING_X2 = 0x02,
+      SAMPLING_X4 = 0x03,
+      SAMPLING_X8 = 0x04,
+      SAMPLING_X16 = 0x05
+    };
+
+    enum sensor_mode {
+      MODE_SLEEP = 0x00,
+      MODE_FORCED = 0x01,
+      MODE_NORMAL = 0x03,
+      MODE_SOFT_RESET_CODE = 0xB6
+    };
+
+    enum sensor_filter {
+      FILTER_OFF = 0x00,
+      FILTER_X2 = 0x01,
+      FILTER_X4 = 0x02,
+      FILTER_X8 = 0x03,
+      FILTER_X16 = 0x04
+    };
+
+    enum standby_duration {
+      STANDBY_MS_1 = 0x00,
+      STANDBY_MS_63 = 0x01,
+      STANDBY_MS_125 = 0x02,
+      STANDBY_MS_250 = 0x03,
+      STANDBY_MS_500 = 0x04,
+      STANDBY_MS_1000 = 0x05,
+      STANDBY_MS_2000 = 0x06,
+      STANDBY_MS_4000 = 0x07
+    };
+
+
+    bool begin(uint8_t address = BMP280_ADDRESS, uint8_t chipID = BMP280_CHIPID) {
+
+      Wire.beginTransmission(address);
+      Wire.write(0xD0);
+
+      if (Wire.endTransmission(false) != 0) { return false; }
+      if (Wire.requestFrom(address,1) != 1) { return false; }
+
+      return (Wire.read() == chipID);
+
+    }
+
+
+    void setSampling(
+      sensor_mode mode = MODE_NORMAL,
+      sensor_sampling temperatureSampling = SAMPLING_X16,
+      sensor_sampling pressureSampling = SAMPLING_X16,
+      sensor_filter filter = FILTER_OFF,
+      standby_duration standby = STANDBY_MS_1
+    ) {
+
+      (void)mode; (void)temperatureSampling; (void)pressureSampling; (void)filter; (void)standby;
+
+    }
+
+
+    Adafruit_Sensor * getTemperatureSensor() { return &temperatureSensor; }
+
+  private:
+
+    Adafruit_Sensor temperatureSensor;
+
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for the Adafruit Unified Sensor library
+ *
+ */
+
+
+#include <Arduino.h>
+
+
+class Adafruit_Sensor {
+
+  public:
+
+    void printSensorDetails() { Serial.print("host BMP280\n"); }
+
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for the ESP8266 Arduino core
+ *
+ *  Only what the sketch uses. Time comes from the virtual clock (see
+ *  Host.h) and, as on the board, millis() is 32 bits and wraps after
+ *  49.7 days.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#include "Host.h"
+
+
+#define ESP8266 1
+#define ARDUINO_ARCH_ESP8266 1
+
+#define LOW 0
+#define HIGH 1
+
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+#define OUTPUT_OPEN_DRAIN 0x03
+
+#define LED_BUILTIN 2
+#define SDA 4
+#define SCL 5
+
+
+// time
+
+inline unsigned long millis() { return (uint32_t)((host->now_us - host->boot_us) / 1000); }
+
+inline unsigned long micros() { return (uint32_t)(host->now_us - host->boot_us); }
+
+inline void delay(unsigned long ms) { hostAdvance((uint64_t)ms * 1000); }
+
+inline void delayMicroseconds(unsigned int us) { hostAdvance(us); }
+
+// a pass through the SDK - not free, so a busy loop still moves the clock
+const uint64_t HostYield_us = 100;
+
+inline void yield() { hostAdvance(HostYield_us); }
+
+// see Clock.h - the SNTP stand-in is in Host.cpp
+void configTime(int timezone_s, int daylightOffset_s, const char * server);
+
+
+// pins (nothing is attached - the I2C bus is simulated in Wire.h)
+
+inline void pinMode(uint8_t, uint8_t) { }
+
+inline void digitalWrite(uint8_t, uint8_t) { }
+
+inline int digitalRead(uint8_t) { return HIGH; }
+
+
+// random numbers in [0,limit) and [low,high)
+
+inline long random(long limit) { return (limit > 0) ? hostRandom(limit) : 0; }
+
+inline long random(long low, long high) { return (high > low) ? low + hostRandom(high - low) : low; }
+
+inline void randomSeed(unsigned long) { }
+
+
+class String {
+
+  public:
+
+    String(const char * value = "") : value(value) { }
+
+    const char * c_str() const { return value.c_str(); }
+
+    size_t length() const { return value.length(); }
+
+  private:
+
+    std::string value;
+
+};
+
+
+class IPAddress {
+
+  public:
+
+    IPAddress() : address(0) { }
+
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) :
+      address(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) { }
+
+    IPAddress(uint32_t address) : address(address) { }
+
+    operator uint32_t() const { return address; }
+
+    bool isSet() const { return address != 0; }
+
+    String toString() const {
+
+      char text[16];
+      snprintf(text,sizeof(text),"%u.%u.%u.%u",address & 0xFF,(address >> 8) & 0xFF,(address >> 16) & 0xFF,address >> 24);
+
+      return String(text);
+
+    }
+
+  private:
+
+    uint32_t address;
+
+};
+
+
+class HostSerial {
+
+  public:
+
+    void begin(unsigned long) { }
+
+    operator bool() const { return true; }
+
+    void flush() { fflush(stdout); }
+
+    int printf(const char * format, ...) __attribute__((format(printf,2,3)));
+
+    void print(const char * text) { if (hostVerbose) { fputs(text,stdout); } }
+
+    void print(const String & text) { print(text.c_str()); }
+
+    void print(const IPAddress & address) { print(address.toString()); }
+
+    void println() { print("\n"); }
+
+    template <typename T>
+    void println(const T & value) { print(value); println(); }
+
+};
+
+extern HostSerial Serial;
+
+
+// reset reasons (see user_interface.h)
+#define REASON_DEFAULT_RST 0
+#define REASON_DEEP_SLEEP_AWAKE 5
+#define REASON_EXT_SYS_RST 6
+
+struct rst_info {
+  uint32_t reason;
+};
+
+typedef enum {
+  RF_DEFAULT = 0,
+  RF_CAL = 1,
+  RF_NO_CAL = 2,
+  RF_DISABLED = 4
+} RFMode;
+
+
+class HostESP {
+
+  public:
+
+    rst_info * getResetInfoPtr() { resetInfo.reason = host->resetReason; return &resetInfo; }
+
+    // advances the clock and ends the boot (see hostRun())
+    [[noreturn]] void deepSleep(uint64_t time_us, RFMode mode = RF_DEFAULT);
+
+    // offset in 4-byte blocks, like the SDK
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t * data, size_t size);
+
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t * data, size_t size);
+
+    uint32_t getFreeHeap() { return 40000; }
+
+  private:
+
+    rst_info resetInfo;
+
+};
+
+extern HostESP ESP;
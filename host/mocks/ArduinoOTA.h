@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for ArduinoOTA - nobody ever asks for an update
+ *
+ */
+
+
+#include <Arduino.h>
+#include <functional>
+
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+
+class HostOTA {
+
+  public:
+
+    void setPort(uint16_t) { }
+
+    void setHostname(const char *) { }
+
+    void setPassword(const char *) { }
+
+    void onError(std::function<void(ota_error_t)> callback) { onErrorCallback = callback; }
+
+    void begin() { }
+
+    void handle() { }
+
+  private:
+
+    std::function<void(ota_error_t)> onErrorCallback;
+
+};
+
+extern HostOTA ArduinoOTA;
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for AsyncDelay (Steve Marple)
+ *
+ *  The same arithmetic as the library: 32-bit and wrap-safe. A timer
+ *  which has never been started counts as expired.
+ *
+ */
+
+
+#include <Arduino.h>
+
+
+class AsyncDelay {
+
+  public:
+
+    enum units_t { MICROS, MILLIS };
+
+    void start(unsigned long delay, units_t units) {
+
+      this->delay = delay;
+      this->units = units;
+
+      restart();
+
+    }
+
+    void restart() { expires = now() + delay; isStarted = true; }
+
+    void expire() { expires = now(); isStarted = true; }
+
+    bool isExpired() const { return !isStarted || (int32_t)((uint32_t)now() - (uint32_t)expires) >= 0; }
+
+    unsigned long getDelay() const { return delay; }
+
+    unsigned long getExpiry() const { return expires; }
+
+  private:
+
+    unsigned long delay = 0;
+    unsigned long expires = 0;
+    units_t units = MILLIS;
+    bool isStarted = false;
+
+    unsigned long now() const { return (units == MILLIS) ? millis() : micros(); }
+
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for ESP8266WiFi
+ *
+ *  One access point. A full connect scans for it, joins it and asks
+ *  DHCP for an address. A fast connect (channel and BSSID given) skips
+ *  the scan and, if an address has been configured, DHCP too (see the
+ *  timings in HostState). Nothing connects during a WiFi outage and an
+ *  outage drops an established connection.
+ *
+ *  DHCP grants a lease of host->dhcpLease_s. A connection which
+ *  configures a previously granted address instead of asking DHCP
+ *  counts as a lease reuse and, once the lease has run out, as a
+ *  stale one (see host->wifi).
+ *
+ *  WiFiClient is the TCP connection to the broker stand-in, which
+ *  MQTTClient opens and closes (see MQTT.h). Bytes written to it cost
+ *  the time to send them at host->broker.bytesPerSecond. The broker
+ *  reads the packets they make up and answers a QoS 1 PUBLISH with a
+ *  PUBACK, which can be read back a round trip later. The connection
+ *  closes during an outage.
+ *
+ */
+
+
+#include <Arduino.h>
+
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1
+} WiFiMode_t;
+
+typedef enum {
+  WIFI_NONE_SLEEP = 0,
+  WIFI_LIGHT_SLEEP = 1,
+  WIFI_MODEM_SLEEP = 2
+} WiFiSleepType_t;
+
+
+class HostWiFi {
+
+  public:
+
+    wl_status_t status();
+
+    bool begin(const char * ssid, const char * psk, int32_t channel = 0, const uint8_t * bssid = nullptr, bool connect = true);
+
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+
+    bool disconnect(bool wifiOff = false);
+
+    bool mode(WiFiMode_t mode);
+
+    void persistent(bool) { }
+
+    bool setSleepMode(WiFiSleepType_t, uint8_t = 0) { return true; }
+
+    bool setHostname(const char *) { return true; }
+
+    String SSID() { return String("host"); }
+
+    String macAddress() { return String("02:00:00:00:00:01"); }
+
+    uint8_t * BSSID() { return bssid; }
+
+    int32_t channel() { return HostChannel; }
+
+    IPAddress localIP() { return isConnected() ? address : IPAddress(); }
+
+    IPAddress gatewayIP() { return isConnected() ? IPAddress(192,168,1,1) : IPAddress(); }
+
+    IPAddress subnetMask() { return isConnected() ? IPAddress(255,255,255,0) : IPAddress(); }
+
+    IPAddress dnsIP(uint8_t = 0) { return isConnected() ? IPAddress(192,168,1,1) : IPAddress(); }
+
+  private:
+
+    static const int32_t HostChannel = 6;
+
+    uint8_t bssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+    typedef enum { Idle, Connecting, Connected } State;
+
+    State state = Idle;
+    bool isFast = false;
+    uint64_t connected_us = 0;            // when the connection attempt completes
+    IPAddress configured;                 // from config() - 0.0.0.0 means ask DHCP
+    IPAddress address;
+
+    bool isConnected() { return status() == WL_CONNECTED; }
+
+};
+
+extern HostWiFi WiFi;
+
+
+// the largest packet the broker stand-in takes, and the PUBACKs it can have on the way back
+const size_t HostPacketMax_bytes = 1024;
+const size_t HostMaxAcks = 64;
+
+
+class WiFiClient {
+
+  public:
+
+    size_t write(const uint8_t * buffer, size_t size);
+
+    size_t write(uint8_t byte) { return write(&byte,1); }
+
+    int available();
+
+    int read();
+
+    uint8_t connected();
+
+    void stop() { close(); }
+
+  private:
+
+    friend class MQTTClient;
+
+    bool isOpen = false;
+
+    // a QoS 1 PUBLISH or PUBACK went missing - like a TCP stream, nothing after it gets through
+    bool isStalled = false;
+
+    // the packet the broker is part-way through receiving
+    uint8_t received[HostPacketMax_bytes];
+    size_t receivedLength = 0;
+
+    // PUBACKs on their way back, oldest first
+    struct { uint16_t packetID; uint64_t due_us; } acks[HostMaxAcks];
+    size_t ackCount = 0;
+    size_t ackBytesRead = 0;              // of the oldest
+
+    void open();
+
+    void close();
+
+    // the broker's side of a complete packet
+    void receive(const uint8_t * packet, size_t length);
+
+};
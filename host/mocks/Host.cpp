@@ -0,0 +1,903 @@
+/*
+ *
+ *  The simulated board and its surroundings (see Host.h)
+ *
+ */
+
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ArduinoOTA.h>
+#include <MQTT.h>
+#include <Wire.h>
+#include <Adafruit_BMP280.h>
+#include <LittleFS.h>
+#include <coredecls.h>
+
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <filesystem>
+
+
+// until hostBegin() moves it to shared memory
+static HostState localState = { };
+
+HostState * host = &localState;
+
+bool hostVerbose = false;
+
+void (*hostOnPublish)(const char * topic, const char * payload, size_t length, bool isDuplicate) = nullptr;
+
+HostSerial Serial;
+HostESP ESP;
+HostWiFi WiFi;
+HostOTA ArduinoOTA;
+HostWire Wire;
+fs::FS LittleFS;
+
+
+// how a boot ended (the exit status of its process)
+const int HostBootReachedEnd = 0;
+const int HostBootSlept = 42;
+
+static bool isBooted = false;
+
+static std::string fileSystemRoot;
+static bool isFileSystemTemporary = false;
+
+
+void hostBegin(uint32_t seed, const char * root) {
+
+  void * shared = mmap(nullptr,sizeof(HostState),PROT_READ | PROT_WRITE,MAP_SHARED | MAP_ANONYMOUS,-1,0);
+
+  if (shared == MAP_FAILED) { perror("hostBegin"); exit(1); }
+
+  host = (HostState *)shared;
+  memset(host,0,sizeof(HostState));
+
+  host->randomState = 0x9E3779B97F4A7C15ULL ^ seed;
+  host->epochAtPowerUp_s = 1767225600;        // 2026-01-01T00:00Z
+
+  // RTC memory holds garbage after a power-up
+  for (size_t i = 0; i < sizeof(host->rtcMemory); i++) { host->rtcMemory[i] = hostRandom(256); }
+  host->resetReason = REASON_DEFAULT_RST;
+
+  host->scan_ms = 2000;
+  host->associate_ms = 300;
+  host->dhcp_ms = 1000;
+  host->dhcpLease_s = 24*60*60;
+
+  host->isSNTPAvailable = true;
+
+  host->broker.latency_ms = 5;
+  host->broker.timeout_ms = 1000;             // arduino-mqtt's default
+  host->broker.bytesPerSecond = 100000;
+
+  if (root) {
+    fileSystemRoot = root;
+    isFileSystemTemporary = false;
+  } else {
+    char path[] = "/tmp/sketch-host-XXXXXX";
+    if (!mkdtemp(path)) { perror("hostBegin"); exit(1); }
+    fileSystemRoot = path;
+    isFileSystemTemporary = true;
+  }
+
+}
+
+
+void hostEnd() {
+
+  if (isFileSystemTemporary) {
+    std::error_code ignored;
+    std::filesystem::remove_all(fileSystemRoot,ignored);
+  }
+
+  if (host != &localState) {
+    munmap(host,sizeof(HostState));
+    host = &localState;
+  }
+
+}
+
+
+const char * hostFileSystemRoot() { return fileSystemRoot.c_str(); }
+
+
+uint32_t hostRandom(uint32_t limit) {
+
+  // xorshift64*
+  uint64_t & x = host->randomState;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+
+  return limit ? (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32) % limit : 0;
+
+}
+
+
+/*
+ * The SNTP stand-in. The SDK answers a little after configTime() and
+ * then every hour, from its own context - here, whenever the clock
+ * moves.
+ */
+static void (*sntpCallback)() = nullptr;
+static bool isSNTPConfigured = false;
+static uint64_t sntpNext_us = 0;
+
+const uint64_t HostSNTPDelay_us = 50*1000;
+const uint64_t HostSNTPInterval_us = 60*60*1000000ULL;
+
+
+void settimeofday_cb(void (*callback)()) { sntpCallback = callback; }
+
+
+void configTime(int, int, const char *) {
+
+  isSNTPConfigured = true;
+  sntpNext_us = host->now_us + HostSNTPDelay_us;
+
+}
+
+
+int hostGettimeofday(struct timeval * tv, void *) {
+
+  tv->tv_sec = host->epochAtPowerUp_s + host->now_us / 1000000;
+  tv->tv_usec = host->now_us % 1000000;
+
+  return 0;
+
+}
+
+
+void hostAdvance(uint64_t us) {
+
+  host->now_us += us;
+
+  if (isSNTPConfigured && host->now_us >= sntpNext_us) {
+
+    // no answer - try again later
+    sntpNext_us = host->now_us + HostSNTPDelay_us;
+
+    if (host->isSNTPAvailable && WiFi.status() == WL_CONNECTED) {
+
+      sntpNext_us = host->now_us + HostSNTPInterval_us;
+
+      if (sntpCallback) { sntpCallback(); }
+
+    }
+
+  }
+
+}
+
+
+uint64_t hostNow_ms() { return host->now_us / 1000; }
+
+
+void hostAddOutage(HostOutageList & list, uint64_t start_ms, uint64_t duration_ms) {
+
+  if (list.count >= HostMaxOutages) { fprintf(stderr,"too many outages\n"); exit(1); }
+
+  list.outages[list.count++] = { start_ms, duration_ms };
+
+}
+
+
+bool hostIsOut(const HostOutageList & list) {
+
+  uint64_t now_ms = hostNow_ms();
+
+  for (size_t i = 0; i < list.count; i++) {
+    if (now_ms >= list.outages[i].start_ms && now_ms < list.outages[i].start_ms + list.outages[i].duration_ms) { return true; }
+  }
+
+  return false;
+
+}
+
+
+bool hostRun(void (*setup)(), void (*loop)(), uint64_t until_ms) {
+
+  while (hostNow_ms() < until_ms) {
+
+    // nothing buffered may be written twice
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t boot = fork();
+
+    if (boot < 0) { perror("hostRun"); return false; }
+
+    if (boot == 0) {
+
+      isBooted = true;
+
+      host->boots++;
+      host->boot_us = host->now_us;
+
+      setup();
+
+      while (hostNow_ms() < until_ms) { loop(); }
+
+      fflush(stdout);
+      _exit(HostBootReachedEnd);
+
+    }
+
+    int status = 0;
+
+    if (waitpid(boot,&status,0) != boot) { perror("hostRun"); return false; }
+
+    if (!WIFEXITED(status)) { return false; }
+
+    if (WEXITSTATUS(status) == HostBootReachedEnd) { return true; }
+
+    if (WEXITSTATUS(status) != HostBootSlept) { return false; }
+
+  }
+
+  return true;
+
+}
+
+
+bool hostIsBooted() { return isBooted; }
+
+
+void hostStop() {
+
+  if (!isBooted) {
+    fprintf(stderr,"hostStop() called outside hostRun()\n");
+    exit(1);
+  }
+
+  fflush(stdout);
+  _exit(HostBootReachedEnd);
+
+}
+
+
+/*
+ * The board
+ */
+
+int HostSerial::printf(const char * format, ...) {
+
+  if (!hostVerbose) { return 0; }
+
+  va_list arguments;
+  va_start(arguments,format);
+  int length = vprintf(format,arguments);
+  va_end(arguments);
+
+  return length;
+
+}
+
+
+void HostESP::deepSleep(uint64_t time_us, RFMode) {
+
+  if (!isBooted) {
+    fprintf(stderr,"ESP.deepSleep() called outside hostRun()\n");
+    exit(1);
+  }
+
+  host->deepSleeps++;
+  host->now_us += time_us;
+  host->resetReason = REASON_DEEP_SLEEP_AWAKE;
+
+  fflush(stdout);
+  _exit(HostBootSlept);
+
+}
+
+
+bool HostESP::rtcUserMemoryRead(uint32_t offset, uint32_t * data, size_t size) {
+
+  if (offset * 4 + size > sizeof(host->rtcMemory)) { return false; }
+
+  memcpy(data,host->rtcMemory + offset * 4,size);
+
+  return true;
+
+}
+
+
+bool HostESP::rtcUserMemoryWrite(uint32_t offset, uint32_t * data, size_t size) {
+
+  if (offset * 4 + size > sizeof(host->rtcMemory)) { return false; }
+
+  memcpy(host->rtcMemory + offset * 4,data,size);
+
+  return true;
+
+}
+
+
+/*
+ * The access point
+ */
+
+wl_status_t HostWiFi::status() {
+
+  bool isOut = hostIsOut(host->wifiOutages);
+
+  if (state == Connecting && !isOut && host->now_us >= connected_us) {
+
+    state = Connected;
+
+    if (configured.isSet()) {
+
+      address = configured;
+
+      // an address which came from DHCP once before?
+      if (isFast) {
+        host->wifi.leaseReuses++;
+        if (host->now_us - host->leaseGranted_us > host->dhcpLease_s * 1000000ULL) { host->wifi.staleLeases++; }
+      }
+
+    } else {
+
+      address = IPAddress(192,168,1,100);
+      host->leaseGranted_us = host->now_us;
+
+    }
+
+    if (isFast) { host->wifi.fastConnects++; } else { host->wifi.fullConnects++; }
+
+  }
+
+  // an outage drops the connection
+  if (state == Connected && isOut) { state = Idle; }
+
+  return (state == Connected) ? WL_CONNECTED : WL_DISCONNECTED;
+
+}
+
+
+bool HostWiFi::begin(const char *, const char *, int32_t channel, const uint8_t * bssid, bool) {
+
+  isFast = (channel != 0) && bssid;
+
+  uint32_t connect_ms = host->associate_ms;
+  if (!isFast) { connect_ms += host->scan_ms; }
+  if (!configured.isSet()) { connect_ms += host->dhcp_ms; }
+
+  state = Connecting;
+  connected_us = host->now_us + connect_ms * 1000ULL;
+
+  return true;
+
+}
+
+
+bool HostWiFi::config(IPAddress local, IPAddress, IPAddress, IPAddress, IPAddress) {
+
+  configured = local;
+
+  return true;
+
+}
+
+
+bool HostWiFi::disconnect(bool) {
+
+  state = Idle;
+
+  return true;
+
+}
+
+
+bool HostWiFi::mode(WiFiMode_t mode) {
+
+  if (mode == WIFI_OFF) { state = Idle; }
+
+  return true;
+
+}
+
+
+/*
+ * The broker
+ */
+
+// the broker's side of a PUBLISH
+static void brokerDeliver(const char * topic, const char * payload, size_t length, bool isDuplicate) {
+
+  HostBrokerStats & stats = host->brokerStats;
+
+  stats.received++;
+  stats.bytes += length;
+  if (isDuplicate) { stats.duplicates++; }
+
+  uint32_t t = 0;
+  while (t < stats.topicCount && strcmp(stats.topics[t],topic) != 0) { t++; }
+
+  if (t == stats.topicCount && t < HostMaxTopics) {
+    snprintf(stats.topics[t],HostMaxTopicLength,"%s",topic);
+    stats.topicCount++;
+  }
+
+  if (t < stats.topicCount) { stats.topicReceived[t]++; }
+
+  if (hostOnPublish) { hostOnPublish(topic,payload,length,isDuplicate); }
+
+}
+
+
+// note a QoS 1 delivery, counting it if the same packet had already been delivered
+static void brokerRemember(uint16_t packetID, bool isDuplicate) {
+
+  uint8_t & bits = host->brokerPacketIDs[packetID / 8];
+  uint8_t bit = 1 << (packetID % 8);
+
+  // a packet ID without DUP is a new packet (IDs wrap)
+  if (isDuplicate && (bits & bit)) { host->brokerStats.repeats++; }
+
+  bits |= bit;
+
+}
+
+
+bool MQTTClient::connect(const char *, bool) {
+
+  if (netClient) { netClient->close(); }
+
+  if (!netClient || WiFi.status() != WL_CONNECTED || hostIsOut(host->brokerOutages)) {
+
+    hostAdvance(host->broker.timeout_ms * 1000ULL);
+
+    host->brokerStats.refusedConnects++;
+
+    error = LWMQTT_NETWORK_FAILED_CONNECT;
+    code = LWMQTT_SERVER_UNAVAILABLE;
+
+    return false;
+
+  }
+
+  // CONNECT, CONNACK
+  hostAdvance(2 * host->broker.latency_ms * 1000ULL);
+
+  host->brokerStats.connects++;
+
+  netClient->open();
+  error = LWMQTT_SUCCESS;
+  code = LWMQTT_CONNECTION_ACCEPTED;
+
+  return true;
+
+}
+
+
+bool MQTTClient::connected() {
+
+  return netClient && netClient->connected();
+
+}
+
+
+bool MQTTClient::publish(const char * topic, const char * payload, int length, bool, int qos) {
+
+  if (!connected()) {
+    error = LWMQTT_NETWORK_FAILED_WRITE;
+    return false;
+  }
+
+  // fixed header, remaining length, topic and packet ID
+  size_t packet = 1 + 2 + 2 + strlen(topic) + (qos ? 2 : 0) + length;
+
+  if (packet > (size_t)bufferSize) {
+    error = LWMQTT_NETWORK_FAILED_WRITE;
+    return false;
+  }
+
+  hostAdvance(packet * 1000000ULL / host->broker.bytesPerSecond);
+
+  bool isDuplicate = (duplicateID != 0);
+
+  if (qos == 0) {
+    packetID = 0;
+  } else if (isDuplicate) {
+    packetID = duplicateID;
+  } else {
+    packetID = nextPacketID++;
+    if (nextPacketID == 0) { nextPacketID = 1; }
+  }
+
+  duplicateID = 0;
+
+  if (hostRandom(100) < host->broker.dropPercent) {
+
+    netClient->close();
+
+    host->brokerStats.drops++;
+
+    error = LWMQTT_NETWORK_FAILED_WRITE;
+
+    return false;
+
+  }
+
+  bool isLost = hostRandom(100) < host->broker.lossPercent;
+
+  if (qos == 0) {
+
+    // nobody notices
+    if (isLost) { host->brokerStats.lost++; } else { brokerDeliver(topic,payload,length,false); }
+
+    error = LWMQTT_SUCCESS;
+
+    return true;
+
+  }
+
+  if (isLost) {
+
+    host->brokerStats.lost++;
+
+    // the PUBACK rather than the PUBLISH went missing?
+    if (hostRandom(2)) { brokerDeliver(topic,payload,length,isDuplicate); }
+
+    hostAdvance(host->broker.timeout_ms * 1000ULL);
+
+    error = LWMQTT_NETWORK_TIMEOUT;
+
+    return false;
+
+  }
+
+  brokerDeliver(topic,payload,length,isDuplicate);
+
+  // PUBLISH, PUBACK
+  hostAdvance(2 * host->broker.latency_ms * 1000ULL);
+
+  error = LWMQTT_SUCCESS;
+
+  return true;
+
+}
+
+
+bool MQTTClient::disconnect() {
+
+  if (connected()) {
+
+    hostAdvance(host->broker.latency_ms * 1000ULL);
+
+    host->brokerStats.disconnects++;
+
+  }
+
+  if (netClient) { netClient->close(); }
+
+  return true;
+
+}
+
+
+void WiFiClient::open() {
+
+  isOpen = true;
+  isStalled = false;
+  receivedLength = 0;
+  ackCount = 0;
+  ackBytesRead = 0;
+
+}
+
+
+void WiFiClient::close() {
+
+  isOpen = false;
+
+}
+
+
+uint8_t WiFiClient::connected() {
+
+  // the network or the broker went away mid-session
+  if (isOpen && (WiFi.status() != WL_CONNECTED || hostIsOut(host->brokerOutages))) {
+
+    close();
+
+    host->brokerStats.drops++;
+
+  }
+
+  return isOpen;
+
+}
+
+
+size_t WiFiClient::write(const uint8_t * buffer, size_t size) {
+
+  if (!connected()) { return 0; }
+
+  hostAdvance(size * 1000000ULL / host->broker.bytesPerSecond);
+
+  for (size_t i = 0; i < size && isOpen; i++) {
+
+    if (receivedLength == sizeof(received)) { close(); break; }
+
+    received[receivedLength++] = buffer[i];
+
+    // sense a complete packet: fixed header, remaining length (7 bits a byte) and the rest
+    size_t remaining = 0;
+    size_t length = 1;
+    bool isComplete = false;
+
+    for (int shift = 0; length < receivedLength && shift < 28; shift += 7) {
+
+      uint8_t digit = received[length++];
+      remaining |= (size_t)(digit & 0x7F) << shift;
+
+      if (!(digit & 0x80)) {
+        isComplete = (receivedLength == length + remaining);
+        break;
+      }
+
+    }
+
+    if (isComplete) {
+      receivedLength = 0;
+      receive(received,length + remaining);
+    }
+
+  }
+
+  return isOpen ? size : 0;
+
+}
+
+
+void WiFiClient::receive(const uint8_t * packet, size_t length) {
+
+  // only PUBLISH packets are looked at
+  if ((packet[0] >> 4) != 3) { return; }
+
+  bool isDuplicate = packet[0] & 0x08;
+  int qos = (packet[0] >> 1) & 3;
+
+  size_t at = 1;
+  while (packet[at++] & 0x80) { }
+
+  size_t topicLength = (packet[at] << 8) | packet[at + 1];
+  at += 2;
+
+  char topic[HostMaxTopicLength + 1];
+  snprintf(topic,sizeof(topic),"%.*s",(int)topicLength,(const char *)packet + at);
+  at += topicLength;
+
+  uint16_t packetID = 0;
+  if (qos) { packetID = (packet[at] << 8) | packet[at + 1]; at += 2; }
+
+  if (isStalled) { return; }
+
+  // as for MQTTClient::publish()
+  if (hostRandom(100) < host->broker.dropPercent) {
+
+    close();
+
+    host->brokerStats.drops++;
+
+    return;
+
+  }
+
+  std::string payload((const char *)packet + at,length - at);
+
+  bool isLost = hostRandom(100) < host->broker.lossPercent;
+
+  if (isLost) {
+
+    host->brokerStats.lost++;
+
+    // the PUBACK rather than the PUBLISH went missing?
+    if (qos && hostRandom(2)) {
+      brokerDeliver(topic,payload.c_str(),payload.size(),isDuplicate);
+      brokerRemember(packetID,isDuplicate);
+    }
+
+    // at QoS 1 the session hangs until the client gives up on it
+    isStalled = (qos > 0);
+
+    return;
+
+  }
+
+  brokerDeliver(topic,payload.c_str(),payload.size(),isDuplicate);
+
+  if (qos == 0) { return; }
+
+  brokerRemember(packetID,isDuplicate);
+
+  if (ackCount == HostMaxAcks) { return; }
+
+  // PUBLISH there, PUBACK back
+  acks[ackCount].packetID = packetID;
+  acks[ackCount].due_us = host->now_us + 2 * host->broker.latency_ms * 1000ULL;
+  ackCount++;
+
+}
+
+
+int WiFiClient::available() {
+
+  if (!connected()) { return 0; }
+
+  size_t due = 0;
+  while (due < ackCount && acks[due].due_us <= host->now_us) { due++; }
+
+  return due * 4 - ackBytesRead;
+
+}
+
+
+int WiFiClient::read() {
+
+  if (available() <= 0) { return -1; }
+
+  // PUBACK: fixed header, remaining length 2, packet ID
+  uint8_t puback[4] = { 0x40, 0x02, (uint8_t)(acks[0].packetID >> 8), (uint8_t)(acks[0].packetID & 0xFF) };
+
+  uint8_t byte = puback[ackBytesRead++];
+
+  if (ackBytesRead == sizeof(puback)) {
+    memmove(acks,acks + 1,(ackCount - 1) * sizeof(acks[0]));
+    ackCount--;
+    ackBytesRead = 0;
+  }
+
+  return byte;
+
+}
+
+
+/*
+ * The BMP280s
+ */
+
+typedef struct {
+  uint8_t registers[256];
+  uint64_t measured_us;           // when the conversion in progress finishes
+  bool isReady;
+} HostBMP280;
+
+static HostBMP280 bmp280s[2];
+
+static uint8_t registerPointer = 0;
+
+
+static HostBMP280 * bmp280At(uint8_t address) {
+
+  if (hostIsOut(host->sensorOutages)) { return nullptr; }
+
+  if (address != BMP280_ADDRESS && address != BMP280_ADDRESS_ALT) { return nullptr; }
+
+  HostBMP280 & sensor = bmp280s[address - BMP280_ADDRESS_ALT];
+
+  if (!sensor.isReady) {
+
+    // the datasheet's example trimming parameters (section 8.2)
+    const uint16_t calibration[12] = {
+      27504, 26435, (uint16_t)-1000,
+      36477, (uint16_t)-10685, 3024, 2855, 140, (uint16_t)-7, 15500, (uint16_t)-14600, 6000
+    };
+
+    for (int i = 0; i < 12; i++) {
+      sensor.registers[0x88 + 2 * i] = calibration[i] & 0xFF;
+      sensor.registers[0x89 + 2 * i] = calibration[i] >> 8;
+    }
+
+    sensor.registers[0xD0] = BMP280_CHIPID;
+
+    sensor.isReady = true;
+
+  }
+
+  return &sensor;
+
+}
+
+
+// a forced conversion - the raw readings swing either side of the datasheet's example
+static void bmp280Convert(HostBMP280 & sensor) {
+
+  uint8_t control = sensor.registers[0xF4];
+
+  uint32_t temperatureSamples = (control >> 5) ? 1 << ((control >> 5) - 1) : 0;
+  uint32_t pressureSamples = ((control >> 2) & 7) ? 1 << (((control >> 2) & 7) - 1) : 0;
+
+  host->conversions++;
+
+  // typical measurement time (datasheet section 3.8.1)
+  sensor.measured_us = host->now_us + 1000 + 2000 * temperatureSamples + 2000 * pressureSamples + (pressureSamples ? 500 : 0);
+
+  double days = host->now_us / 86400e6;
+
+  int32_t adc_T = 519888 + (int32_t)(6000 * sin(2 * M_PI * days)) + (int32_t)hostRandom(61) - 30;
+  int32_t adc_P = 415148 + (int32_t)(4000 * sin(2 * M_PI * days / 3)) + (int32_t)hostRandom(81) - 40;
+
+  sensor.registers[0xF7] = adc_P >> 12;
+  sensor.registers[0xF8] = adc_P >> 4;
+  sensor.registers[0xF9] = adc_P << 4;
+  sensor.registers[0xFA] = adc_T >> 12;
+  sensor.registers[0xFB] = adc_T >> 4;
+  sensor.registers[0xFC] = adc_T << 4;
+
+}
+
+
+void HostWire::beginTransmission(uint8_t address) {
+
+  this->address = address;
+  isFirstByte = true;
+
+}
+
+
+size_t HostWire::write(uint8_t value) {
+
+  HostBMP280 * sensor = bmp280At(address);
+
+  if (!sensor) { return 0; }
+
+  if (isFirstByte) {
+    registerPointer = value;
+    isFirstByte = false;
+    return 1;
+  }
+
+  sensor->registers[registerPointer] = value;
+
+  // ctrl_meas asking for a forced conversion
+  if (registerPointer == 0xF4 && (value & 3) == Adafruit_BMP280::MODE_FORCED) { bmp280Convert(*sensor); }
+
+  registerPointer++;
+
+  return 1;
+
+}
+
+
+uint8_t HostWire::endTransmission(bool) {
+
+  return bmp280At(address) ? 0 : 2;
+
+}
+
+
+uint8_t HostWire::requestFrom(uint8_t address, uint8_t length) {
+
+  this->address = address;
+
+  available_bytes = bmp280At(address) ? length : 0;
+
+  return available_bytes;
+
+}
+
+
+int HostWire::read() {
+
+  HostBMP280 * sensor = bmp280At(address);
+
+  if (!sensor || available_bytes == 0) { return -1; }
+
+  available_bytes--;
+
+  uint8_t reg = registerPointer++;
+
+  // status - "measuring" until the conversion is done
+  if (reg == 0xF3) { return (host->now_us < sensor->measured_us) ? 0x08 : 0x00; }
+
+  return sensor->registers[reg];
+
+}
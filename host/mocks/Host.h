@@ -0,0 +1,175 @@
+#pragma once
+
+/*
+ *
+ *  The simulated board and its surroundings
+ *
+ *  The stand-ins for the Arduino and ESP8266 libraries in this
+ *  directory are driven by one HostState:
+ *
+ *  - a virtual clock. millis() reads it and delay() advances it, so
+ *    the sketch's scheduler (which spends nearly all its time in
+ *    delay()) runs weeks of simulated operation in seconds;
+ *  - the board - RTC user memory, the reset reason and how many times
+ *    it has booted;
+ *  - the access point, the broker and the sensors, each with a list
+ *    of outages and the counters the simulator and tests report.
+ *
+ *  hostRun() boots the sketch (setup() then loop()) repeatedly until
+ *  the clock reaches a given time. Every boot is a fork() of a process
+ *  which has never run the sketch, so each starts with the globals as
+ *  the compiler left them, exactly as after a real reset. ESP.deepSleep()
+ *  advances the clock by the length of the sleep and ends the boot.
+ *  HostState lives in shared memory so the clock, RTC memory and the
+ *  counters carry on across boots, and LittleFS is a directory of
+ *  ordinary files, so the spill log does too.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// a period during which something is unavailable
+typedef struct {
+  uint64_t start_ms;
+  uint64_t duration_ms;
+} HostOutage;
+
+const size_t HostMaxOutages = 16;
+
+typedef struct {
+  HostOutage outages[HostMaxOutages];
+  size_t count;
+} HostOutageList;
+
+
+// what the broker stand-in does to each exchange with it
+typedef struct {
+  uint32_t latency_ms;          // each way
+  uint32_t lossPercent;         // PUBLISH (or its PUBACK) lost
+  uint32_t dropPercent;         // session dropped instead of a PUBLISH arriving
+  uint32_t timeout_ms;          // how long the client waits for a reply
+  uint32_t bytesPerSecond;      // link speed
+} HostBrokerSettings;
+
+
+const size_t HostMaxTopics = 16;
+const size_t HostMaxTopicLength = 64;
+
+typedef struct {
+  uint32_t connects;
+  uint32_t refusedConnects;     // broker unavailable
+  uint32_t disconnects;
+  uint32_t drops;               // sessions dropped by the stand-in
+  uint32_t received;            // PUBLISH packets arriving (including duplicates)
+  uint32_t duplicates;          // ... with the DUP flag set
+  uint32_t repeats;             // ... and a packet ID already delivered (its PUBACK was lost)
+  uint32_t lost;                // PUBLISH packets (or PUBACKs) lost
+  uint64_t bytes;               // payload bytes received
+  uint32_t topicCount;
+  char topics[HostMaxTopics][HostMaxTopicLength];
+  uint32_t topicReceived[HostMaxTopics];
+} HostBrokerStats;
+
+
+typedef struct {
+  uint32_t fullConnects;        // scanned and asked DHCP
+  uint32_t fastConnects;        // went straight to a known access point
+  uint32_t leaseReuses;         // ... and reused a DHCP lease
+  uint32_t staleLeases;         // ... which DHCP had already expired
+} HostWiFiStats;
+
+
+typedef struct {
+
+  // the virtual clock (microseconds since power-up)
+  uint64_t now_us;
+  uint64_t boot_us;             // when the current boot started
+  uint32_t epochAtPowerUp_s;    // Unix time at power-up (for the SNTP stand-in)
+
+  // the board
+  uint8_t rtcMemory[512];
+  uint32_t resetReason;
+  uint32_t boots;
+  uint32_t deepSleeps;
+  uint64_t randomState;
+
+  // the access point
+  HostOutageList wifiOutages;
+  uint32_t scan_ms;             // finding the access point (full connects only)
+  uint32_t associate_ms;        // joining it
+  uint32_t dhcp_ms;             // asking DHCP for an address
+  uint32_t dhcpLease_s;
+  uint64_t leaseGranted_us;
+  HostWiFiStats wifi;
+
+  // the SNTP server (answers once WiFi is up, then every hour)
+  bool isSNTPAvailable;
+
+  // the broker
+  HostOutageList brokerOutages;
+  HostBrokerSettings broker;
+  HostBrokerStats brokerStats;
+  uint8_t brokerPacketIDs[65536 / 8];   // QoS 1 packet IDs delivered, one bit each
+
+  // the BMP280s (both stop answering during an outage)
+  HostOutageList sensorOutages;
+  uint32_t conversions;         // forced conversions started, over both
+
+} HostState;
+
+
+// in shared memory once hostBegin() has been called
+extern HostState * host;
+
+// Serial output is only shown if this is set
+extern bool hostVerbose;
+
+// called with every PUBLISH the broker receives (in the current process)
+extern void (*hostOnPublish)(const char * topic, const char * payload, size_t length, bool isDuplicate);
+
+
+/*
+ * Set up the simulated world (with the clock at zero and the board
+ * powered up). fileSystemRoot is where LittleFS keeps its files - if
+ * it is null, a new temporary directory is used and hostEnd() removes
+ * it.
+ */
+void hostBegin(uint32_t seed = 1, const char * fileSystemRoot = nullptr);
+
+// tear it down again (host no longer points at the simulated world)
+void hostEnd();
+
+const char * hostFileSystemRoot();
+
+
+// the virtual clock
+void hostAdvance(uint64_t us);
+
+uint64_t hostNow_ms();
+
+
+// outages, in milliseconds since power-up
+void hostAddOutage(HostOutageList & list, uint64_t start_ms, uint64_t duration_ms);
+
+bool hostIsOut(const HostOutageList & list);
+
+
+/*
+ * Boot the sketch and run it until the clock reaches until_ms,
+ * booting it again whenever it deep sleeps (or reboots). Returns
+ * false if a boot ended any other way (eg a crash).
+ */
+bool hostRun(void (*setup)(), void (*loop)(), uint64_t until_ms);
+
+// whether the code is running inside hostRun()
+bool hostIsBooted();
+
+// end hostRun() now, as if the clock had reached until_ms
+void hostStop();
+
+
+// a deterministic random number in [0,limit)
+uint32_t hostRandom(uint32_t limit);
@@ -0,0 +1,158 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for LittleFS - the flash file system is a directory
+ *  of ordinary files (see hostFileSystemRoot() in Host.h), so what the
+ *  sketch writes survives reboots and can be inspected afterwards
+ *
+ */
+
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <memory>
+#include <vector>
+
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+
+class File {
+
+  public:
+
+    File() { }
+
+    // (a failed open stays closed - fclose() must never see null)
+    File(FILE * file) { if (file) { this->file.reset(file,fclose); } }
+
+    operator bool() const { return (bool)file; }
+
+    size_t write(const uint8_t * data, size_t length) { return file ? fwrite(data,1,length,file.get()) : 0; }
+
+    size_t read(uint8_t * data, size_t length) { return file ? fread(data,1,length,file.get()) : 0; }
+
+    bool seek(uint32_t position, SeekMode mode) {
+
+      static const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+
+      return file && fseek(file.get(),position,whence[mode]) == 0;
+
+    }
+
+    size_t size() {
+
+      struct stat info;
+
+      if (!file || fstat(fileno(file.get()),&info) != 0) { return 0; }
+
+      return info.st_size;
+
+    }
+
+    void close() { file.reset(); }
+
+  private:
+
+    // closed when the last copy goes, like the core's File
+    std::shared_ptr<FILE> file;
+
+};
+
+
+class Dir {
+
+  public:
+
+    Dir() { }
+
+    Dir(const std::string & path) : path(path) {
+
+      DIR * dir = opendir(path.c_str());
+
+      if (!dir) { return; }
+
+      while (struct dirent * entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') { names.push_back(entry->d_name); }
+      }
+
+      closedir(dir);
+
+    }
+
+    bool next() { return ++index < (int)names.size(); }
+
+    String fileName() { return String(names[index].c_str()); }
+
+    size_t fileSize() {
+
+      struct stat info;
+
+      return (stat((path + "/" + names[index]).c_str(),&info) == 0) ? info.st_size : 0;
+
+    }
+
+  private:
+
+    std::string path;
+    std::vector<std::string> names;
+    int index = -1;
+
+};
+
+
+namespace fs {
+
+  class FS {
+
+    public:
+
+      bool begin() { return mkdir(hostFileSystemRoot(),0755) == 0 || errno == EEXIST; }
+
+      Dir openDir(const char * path) { return Dir(hostPath(path)); }
+
+      // like LittleFS, writing creates any missing directories
+      File open(const char * path, const char * mode) {
+
+        std::string file = hostPath(path);
+
+        if (mode[0] != 'r') {
+          for (size_t slash = file.find('/',1); slash != std::string::npos; slash = file.find('/',slash + 1)) {
+            mkdir(file.substr(0,slash).c_str(),0755);
+          }
+        }
+
+        const char * hostMode = (mode[0] == 'a') ? "ab" : (mode[0] == 'w') ? "wb" : "rb";
+
+        return File(fopen(file.c_str(),hostMode));
+
+      }
+
+      bool exists(const char * path) {
+
+        struct stat info;
+
+        return stat(hostPath(path).c_str(),&info) == 0;
+
+      }
+
+      bool remove(const char * path) { return ::remove(hostPath(path).c_str()) == 0; }
+
+    private:
+
+      std::string hostPath(const char * path) { return std::string(hostFileSystemRoot()) + path; }
+
+  };
+
+}
+
+using fs::FS;
+
+extern fs::FS LittleFS;
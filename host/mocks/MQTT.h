@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for MQTT (arduino-mqtt by Joel Gaehwiler) and the
+ *  broker at the other end of it
+ *
+ *  Like the library, connect() and publish() block until the broker
+ *  answers or host->broker.timeout_ms passes, so their cost shows up
+ *  on the virtual clock:
+ *
+ *  - connect() takes a round trip (CONNECT, CONNACK) and is refused
+ *    while WiFi is down or the broker is in an outage;
+ *  - a QoS 0 publish() costs the time to send the packet at
+ *    host->broker.bytesPerSecond, a QoS 1 publish() a round trip on
+ *    top (PUBLISH, PUBACK);
+ *  - host->broker.lossPercent of PUBLISH packets are lost. At QoS 0
+ *    nobody notices. At QoS 1 either the PUBLISH or its PUBACK went
+ *    missing, so publish() times out and returns false (and the
+ *    broker may have the message already);
+ *  - host->broker.dropPercent of PUBLISH packets drop the session
+ *    instead, as does an outage starting mid-session.
+ *
+ *  The session lives in the WiFiClient given to begin(), so packets
+ *  written straight to it (see ESP8266WiFi.h) go to the same broker,
+ *  with the same losses and drops, without waiting for the PUBACK.
+ *
+ *  Everything the broker receives is counted in host->brokerStats and
+ *  passed to hostOnPublish (see Host.h).
+ *
+ */
+
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+
+typedef enum {
+  LWMQTT_SUCCESS = 0,
+  LWMQTT_NETWORK_FAILED_CONNECT = -3,
+  LWMQTT_NETWORK_TIMEOUT = -4,
+  LWMQTT_NETWORK_FAILED_WRITE = -6
+} lwmqtt_err_t;
+
+typedef enum {
+  LWMQTT_CONNECTION_ACCEPTED = 0,
+  LWMQTT_SERVER_UNAVAILABLE = 3,
+  LWMQTT_UNKNOWN_RETURN_CODE = 6
+} lwmqtt_return_code_t;
+
+
+class MQTTClient {
+
+  public:
+
+    MQTTClient(int bufferSize = 128) : bufferSize(bufferSize) { }
+
+    void begin(const char * hostname, int port, WiFiClient & client) { (void)hostname; (void)port; netClient = &client; }
+
+    void setCleanSession(bool isClean) { isCleanSession = isClean; }
+
+    bool connect(const char * clientID, bool skip = false);
+
+    bool publish(const char * topic, const char * payload, int length, bool retained = false, int qos = 0);
+
+    bool connected();
+
+    bool loop() { return connected(); }
+
+    bool disconnect();
+
+    lwmqtt_err_t lastError() { return error; }
+
+    lwmqtt_return_code_t returnCode() { return code; }
+
+    uint16_t lastPacketID() { return packetID; }
+
+    // the next publish() resends packetID with the DUP flag set
+    void prepareDuplicate(uint16_t packetID) { duplicateID = packetID; }
+
+  private:
+
+    int bufferSize;
+    bool isCleanSession = true;
+
+    WiFiClient * netClient = nullptr;
+
+    lwmqtt_err_t error = LWMQTT_SUCCESS;
+    lwmqtt_return_code_t code = LWMQTT_CONNECTION_ACCEPTED;
+
+    uint16_t nextPacketID = 1;
+    uint16_t packetID = 0;
+    uint16_t duplicateID = 0;
+
+};
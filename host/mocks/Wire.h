@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for Wire (I2C), with a BMP280 at 0x76 and 0x77
+ *
+ *  Each simulated BMP280 has the datasheet's example trimming
+ *  parameters (section 8.2), sleeps until ctrl_meas asks for a forced
+ *  conversion, reports "measuring" in its status register for the
+ *  conversion time and then latches a reading. The readings follow a
+ *  daily temperature cycle and a three-day pressure swing, with a
+ *  little noise. Neither sensor answers during an outage in
+ *  host->sensorOutages.
+ *
+ */
+
+
+#include <Arduino.h>
+
+
+class HostWire {
+
+  public:
+
+    void begin() { }
+
+    void setClock(uint32_t clock_Hz) { (void)clock_Hz; }
+
+    void beginTransmission(uint8_t address);
+
+    size_t write(uint8_t value);
+
+    // 0 on success, 2 if nothing acknowledged the address
+    uint8_t endTransmission(bool sendStop = true);
+
+    uint8_t requestFrom(uint8_t address, uint8_t length);
+
+    int available() { return available_bytes; }
+
+    int read();
+
+  private:
+
+    uint8_t address = 0;
+    bool isFirstByte = false;
+    int available_bytes = 0;
+
+};
+
+extern HostWire Wire;
@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for the ESP8266 core's SNTP hooks
+ *
+ *  Once configTime() has been called and WiFi is up, the SNTP stand-in
+ *  (see Host.cpp) sets the time on the virtual clock and calls the
+ *  settimeofday_cb() callback, then does so again every hour like the
+ *  SDK. gettimeofday() is redirected to the virtual clock.
+ *
+ */
+
+
+#include <sys/time.h>
+
+
+void settimeofday_cb(void (*callback)());
+
+int hostGettimeofday(struct timeval * tv, void * tz);
+
+#define gettimeofday(tv,tz) hostGettimeofday(tv,tz)
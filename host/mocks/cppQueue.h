@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ *
+ *  Host stand-in for cppQueue (SMFSW)
+ *
+ *  The sketch replaced cppQueue with its own packed arena (see Queue.h)
+ *  but the stand-in is kept for anything written against the library.
+ *  FIFO only.
+ *
+ */
+
+
+#include <Arduino.h>
+#include <vector>
+
+
+typedef enum {
+  FIFO,
+  LIFO
+} cppQueueType;
+
+
+class cppQueue {
+
+  public:
+
+    cppQueue(size_t recordSize, size_t recordCount, cppQueueType type = FIFO, bool overwrite = false) :
+      size(recordSize), limit(recordCount), storage(recordSize * recordCount) { (void)type; (void)overwrite; }
+
+    bool isEmpty() { return count == 0; }
+
+    bool isFull() { return count == limit; }
+
+    size_t getCount() { return count; }
+
+    bool push(const void * record) {
+
+      if (isFull()) { return false; }
+
+      memcpy(&storage[((head + count) % limit) * size],record,size);
+      count++;
+
+      return true;
+
+    }
+
+    bool peek(void * record) {
+
+      if (isEmpty()) { return false; }
+
+      memcpy(record,&storage[head * size],size);
+
+      return true;
+
+    }
+
+    bool pop(void * record) {
+
+      if (!peek(record)) { return false; }
+
+      head = (head + 1) % limit;
+      count--;
+
+      return true;
+
+    }
+
+  private:
+
+    size_t size;
+    size_t limit;
+    std::vector<uint8_t> storage;
+    size_t head = 0;
+    size_t count = 0;
+
+};
@@ -0,0 +1,168 @@
+/*
+ *
+ *  Run the unmodified sketch on the host for weeks of simulated time
+ *
+ *      simulate [options]
+ *
+ *      --days N                  how long to run (default 35)
+ *      --wifi-outage AT+FOR      WiFi unavailable from AT for FOR, eg 3d+6h
+ *      --broker-outage AT+FOR    the MQTT broker unavailable
+ *      --sensor-outage AT+FOR    the BMP280s stop answering
+ *      --latency MS              broker latency, each way (default 5)
+ *      --loss PERCENT            PUBLISH packets lost
+ *      --drop PERCENT            PUBLISH packets which drop the session instead
+ *      --no-sntp                 the SNTP server never answers
+ *      --max-restarts N          fail if the board restarts more often than this
+ *      --min-boots N             fail if the board boots fewer times than this
+ *      --min-readings N          fail if the sensors take fewer readings than this
+ *      --seed N                  for the simulated noise, losses and jitter
+ *      --verbose                 show the sketch's serial output
+ *
+ *  Times take a suffix of ms, s, m, h or d. The outage options can be
+ *  repeated. At the end, a summary of what the broker received and how
+ *  the board behaved is printed. The run fails if the sketch crashed,
+ *  restarted too often (or, in DeepSleepMode, woke too rarely), took
+ *  too few readings or reused a DHCP lease which had expired. A reading
+ *  is a forced conversion by one sensor.
+ *
+ */
+
+
+#include "sketch_esp8266_bmp280.ino"
+
+#include <chrono>
+
+
+static void usage() {
+
+  fprintf(stderr,
+    "usage: simulate [--days N] [--wifi-outage AT+FOR] [--broker-outage AT+FOR]\n"
+    "                [--sensor-outage AT+FOR] [--latency MS] [--loss PERCENT]\n"
+    "                [--drop PERCENT] [--no-sntp] [--max-restarts N] [--min-boots N]\n"
+    "                [--min-readings N] [--seed N] [--verbose]\n");
+
+  exit(2);
+
+}
+
+
+// "90", "1500ms", "30s", "5m", "6h", "3d" (in milliseconds)
+static uint64_t parseTime(const char * text) {
+
+  char * suffix = nullptr;
+  double value = strtod(text,&suffix);
+
+  if (suffix == text || value < 0) { usage(); }
+
+  if (strcmp(suffix,"") == 0 || strcmp(suffix,"ms") == 0) { return value; }
+  if (strcmp(suffix,"s") == 0) { return value * 1000; }
+  if (strcmp(suffix,"m") == 0) { return value * 60*1000; }
+  if (strcmp(suffix,"h") == 0) { return value * 60*60*1000; }
+  if (strcmp(suffix,"d") == 0) { return value * 24*60*60*1000; }
+
+  usage();
+  return 0;
+
+}
+
+
+static void parseOutage(HostOutageList & list, const char * text) {
+
+  const char * plus = strchr(text,'+');
+
+  if (!plus) { usage(); }
+
+  hostAddOutage(list,parseTime(std::string(text,plus).c_str()),parseTime(plus + 1));
+
+}
+
+
+int main(int argc, char * argv[]) {
+
+  uint64_t days = 35;
+  uint32_t seed = 1;
+  long maxRestarts = -1;
+  uint32_t minBoots = 0;
+  uint32_t minReadings = 0;
+
+  // the seed must be known before the world is set up
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i],"--seed") == 0) { seed = strtoul(argv[i + 1],nullptr,10); }
+  }
+
+  hostBegin(seed);
+
+  for (int i = 1; i < argc; i++) {
+
+    const char * option = argv[i];
+    const char * value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+    if (strcmp(option,"--no-sntp") == 0) { host->isSNTPAvailable = false; continue; }
+    if (strcmp(option,"--verbose") == 0) { hostVerbose = true; continue; }
+
+    if (!value) { usage(); }
+
+    i++;
+
+    if (strcmp(option,"--days") == 0) { days = strtoull(value,nullptr,10); }
+    else if (strcmp(option,"--wifi-outage") == 0) { parseOutage(host->wifiOutages,value); }
+    else if (strcmp(option,"--broker-outage") == 0) { parseOutage(host->brokerOutages,value); }
+    else if (strcmp(option,"--sensor-outage") == 0) { parseOutage(host->sensorOutages,value); }
+    else if (strcmp(option,"--latency") == 0) { host->broker.latency_ms = strtoul(value,nullptr,10); }
+    else if (strcmp(option,"--loss") == 0) { host->broker.lossPercent = strtoul(value,nullptr,10); }
+    else if (strcmp(option,"--drop") == 0) { host->broker.dropPercent = strtoul(value,nullptr,10); }
+    else if (strcmp(option,"--max-restarts") == 0) { maxRestarts = strtol(value,nullptr,10); }
+    else if (strcmp(option,"--min-boots") == 0) { minBoots = strtoul(value,nullptr,10); }
+    else if (strcmp(option,"--min-readings") == 0) { minReadings = strtoul(value,nullptr,10); }
+    else if (strcmp(option,"--seed") == 0) { }
+    else { usage(); }
+
+  }
+
+  auto started = std::chrono::steady_clock::now();
+
+  bool isClean = hostRun(setup,loop,days * 24*60*60*1000);
+
+  double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  const HostBrokerStats & broker = host->brokerStats;
+  const HostWiFiStats & wifi = host->wifi;
+
+  printf("simulated %.1f days in %.2f s\n",hostNow_ms() / 86400000.0,elapsed_s);
+  printf("board: %u boots, %u deep sleeps (including reboots)\n",host->boots,host->deepSleeps);
+  printf("sensors: %u readings\n",host->conversions);
+  printf("wifi: %u full connects, %u fast connects (%u reusing a lease, %u of them stale)\n",
+    wifi.fullConnects,wifi.fastConnects,wifi.leaseReuses,wifi.staleLeases);
+  printf("broker: %u connects (%u refused), %u disconnects, %u sessions dropped\n",
+    broker.connects,broker.refusedConnects,broker.disconnects,broker.drops);
+  printf("broker: %u messages received (%u duplicates, %u lost), %llu payload bytes\n",
+    broker.received,broker.duplicates,broker.lost,(unsigned long long)broker.bytes);
+
+  for (size_t i = 0; i < broker.topicCount; i++) {
+    printf("  %-40s %8u\n",broker.topics[i],broker.topicReceived[i]);
+  }
+
+  int status = 0;
+
+  if (!isClean) {
+    fprintf(stderr,"the sketch crashed\n");
+    status = 1;
+  } else if (maxRestarts >= 0 && host->deepSleeps > (uint32_t)maxRestarts) {
+    fprintf(stderr,"the board restarted %u times (at most %ld expected)\n",host->deepSleeps,maxRestarts);
+    status = 1;
+  } else if (host->boots < minBoots) {
+    fprintf(stderr,"the board booted %u times (at least %u expected)\n",host->boots,minBoots);
+    status = 1;
+  } else if (host->conversions < minReadings) {
+    fprintf(stderr,"the sensors took %u readings (at least %u expected)\n",host->conversions,minReadings);
+    status = 1;
+  } else if (wifi.staleLeases > 0) {
+    fprintf(stderr,"%u connections reused an expired DHCP lease\n",wifi.staleLeases);
+    status = 1;
+  }
+
+  hostEnd();
+
+  return status;
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ *
+ *  Just enough of a test framework
+ *
+ *  CHECK() and CHECK_EQUAL() report a failure with its location and
+ *  carry on, so one run shows every failure. main() returns
+ *  checkResult(), which ctest reads as pass or fail.
+ *
+ */
+
+
+#include <stdio.h>
+
+
+static int checkFailures = 0;
+
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr,"%s:%d: CHECK(%s) failed\n",__FILE__,__LINE__,#condition); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+
+#define CHECK_EQUAL(expected,actual) \
+  do { \
+    long long e = (long long)(expected); \
+    long long a = (long long)(actual); \
+    if (e != a) { \
+      fprintf(stderr,"%s:%d: expected %s == %lld but got %lld\n",__FILE__,__LINE__,#actual,e,a); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+
+static inline int checkResult() {
+
+  if (checkFailures) {
+    fprintf(stderr,"%d check(s) failed\n",checkFailures);
+    return 1;
+  }
+
+  printf("all checks passed\n");
+  return 0;
+
+}
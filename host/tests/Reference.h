@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ *
+ *  The sketch's original floating point code, kept as the reference
+ *  its integer replacements are tested and benchmarked against
+ *
+ */
+
+
+#include <math.h>
+
+
+// sea level pressure as it was (hPa in, hPa out)
+float referenceSeaLevel(float ph, float t) {
+
+  // precalculate altitude, corrected for the temperature lapse rate
+  float hl = LocalHeightAboveSeaLevelInMetres * 0.0065;
+
+  return ph / pow(1.0-hl/(t+hl+273.15),5.257);
+
+}
+
+
+/*
+ * The trend test as it was: shift the history along, re-sum it and
+ * fit the line in doubles every time. Returns -1 (falling), 0
+ * (steady) or 1 (rising) for a full window, and sets tObserved.
+ */
+template <size_t Size>
+int referenceTrend(const double (&pressures)[Size], double criticalT, double & tObserved) {
+
+  double sum_x = 0.0;     // ∑(x)
+  double sum_xx = 0.0;    // ∑(x²)
+  double sum_y = 0.0;     // ∑(y)
+  double sum_xy = 0.0;    // ∑(xy)
+  double n = 1.0 * Size;
+
+  for (size_t i = 0; i < Size; i++) {
+
+    double x = 1.0 * i;
+    double y = pressures[i];
+
+    sum_x = sum_x + x;
+    sum_xx = sum_xx + x * x;
+    sum_y = sum_y + y;
+    sum_xy = sum_xy + x * y;
+
+  }
+
+  double slope = (sum_x*sum_y - n*sum_xy) / (sum_x*sum_x - n*sum_xx);
+  double intercept = (sum_y -slope*sum_x) / n;
+
+  double SSE = 0.0;        // ∑((y-ŷ)²)
+
+  for (size_t i = 0; i < Size; i++) {
+
+    double y = pressures[i];
+    double residual = y - (intercept + slope * i);
+    SSE = SSE + residual * residual;
+
+  }
+
+  tObserved = fabs(slope/(sqrt(SSE / (n-2.0)) / sqrt(sum_xx - sum_x*sum_x/n)));
+
+  if (tObserved > criticalT) { return (slope < 0.0) ? -1 : 1; }
+
+  return 0;
+
+}
@@ -0,0 +1,189 @@
+/*
+ *
+ *  QoS 1 against the broker stand-in (built with MQTTAtLeastOnce set)
+ *
+ *  A backlog of numbered messages is drained while the broker loses
+ *  PUBLISH packets (or their PUBACKs) and drops sessions. Every message
+ *  must arrive, in order, and any that arrive more than once must
+ *  carry the DUP flag the second time. Over a clean but slow link,
+ *  the window of packets in flight must drain it much faster than
+ *  one message per round trip.
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+
+#include <unistd.h>
+#include <vector>
+
+
+typedef struct {
+  uint32_t latency_ms;
+  uint32_t lossPercent;
+  uint32_t dropPercent;
+  uint32_t seed;
+} Scenario;
+
+const Scenario scenarios[] = {
+  {  5, 10,  0, 1 },
+  {  5,  0,  5, 2 },
+  {  5, 10,  3, 3 },
+  { 50,  0,  0, 4 }
+};
+
+// more than the RAM queue holds, so some come back from the spill log
+const uint32_t Backlog = 400;
+
+const uint64_t DrainLimit_ms = 6*60*60*1000ULL;
+
+// per boot (each scenario runs in its own process)
+static std::vector<uint32_t> deliveries;
+static uint32_t lastFirstArrival = 0;
+static uint32_t resendsWithoutDUP = 0;
+static uint32_t outOfOrder = 0;
+static uint64_t drainStart_ms = 0;
+
+
+static void onPublish(const char *, const char * payload, size_t, bool isDuplicate) {
+
+  uint32_t n = strtoul(payload,nullptr,10);
+
+  if (n >= deliveries.size()) { return; }
+
+  if (deliveries[n]++ == 0) {
+    if (n != 0 && n != lastFirstArrival + 1) { outOfOrder++; }
+    lastFirstArrival = n;
+  } else if (!isDuplicate) {
+    resendsWithoutDUP++;
+  }
+
+}
+
+
+static void testSetup() {
+
+  // a reboot would lose the messages this test queued
+  if (host->boots > 1) {
+    fprintf(stderr,"the board rebooted\n");
+    fflush(stderr);
+    _exit(1);
+  }
+
+  deliveries.assign(Backlog,0);
+
+  spillLog.begin();
+
+  while (WiFi.status() != WL_CONNECTED || wifiState != WiFiIdleState) {
+    wifi_handle();
+    scheduler_idle();
+  }
+
+  for (uint32_t n = 0; n < Backlog; n++) {
+
+    size_t capacity = 0;
+    char * payload = try_to_reserve(capacity);
+
+    size_t length = snprintf(payload,capacity,"%u",n);
+
+    try_to_enqueue(__func__,TopicStatusID,length);
+
+  }
+
+  drainStart_ms = hostNow_ms();
+
+}
+
+
+static void testLoop() {
+
+  wifi_handle();
+  mqtt_handle();
+
+  bool isDrained = mqttQueue.isEmpty() && spillLog.isEmpty() && (mqttState == MQTTIdleState);
+  bool isStuck = hostNow_ms() > DrainLimit_ms;
+
+  if (isDrained || isStuck) {
+
+    uint32_t missing = 0, repeated = 0;
+
+    for (uint32_t count : deliveries) {
+      if (count == 0) { missing++; }
+      if (count > 1) { repeated += count - 1; }
+    }
+
+    const HostBrokerStats & stats = host->brokerStats;
+    const HostBrokerSettings & broker = host->broker;
+
+    uint64_t drain_ms = hostNow_ms() - drainStart_ms;
+
+    printf(
+      "latency %u ms, loss %u%%, drop %u%%: %u lost or dropped, %u delivered twice, %u arrived flagged DUP, %u missing, drained in %llu ms\n",
+      host->broker.latency_ms,
+      host->broker.lossPercent,
+      host->broker.dropPercent,
+      stats.lost + stats.drops,
+      repeated,
+      stats.duplicates,
+      missing,
+      (unsigned long long)drain_ms
+    );
+
+    CHECK(!isStuck);
+    CHECK_EQUAL(0,missing);
+    CHECK_EQUAL(0,outOfOrder);
+    CHECK_EQUAL(0,resendsWithoutDUP);
+
+    if (broker.lossPercent + broker.dropPercent > 0) {
+
+      // the scenario must actually have exercised the resend path
+      CHECK(stats.lost + stats.drops > 0);
+
+    } else if (MQTTWindow > 1) {
+
+      // at least twice as fast as waiting for each PUBACK in turn
+      CHECK(drain_ms * 2 < Backlog * 2ULL * broker.latency_ms);
+
+    }
+
+    if (checkFailures) {
+      fflush(stdout);
+      fflush(stderr);
+      _exit(1);
+    }
+
+    hostStop();
+
+  }
+
+  scheduler_idle();
+
+}
+
+
+int main() {
+
+  hostOnPublish = onPublish;
+
+  bool isClean = true;
+
+  for (const Scenario & scenario : scenarios) {
+
+    hostBegin(scenario.seed);
+
+    host->broker.latency_ms = scenario.latency_ms;
+    host->broker.lossPercent = scenario.lossPercent;
+    host->broker.dropPercent = scenario.dropPercent;
+
+    isClean = hostRun(testSetup,testLoop,~0ULL) && isClean;
+
+    hostEnd();
+
+  }
+
+  CHECK(isClean);
+
+  return checkResult();
+
+}
@@ -0,0 +1,187 @@
+/*
+ *
+ *  The sketch's CBOR encoding, byte for byte against RFC 8949, and
+ *  payloads round-tripped through the host decoder (built with
+ *  CBORPayloads set)
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+#include "CBORDecoder.h"
+
+#include <functional>
+#include <string>
+
+
+// what a writer produces, as hex
+static std::string encoded(std::function<void(CBORWriter &)> write) {
+
+  char buffer[64];
+  CBORWriter cbor(buffer,sizeof(buffer));
+
+  write(cbor);
+
+  std::string hex;
+  for (size_t i = 0; i < cbor.length(); i++) {
+    char digits[3];
+    snprintf(digits,sizeof(digits),"%02x",(uint8_t)buffer[i]);
+    hex += digits;
+  }
+
+  return hex;
+
+}
+
+
+#define CHECK_ENCODING(expected,write) CHECK(encoded([](CBORWriter & cbor) { write; }) == expected)
+
+
+// RFC 8949 appendix A
+static void testEncodings() {
+
+  CHECK_ENCODING("00",cbor.unsignedInteger(0));
+  CHECK_ENCODING("17",cbor.unsignedInteger(23));
+  CHECK_ENCODING("1818",cbor.unsignedInteger(24));
+  CHECK_ENCODING("1864",cbor.unsignedInteger(100));
+  CHECK_ENCODING("1903e8",cbor.unsignedInteger(1000));
+  CHECK_ENCODING("1a000f4240",cbor.unsignedInteger(1000000));
+  CHECK_ENCODING("1affffffff",cbor.unsignedInteger(4294967295));
+
+  CHECK_ENCODING("0a",cbor.integer(10));
+  CHECK_ENCODING("20",cbor.integer(-1));
+  CHECK_ENCODING("29",cbor.integer(-10));
+  CHECK_ENCODING("3863",cbor.integer(-100));
+  CHECK_ENCODING("3903e7",cbor.integer(-1000));
+  CHECK_ENCODING("1a7fffffff",cbor.integer(INT32_MAX));
+  CHECK_ENCODING("3a7fffffff",cbor.integer(INT32_MIN));
+
+  CHECK_ENCODING("60",cbor.text(""));
+  CHECK_ENCODING("6449455446",cbor.text("IETF"));
+  CHECK_ENCODING("4401020304",cbor.byteString((const uint8_t *)"\x01\x02\x03\x04",4));
+
+  CHECK_ENCODING("c11a514b67b0",cbor.epochTime(1363896240));
+  CHECK_ENCODING("c48221196ab3",cbor.decimal(27315,2));
+  CHECK_ENCODING("c482201902e3",cbor.decimal(739,1));
+  CHECK_ENCODING("c4822039fc18",cbor.decimal(-64537,1));
+
+  CHECK_ENCODING("a201020304",cbor.map(2); cbor.key(1); cbor.integer(2); cbor.key(3); cbor.integer(4));
+
+}
+
+
+static void testOverflow() {
+
+  char buffer[4];
+  CBORWriter cbor(buffer,sizeof(buffer));
+
+  cbor.unsignedInteger(1000);
+  CHECK_EQUAL(3,cbor.length());
+
+  // too big for what is left - the whole payload is rejected
+  cbor.text("IETF");
+  CHECK_EQUAL(sizeof(buffer),cbor.length());
+
+  cbor.integer(0);
+  CHECK_EQUAL(sizeof(buffer),cbor.length());
+
+}
+
+
+static void testDecoder() {
+
+  CBORValue value;
+
+  // a batch (MQTTBatchMode) - an indefinite-length array of maps
+  const uint8_t batch[] = { 0x9f, 0xa1, 0x01, 0x02, 0xa1, 0x01, 0x03, 0xff };
+  CHECK(decodeCBOR(batch,sizeof(batch),value));
+  CHECK_EQUAL(CBORValueArray,value.type);
+  CHECK_EQUAL(2,value.items.size());
+  CHECK(value.items.size() == 2 && value.items[1].find(1) && value.items[1].find(1)->integer() == 3);
+
+  // truncated anywhere, or with a byte left over
+  for (size_t length = 0; length < sizeof(batch); length++) {
+    CHECK(!decodeCBOR(batch,length,value));
+  }
+
+  const uint8_t extra[] = { 0x01, 0x02 };
+  CHECK(!decodeCBOR(extra,sizeof(extra),value));
+
+  // a string longer than what follows, and a float (never sent)
+  const uint8_t longText[] = { 0x65, 'I', 'E', 'T', 'F' };
+  CHECK(!decodeCBOR(longText,sizeof(longText),value));
+
+  const uint8_t half[] = { 0xf9, 0x3c, 0x00 };
+  CHECK(!decodeCBOR(half,sizeof(half),value));
+
+  const uint8_t simple[] = { 0xf5 };
+  CHECK(decodeCBOR(simple,sizeof(simple),value));
+  CHECK_EQUAL(CBORValueSimple,value.type);
+  CHECK_EQUAL(21,value.argument);
+
+}
+
+
+// the oldest queued payload, decoded
+static bool dequeue(TopicID topic, CBORValue & value) {
+
+  Telemetry telemetry;
+
+  if (!mqttQueue.peek(telemetry)) { return false; }
+
+  bool isDecoded = (telemetry.topic == topic) && decodeCBOR((const uint8_t *)telemetry.payload,telemetry.payloadLength,value);
+
+  mqttQueue.release();
+
+  return isDecoded;
+
+}
+
+
+static void testStatusPayloads() {
+
+  // values which need all 32 bits, and fractions
+  publish_status_update("host","02:00:00:00:00:01","192.168.1.100",40000,3000000000,99,176823,7,0);
+
+  mqttHoldSaved_ms = 4000000000;
+  mqttRunStats = { 12, 400, 19260, 23 };
+  telemetryDiscardedCount = 65535;
+  publish_mqtt_status_update();
+
+  CBORValue status;
+  CHECK(dequeue(TopicStatusID,status));
+  CHECK_EQUAL(CBORValueMap,status.type);
+  CHECK_EQUAL(9,status.pairs());
+  CHECK(status.find(CBORStatusSSIDKey) && status.find(CBORStatusSSIDKey)->bytes == "host");
+  CHECK(status.find(CBORStatusUpTimeKey) && status.find(CBORStatusUpTimeKey)->type == CBORValueUnsigned);
+  CHECK(status.find(CBORStatusUpTimeKey) && status.find(CBORStatusUpTimeKey)->integer() == 3000000000);
+  CHECK(status.find(CBORStatusWakeupsKey) && status.find(CBORStatusWakeupsKey)->integer() == 176823);
+
+  CBORValue mqtt;
+  CHECK(dequeue(TopicStatusMQTTID,mqtt));
+  CHECK_EQUAL(12,mqtt.pairs());
+  CHECK(mqtt.find(CBORMQTTSavedKey) && mqtt.find(CBORMQTTSavedKey)->integer() == 4000000000);
+  CHECK(mqtt.find(CBORMQTTRunMessagesKey) && mqtt.find(CBORMQTTRunMessagesKey)->integer() == 400);
+  CHECK(mqtt.find(CBORMQTTDiscardedKey) && mqtt.find(CBORMQTTDiscardedKey)->integer() == 65535);
+
+  // 400 messages in 19.26 s is 20.7/s, sent as 4([-1, 207])
+  const CBORValue * rate = mqtt.find(CBORMQTTRateKey);
+  CHECK(rate && rate->isNumber() && rate->type == CBORValueTag);
+  CHECK(rate && fabs(rate->number() - 20.7) < 1e-9);
+
+  CHECK(mqttQueue.isEmpty());
+
+}
+
+
+int main() {
+
+  testEncodings();
+  testOverflow();
+  testDecoder();
+  testStatusPayloads();
+
+  return checkResult();
+
+}
@@ -0,0 +1,189 @@
+/*
+ *
+ *  The JSON writer's integer formatting against snprintf()
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+
+#include <stdarg.h>
+#include <random>
+#include <string>
+
+
+static std::string written(void (*write)(JSONWriter &, int64_t, uint8_t), int64_t value, uint8_t places = 0) {
+
+  char buffer[32];
+  JSONWriter json(buffer,sizeof(buffer));
+
+  write(json,value,places);
+
+  return std::string(buffer,json.length());
+
+}
+
+
+static std::string printed(const char * format, ...) __attribute__((format(printf,1,2)));
+
+static std::string printed(const char * format, ...) {
+
+  char buffer[64];
+
+  va_list arguments;
+  va_start(arguments,format);
+  vsnprintf(buffer,sizeof(buffer),format,arguments);
+  va_end(arguments);
+
+  return buffer;
+
+}
+
+
+static void writeInteger(JSONWriter & json, int64_t value, uint8_t) { json.integer(value); }
+static void writeUnsigned(JSONWriter & json, int64_t value, uint8_t) { json.unsignedInteger(value); }
+static void writeDecimal(JSONWriter & json, int64_t value, uint8_t places) { json.decimal(value,places); }
+
+
+static void checkInteger(int32_t value) {
+
+  CHECK(written(writeInteger,value) == printed("%d",value));
+
+}
+
+
+static void checkUnsigned(uint32_t value) {
+
+  CHECK(written(writeUnsigned,value) == printed("%u",value));
+
+}
+
+
+// the reference goes through long double, which holds every value exactly enough
+static void checkDecimal(int32_t scaled, uint8_t places) {
+
+  long double scale = 1;
+  for (uint8_t i = 0; i < places; i++) { scale *= 10; }
+
+  CHECK(written(writeDecimal,scaled,places) == printed("%.*Lf",places,scaled / scale));
+
+}
+
+
+static void testIntegers() {
+
+  const int32_t edges[] = { 0, 1, -1, 9, 10, -10, 99, 100, 999999999, 1000000000, INT32_MAX, INT32_MIN, INT32_MIN + 1 };
+
+  for (int32_t value : edges) {
+    checkInteger(value);
+    checkUnsigned(value);
+  }
+
+  checkUnsigned(UINT32_MAX);
+
+  std::mt19937 random(7);
+
+  for (size_t i = 0; i < 200000; i++) {
+    uint32_t bits = random();
+    // all magnitudes, not just huge ones
+    uint32_t value = bits >> (random() % 32);
+    checkInteger((int32_t)((i & 1) ? value : 0 - value));
+    checkUnsigned(value);
+  }
+
+}
+
+
+static void testDecimals() {
+
+  // the fractions the sketch sends: temperatures, pressures and rates
+  const int32_t edges[] = { 0, 5, -5, 9, 10, -10, 99, 100, -101, 2150, -4000, 8500, 101325, 110000, INT32_MAX, INT32_MIN + 1 };
+
+  for (int32_t value : edges) {
+    for (uint8_t places = 0; places <= 4; places++) { checkDecimal(value,places); }
+  }
+
+  std::mt19937 random(11);
+
+  for (size_t i = 0; i < 200000; i++) {
+    int32_t value = (int32_t)random() >> (random() % 32);
+    checkDecimal(value,random() % 5);
+  }
+
+}
+
+
+// every temperature a sensor can report, in tenths and hundredths of a degree
+static void testTemperatures() {
+
+  for (int32_t hundredths = -4000; hundredths <= 8500; hundredths++) {
+    checkDecimal(hundredths,2);
+    if (hundredths % 10 == 0) { checkDecimal(hundredths / 10,1); }
+  }
+
+}
+
+
+static void testText() {
+
+  char buffer[64];
+  JSONWriter json(buffer,sizeof(buffer));
+
+  json.beginObject();
+  json.key("\"ssid\"");
+  json.text("a \"quoted\" back\\slash\ttab");
+  json.key("\"n\"");
+  json.integer(-3);
+  json.endObject();
+
+  CHECK(std::string(buffer) == "{\"ssid\":\"a \\\"quoted\\\" back\\\\slash\\u0009tab\",\"n\":-3}");
+  CHECK_EQUAL(strlen(buffer),json.length());
+  CHECK(!json.isTruncated());
+
+}
+
+
+static void testTruncation() {
+
+  // every capacity short of the full payload rejects it, and never writes past the end
+  const char * full = "{\"temp_C\":-12.35,\"samples\":4294967295}";
+
+  for (size_t capacity = 1; capacity <= strlen(full) + 1; capacity++) {
+
+    char buffer[64];
+    memset(buffer,'#',sizeof(buffer));
+
+    JSONWriter json(buffer,capacity);
+    json.beginObject();
+    json.key("\"temp_C\"");
+    json.decimal(-1235,2);
+    json.key("\"samples\"");
+    json.unsignedInteger(UINT32_MAX);
+    json.endObject();
+
+    bool isComplete = (capacity > strlen(full));
+
+    CHECK_EQUAL(!isComplete,json.isTruncated());
+    CHECK_EQUAL(isComplete ? strlen(full) : capacity,json.length());
+    CHECK(memchr(buffer,0,capacity) != nullptr);
+    CHECK(buffer[capacity] == '#');
+
+    if (isComplete) { CHECK(std::string(buffer) == full); }
+
+  }
+
+}
+
+
+int main() {
+
+  testIntegers();
+  testDecimals();
+  testTemperatures();
+  testText();
+  testTruncation();
+
+  return checkResult();
+
+}
@@ -0,0 +1,340 @@
+/*
+ *
+ *  The RAM queue's arena - records wrapping round the end, batches
+ *  marked as sent and released out of turn, records in flight, and a
+ *  long random run against a plain FIFO
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+
+#include <deque>
+#include <random>
+#include <string>
+
+
+// a record's payload is its number, padded with letters to length
+static std::string payloadFor(uint32_t n, size_t length) {
+
+  std::string payload = std::to_string(n) + ":";
+
+  while (payload.size() < length) { payload += (char)('a' + (n + payload.size()) % 26); }
+
+  return payload.substr(0,length);
+
+}
+
+
+static bool push(TelemetryQueue & queue, const std::string & payload, TopicID topic = TopicStatusID) {
+
+  size_t capacity = 0;
+  char * space = queue.reserve(capacity);
+
+  if (capacity <= payload.size()) { return false; }
+
+  memcpy(space,payload.data(),payload.size());
+
+  return queue.commit(topic,payload.size(),false);
+
+}
+
+
+static std::string text(const Telemetry & telemetry) {
+
+  return std::string(telemetry.payload,telemetry.payloadLength);
+
+}
+
+
+static std::string oldest(TelemetryQueue & queue) {
+
+  Telemetry telemetry = { };
+
+  return queue.peek(telemetry) ? text(telemetry) : "";
+
+}
+
+
+static void testWrap() {
+
+  TelemetryQueue queue;
+
+  // four records leave too little at the end of the arena for a fifth
+  const size_t Length = 1000;
+
+  for (uint32_t n = 0; n < 4; n++) { CHECK(push(queue,payloadFor(n,Length))); }
+  CHECK(!push(queue,payloadFor(4,Length)));
+  CHECK_EQUAL(4,queue.count());
+
+  queue.release();
+  queue.release();
+
+  // so the next two go at the start
+  CHECK(push(queue,payloadFor(4,Length)));
+  CHECK(push(queue,payloadFor(5,Length)));
+  CHECK(!push(queue,payloadFor(6,Length)));
+
+  CHECK_EQUAL(4,queue.count());
+  CHECK_EQUAL(4 * (sizeof(TelemetryHeader) + Length + 1),queue.bytesUsed());
+
+  // and come out after the two left at the end, terminated
+  for (uint32_t n = 2; n < 6; n++) {
+
+    Telemetry telemetry = { };
+    CHECK(queue.peek(telemetry));
+    CHECK(text(telemetry) == payloadFor(n,Length));
+    CHECK_EQUAL(0,telemetry.payload[Length]);
+
+    queue.release();
+
+  }
+
+  CHECK(queue.isEmpty());
+  CHECK_EQUAL(0,queue.bytesUsed());
+
+  // an empty arena offers all of itself again
+  size_t capacity = 0;
+  queue.reserve(capacity);
+  CHECK_EQUAL(TelemetryQueueSize_bytes - sizeof(TelemetryHeader),capacity);
+
+}
+
+
+static void testTruncation() {
+
+  TelemetryQueue queue;
+
+  size_t capacity = 0;
+  queue.reserve(capacity);
+
+  // the payload and its null must both fit
+  CHECK(!queue.commit(TopicStatusID,capacity,false));
+  CHECK(queue.isEmpty());
+
+  queue.reserve(capacity);
+  CHECK(queue.commit(TopicStatusID,capacity - 1,false));
+  CHECK_EQUAL(1,queue.count());
+
+  // nothing is left, and the reservation has been used
+  queue.reserve(capacity);
+  CHECK_EQUAL(0,capacity);
+  CHECK(!queue.commit(TopicStatusID,0,false));
+
+}
+
+
+static void testSentRecords() {
+
+  TelemetryQueue queue;
+
+  // pushed so that the walk has to cross the end of the arena
+  for (uint32_t n = 0; n < 3; n++) { CHECK(push(queue,payloadFor(n,1200))); }
+  queue.release();
+  queue.release();
+
+  for (uint32_t n = 3; n < 7; n++) { CHECK(push(queue,payloadFor(n,200))); }
+
+  // a batch takes 2, 4 and 5 (3 is for another topic, say)
+  QueueCursor cursor = { };
+  Telemetry telemetry = { };
+
+  uint32_t expected[] = { 2, 3, 4, 5, 6 };
+
+  for (uint32_t n : expected) {
+
+    CHECK(queue.peekNext(telemetry,cursor));
+    CHECK(text(telemetry) == payloadFor(n,n == 2 ? 1200 : 200));
+
+    if (n != 3 && n != 6) { queue.markSent(cursor); }
+
+  }
+
+  CHECK(!queue.peekNext(telemetry,cursor));
+
+  // releasing the oldest takes 2 only - 3 was not sent
+  queue.release();
+  CHECK(oldest(queue) == payloadFor(3,200));
+  CHECK_EQUAL(4,queue.count());
+
+  // a new walk skips the sent records
+  cursor = { };
+  CHECK(queue.peekNext(telemetry,cursor) && text(telemetry) == payloadFor(3,200));
+  CHECK(queue.peekNext(telemetry,cursor) && text(telemetry) == payloadFor(6,200));
+  CHECK(!queue.peekNext(telemetry,cursor));
+
+  // releasing 3 takes 4 and 5 with it
+  queue.release();
+  CHECK_EQUAL(1,queue.count());
+  CHECK(oldest(queue) == payloadFor(6,200));
+  CHECK_EQUAL(sizeof(TelemetryHeader) + 201,queue.bytesUsed());
+
+  queue.release();
+  CHECK(queue.isEmpty());
+
+  // releasing an empty queue is harmless
+  queue.release();
+  CHECK(queue.isEmpty());
+  CHECK_EQUAL(0,queue.bytesUsed());
+
+}
+
+
+static void testInFlightRecords() {
+
+  TelemetryQueue queue;
+
+  for (uint32_t n = 0; n < 4; n++) { CHECK(push(queue,payloadFor(n,100))); }
+
+  // packets in flight take 0 and 2
+  QueueCursor cursor = { };
+  Telemetry telemetry = { };
+
+  for (uint32_t n = 0; n < 4; n++) {
+    CHECK(queue.peekNext(telemetry,cursor));
+    if (n % 2 == 0) { queue.mark(cursor,RecordInFlight); }
+  }
+
+  // the next packet only finds what is still queued
+  cursor = { };
+  CHECK(queue.peekNext(telemetry,cursor) && text(telemetry) == payloadFor(1,100));
+  CHECK(queue.peekNext(telemetry,cursor) && text(telemetry) == payloadFor(3,100));
+  CHECK(!queue.peekNext(telemetry,cursor));
+
+  // ... and a resend finds what is in flight
+  cursor = { };
+  CHECK(queue.peekNext(telemetry,cursor,RecordInFlight) && text(telemetry) == payloadFor(0,100));
+  CHECK(queue.peekNext(telemetry,cursor,RecordInFlight) && text(telemetry) == payloadFor(2,100));
+
+  // 2 acknowledged first - nothing leaves until 0 has been
+  queue.markSent(cursor);
+  CHECK(!queue.peekNext(telemetry,cursor,RecordInFlight));
+  queue.releaseSent();
+  CHECK_EQUAL(4,queue.count());
+
+  cursor = { };
+  CHECK(queue.peekNext(telemetry,cursor,RecordInFlight));
+  queue.markSent(cursor);
+  queue.releaseSent();
+  CHECK_EQUAL(3,queue.count());
+  CHECK(oldest(queue) == payloadFor(1,100));
+
+  // releasing 1 takes the sent 2 with it, but not 3 which is in flight
+  cursor = { };
+  CHECK(queue.peekNext(telemetry,cursor) && queue.peekNext(telemetry,cursor));
+  CHECK(text(telemetry) == payloadFor(3,100));
+  queue.mark(cursor,RecordInFlight);
+  queue.release();
+  CHECK_EQUAL(1,queue.count());
+  queue.releaseSent();
+  CHECK_EQUAL(1,queue.count());
+  CHECK(oldest(queue) == payloadFor(3,100));
+
+}
+
+
+/*
+ * Random pushes, releases and batches, checked after every step
+ * against a std::deque holding the same records.
+ */
+typedef struct {
+  std::string payload;
+  bool sent;
+} Record;
+
+
+static size_t sizeOf(const Record & record) { return sizeof(TelemetryHeader) + record.payload.size() + 1; }
+
+
+static void testAgainstFIFO() {
+
+  std::mt19937 random(2026);
+
+  TelemetryQueue queue;
+  std::deque<Record> fifo;
+
+  size_t fifoBytes = 0;
+  uint32_t next = 0;
+  size_t pushed = 0, refused = 0, batches = 0;
+
+  for (size_t step = 0; step < 200000 && !checkFailures; step++) {
+
+    uint32_t action = random() % 10;
+
+    if (action < 5) {
+
+      // mostly small payloads, now and then a big one
+      size_t length = (random() % 8 == 0) ? 100 + random() % 900 : 4 + random() % 120;
+      Record record = { payloadFor(next++,length), false };
+
+      if (push(queue,record.payload)) {
+        fifo.push_back(record);
+        fifoBytes += sizeOf(record);
+        pushed++;
+      } else {
+        // only refused if the arena really is short of contiguous space
+        CHECK(fifoBytes + sizeOf(record) > TelemetryQueueSize_bytes / 2);
+        refused++;
+      }
+
+    } else if (action < 8) {
+
+      // the oldest, plus any sent records immediately behind it
+      queue.release();
+
+      if (!fifo.empty()) {
+        do {
+          fifoBytes -= sizeOf(fifo.front());
+          fifo.pop_front();
+        } while (!fifo.empty() && fifo.front().sent);
+      }
+
+    } else {
+
+      // a batch - send some of the unsent records
+      QueueCursor cursor = { };
+      Telemetry telemetry = { };
+
+      for (Record & record : fifo) {
+
+        if (record.sent) { continue; }
+
+        CHECK(queue.peekNext(telemetry,cursor));
+        CHECK(text(telemetry) == record.payload);
+
+        if (random() % 2) {
+          queue.markSent(cursor);
+          record.sent = true;
+        }
+
+      }
+
+      CHECK(!queue.peekNext(telemetry,cursor));
+
+      batches++;
+
+    }
+
+    CHECK_EQUAL(fifo.size(),queue.count());
+    CHECK_EQUAL(fifoBytes,queue.bytesUsed());
+    CHECK(fifo.empty() ? queue.isEmpty() : oldest(queue) == fifo.front().payload);
+
+  }
+
+  printf("%zu pushed, %zu refused, %zu batches\n",pushed,refused,batches);
+
+}
+
+
+int main() {
+
+  testWrap();
+  testTruncation();
+  testSentRecords();
+  testInFlightRecords();
+  testAgainstFIFO();
+
+  return checkResult();
+
+}
@@ -0,0 +1,66 @@
+/*
+ *
+ *  The Q28 sea level correction against double precision pow()
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+#include "Reference.h"
+
+
+// what the correction should give, in 1/256 Pa
+static double exactSeaLevel_x256(uint32_t pascals_x256, int32_t celsius_x100) {
+
+  double hl = LocalHeightAboveSeaLevelInMetres * 0.0065;
+  double t = celsius_x100 / 100.0;
+
+  return pascals_x256 / pow(1.0 - hl / (t + hl + 273.15),SeaLevelExponent);
+
+}
+
+
+int main() {
+
+  double worstRelative = 0;
+  double worstFloatRelative = 0;
+  size_t cases = 0;
+
+  // the BMP280's whole operating range
+  for (int32_t celsius_x100 = -4000; celsius_x100 <= 8500; celsius_x100 += 25) {
+
+    for (uint32_t pascals = 30000; pascals <= 110000; pascals += 173) {
+
+      uint32_t pascals_x256 = pascals * 256 + (celsius_x100 & 0xFF);
+
+      double exact = exactSeaLevel_x256(pascals_x256,celsius_x100);
+      uint32_t fixed = equivalentPressureAtSeaLevel(pascals_x256,celsius_x100);
+
+      // within 1e-7 of the exact value, give or take the final rounding
+      double error = fabs(fixed - exact);
+      CHECK(error <= exact * 1e-7 + 0.5);
+
+      worstRelative = fmax(worstRelative,(error - 0.5) / exact);
+
+      // the original float code, for comparison
+      double original = referenceSeaLevel(pascals_x256 / 25600.0f,celsius_x100 / 100.0f) * 25600.0;
+      worstFloatRelative = fmax(worstFloatRelative,fabs(original - exact) / exact);
+
+      cases++;
+
+    }
+
+  }
+
+  printf(
+    "%zu cases at %.0f m: worst relative error %.2g (the original float code %.2g)\n",
+    cases,
+    (double)LocalHeightAboveSeaLevelInMetres,
+    fmax(worstRelative,0.0),
+    worstFloatRelative
+  );
+
+  return checkResult();
+
+}
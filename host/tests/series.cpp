@@ -0,0 +1,208 @@
+/*
+ *
+ *  Round trips through the sketch's SeriesBlock and the host decoder
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+#include "SeriesDecoder.h"
+
+
+const uint8_t Channels = 4;
+
+typedef SeriesBlock<Channels,200> Block;
+
+typedef struct {
+  uint32_t time_s;
+  int32_t values[Channels];
+} Reading;
+
+
+// add readings until the block is full, then check the decoder gives back those that fitted
+static void roundTrip(const char * name, const Reading * readings, size_t count, uint8_t timebase) {
+
+  Block block;
+  block.reset();
+
+  size_t added = 0;
+  while (added < count && block.add(readings[added].time_s,readings[added].values,timebase)) { added++; }
+
+  SeriesDecoded series;
+  bool isDecoded = decodeSeriesBlock(block.data(),block.length(),series);
+
+  CHECK(isDecoded);
+  CHECK_EQUAL(added,block.count());
+  CHECK_EQUAL(SeriesBlockVersion,series.version);
+  CHECK_EQUAL(timebase,series.timebase);
+  CHECK_EQUAL(Channels,series.channels);
+  CHECK_EQUAL(added,series.readings.size());
+
+  for (size_t r = 0; r < added && r < series.readings.size(); r++) {
+
+    CHECK_EQUAL(readings[r].time_s,series.readings[r].time_s);
+
+    for (uint8_t c = 0; c < Channels; c++) {
+      CHECK_EQUAL(readings[r].values[c],series.readings[r].values[c]);
+    }
+
+  }
+
+  printf("%s: %zu readings in %zu bytes\n",name,added,block.length());
+
+}
+
+
+static void testSteadyReadings() {
+
+  Reading readings[40];
+
+  for (size_t i = 0; i < 40; i++) {
+    readings[i] = { 1767225600 + (uint32_t)i * 600, { 2150 + (int32_t)(i % 3), 97640, 101325, 2 } };
+  }
+
+  roundTrip("steady",readings,40,SeriesTimebaseUnix);
+
+}
+
+
+static void testNegativeDeltas() {
+
+  // falling through zero, an irregular interval and a trend which changes back
+  const Reading readings[] = {
+    { 5000, {   120, 101900, 105800, 2 } },
+    { 5600, {    40, 101500, 105400, 1 } },
+    { 6200, {   -85, 100200, 104100, 1 } },
+    { 6790, { -1240,  99000, 102900, 1 } },
+    { 7400, { -4000,  97000, 100900, 0 } },
+    { 7401, {  8500, 110000, 114000, 3 } },
+    { 8000, { -4000,  30000,  31000, 2 } }
+  };
+
+  roundTrip("negative deltas",readings,sizeof(readings) / sizeof(readings[0]),SeriesTimebaseDevice);
+
+}
+
+
+static void testCounterWrap() {
+
+  // the device clock passes 2^32 part way through the block
+  Reading readings[10];
+
+  for (size_t i = 0; i < 10; i++) {
+    readings[i] = { 0xFFFFF000 + (uint32_t)i * 600, { 2000, 97000, 101000, 2 } };
+  }
+
+  CHECK(readings[9].time_s < readings[0].time_s);
+
+  roundTrip("counter wrap",readings,10,SeriesTimebaseDevice);
+
+  // and values at the extremes of their range
+  const Reading extremes[] = {
+    { 100, { INT32_MAX, INT32_MIN, 0, 0 } },
+    { 700, { INT32_MIN, INT32_MAX, -1, 1 } },
+    { 1300, { 0, 0, INT32_MAX, INT32_MIN } }
+  };
+
+  roundTrip("extremes",extremes,3,SeriesTimebaseDevice);
+
+}
+
+
+static void testFullBlock() {
+
+  // big changes every time fill the block early
+  Reading readings[100];
+
+  for (size_t i = 0; i < 100; i++) {
+    int32_t sign = (i & 1) ? -1 : 1;
+    readings[i] = { 1000 + (uint32_t)(i * i) * 7, { sign * 2000000, sign * 3000000, -sign * 4000000, (int32_t)i } };
+  }
+
+  roundTrip("full",readings,100,SeriesTimebaseUnix);
+
+}
+
+
+static void testHeaderOnly() {
+
+  // version, timebase, channels, no readings, t0
+  const uint8_t empty[] = { 1, 1, 4, 0, 0x80, 0x80, 0x04 };
+
+  SeriesDecoded series;
+
+  CHECK(decodeSeriesBlock(empty,sizeof(empty),series));
+  CHECK_EQUAL(4,series.channels);
+  CHECK_EQUAL(0,series.readings.size());
+
+  // cut short anywhere
+  for (size_t length = 0; length < sizeof(empty); length++) {
+    CHECK(!decodeSeriesBlock(empty,length,series));
+  }
+
+  // an unknown version
+  const uint8_t future[] = { 2, 1, 4, 0, 0 };
+  CHECK(!decodeSeriesBlock(future,sizeof(future),series));
+
+  // a reading short of a channel, and a byte left over
+  const uint8_t short_[] = { 1, 0, 2, 1, 10, 0, 4 };
+  CHECK(!decodeSeriesBlock(short_,sizeof(short_),series));
+
+  const uint8_t extra[] = { 1, 0, 2, 1, 10, 0, 4, 6, 0 };
+  CHECK(!decodeSeriesBlock(extra,sizeof(extra),series));
+  CHECK(decodeSeriesBlock(extra,sizeof(extra) - 1,series));
+  CHECK_EQUAL(2,series.readings[0].values[0]);
+  CHECK_EQUAL(3,series.readings[0].values[1]);
+
+}
+
+
+static void testBase64() {
+
+  // through the sketch's JSON writer and back, for each length modulo 3
+  for (size_t length = 0; length < 9; length++) {
+
+    uint8_t data[9];
+    for (size_t i = 0; i < length; i++) { data[i] = 0xF0 + i * 37; }
+
+    char json[32];
+    JSONWriter writer(json,sizeof(json));
+    writer.base64(data,length);
+
+    // strip the quotes
+    std::string text(json + 1,writer.length() - 2);
+
+    std::vector<uint8_t> decoded;
+    CHECK(decodeBase64(text.c_str(),decoded));
+    CHECK_EQUAL(length,decoded.size());
+    CHECK(std::vector<uint8_t>(data,data + length) == decoded);
+
+  }
+
+  std::vector<uint8_t> decoded;
+  CHECK(!decodeBase64("abc",decoded));
+  CHECK(!decodeBase64("ab=c",decoded));
+  CHECK(!decodeBase64("a!cd",decoded));
+
+  // the README's example payload
+  SeriesDecoded series;
+  CHECK(decodeBase64("AQAECNgEAJgn2qQMyuIMALAJAAAAAAIAAAAAAQAAAAAAAAAAAAAAAAAEAgAAAAACAAAAAA==",decoded));
+  CHECK(decodeSeriesBlock(decoded.data(),decoded.size(),series));
+  CHECK_EQUAL(8,series.readings.size());
+
+}
+
+
+int main() {
+
+  testSteadyReadings();
+  testNegativeDeltas();
+  testCounterWrap();
+  testFullBlock();
+  testHeaderOnly();
+  testBase64();
+
+  return checkResult();
+
+}
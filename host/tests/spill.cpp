@@ -0,0 +1,294 @@
+/*
+ *
+ *  The spill log against the file-backed LittleFS stand-in - records
+ *  overflowing the RAM queue come back in the order they were queued,
+ *  across a restart and when the log fills up, and are discarded if
+ *  the topic table changes under them
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+
+#include <string>
+#include <vector>
+
+
+// queue a record numbered n, padded to length (at least 8) with its number
+static void enqueue(uint32_t n, size_t length) {
+
+  size_t capacity = 0;
+  char * payload = try_to_reserve(capacity);
+
+  CHECK(capacity > length);
+  if (capacity <= length) { return; }
+
+  snprintf(payload,capacity,"%08u",n);
+  memset(payload + 8,'a' + n % 26,length - 8);
+
+  try_to_enqueue(__func__,TopicStatusID,length);
+
+}
+
+
+// the number a record carries, or -1 if it is not what enqueue() queued
+static int64_t numberOf(const Telemetry & telemetry, size_t length) {
+
+  if (telemetry.topic != TopicStatusID || telemetry.payloadLength != length) { return -1; }
+  if (telemetry.payload[length] != 0) { return -1; }
+
+  uint32_t n = strtoul(std::string(telemetry.payload,8).c_str(),nullptr,10);
+
+  for (size_t i = 8; i < length; i++) {
+    if (telemetry.payload[i] != (char)('a' + n % 26)) { return -1; }
+  }
+
+  return n;
+
+}
+
+
+// take everything off both queues as the transmitter does - the log first
+static std::vector<int64_t> drain(size_t length) {
+
+  std::vector<int64_t> numbers;
+  Telemetry telemetry;
+
+  while (spillLog.peek(telemetry)) {
+    numbers.push_back(numberOf(telemetry,length));
+    spillLog.release();
+  }
+
+  while (mqttQueue.peek(telemetry)) {
+    numbers.push_back(numberOf(telemetry,length));
+    mqttQueue.release();
+  }
+
+  return numbers;
+
+}
+
+
+static bool isInOrder(const std::vector<int64_t> & numbers, uint32_t first, uint32_t count) {
+
+  if (numbers.size() != count) { return false; }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (numbers[i] != first + i) { return false; }
+  }
+
+  return true;
+
+}
+
+
+/*
+ * Each test has a file system of its own, but the sketch's log keeps
+ * its running totals, so tests look at how much those change.
+ */
+static void testBackfillOrder() {
+
+  hostBegin();
+  CHECK(spillLog.begin());
+
+  uint32_t dropped = spillLog.droppedCount();
+
+  // several times what the RAM queue holds, so it spills repeatedly
+  const uint32_t Count = 300;
+
+  for (uint32_t n = 0; n < Count; n++) { enqueue(n,100); }
+
+  CHECK(spillLog.spilledCount() > 0);
+  CHECK(!spillLog.isEmpty());
+  CHECK(!mqttQueue.isEmpty());
+
+  CHECK(isInOrder(drain(100),0,Count));
+  CHECK(spillLog.isEmpty());
+  CHECK_EQUAL(dropped,spillLog.droppedCount());
+
+  // the log starts afresh once drained, and still keeps order
+  for (uint32_t n = 0; n < 100; n++) { enqueue(n,200); }
+
+  CHECK(isInOrder(drain(200),0,100));
+
+  hostEnd();
+
+}
+
+
+static void testLongestPayload() {
+
+  hostBegin();
+  CHECK(spillLog.begin());
+
+  // try_to_reserve() offers room for the longest payload and its null, and no more
+  size_t capacity = 0;
+  try_to_reserve(capacity);
+  CHECK_EQUAL(TelemetryPayloadMax_bytes + 1,capacity);
+
+  uint32_t spilled = spillLog.spilledCount();
+  uint32_t dropped = spillLog.droppedCount();
+
+  for (uint32_t n = 0; n < 40; n++) { enqueue(n,TelemetryPayloadMax_bytes); }
+
+  spill_to_flash(0);
+
+  CHECK(mqttQueue.isEmpty());
+  CHECK_EQUAL(spilled + 40,spillLog.spilledCount());
+  CHECK_EQUAL(dropped,spillLog.droppedCount());
+
+  CHECK(isInOrder(drain(TelemetryPayloadMax_bytes),0,40));
+
+  hostEnd();
+
+}
+
+
+static void testRestart() {
+
+  hostBegin();
+  CHECK(spillLog.begin());
+
+  for (uint32_t n = 0; n < 100; n++) { enqueue(n,50); }
+  spill_to_flash(0);
+
+  // send some, then note where the log had got to
+  Telemetry telemetry;
+  for (uint32_t n = 0; n < 30; n++) { CHECK(spillLog.peek(telemetry)); spillLog.release(); }
+
+  uint32_t seq = 0, offset = 0;
+  spillLog.cursor(seq,offset);
+
+  // without the cursor, a new log over the same files starts the segment again
+  SpillLog cold(LittleFS);
+  CHECK(cold.begin());
+  CHECK(cold.peek(telemetry) && numberOf(telemetry,50) == 0);
+
+  // with it, the new log picks up where the old one left off
+  SpillLog restarted(LittleFS);
+  CHECK(restarted.begin());
+  CHECK(!restarted.isEmpty());
+
+  restarted.resume(seq,offset);
+
+  std::vector<int64_t> numbers;
+  while (restarted.peek(telemetry)) {
+    numbers.push_back(numberOf(telemetry,50));
+    restarted.release();
+  }
+
+  CHECK(isInOrder(numbers,30,70));
+
+  hostEnd();
+
+}
+
+
+static void testFullLog() {
+
+  hostBegin();
+  CHECK(spillLog.begin());
+
+  uint32_t dropped = spillLog.droppedCount();
+  uint16_t discarded = telemetryDiscarded();
+
+  // comfortably more than SpillMaxSegments segments
+  const size_t Record_bytes = sizeof(TelemetryHeader) + 200 + 1;
+  const uint32_t PerSegment = SpillSegmentSize_bytes / Record_bytes;
+  const uint32_t Count = (SpillMaxSegments + 2) * PerSegment;
+
+  for (uint32_t n = 0; n < Count; n++) {
+    enqueue(n,200);
+    spill_to_flash(0);
+  }
+
+  // the two oldest segments are discarded whole, the rest are in order
+  CHECK_EQUAL(dropped + 2 * PerSegment,spillLog.droppedCount());
+  CHECK_EQUAL(discarded + 2 * PerSegment,telemetryDiscarded());
+  CHECK(isInOrder(drain(200),2 * PerSegment,Count - 2 * PerSegment));
+
+  hostEnd();
+
+}
+
+
+static void testFullLogPartlyRead() {
+
+  hostBegin();
+  CHECK(spillLog.begin());
+
+  const size_t Record_bytes = sizeof(TelemetryHeader) + 200 + 1;
+  const uint32_t PerSegment = SpillSegmentSize_bytes / Record_bytes;
+  const uint32_t Count = SpillMaxSegments * PerSegment + 1;
+
+  for (uint32_t n = 0; n < PerSegment; n++) {
+    enqueue(n,200);
+    spill_to_flash(0);
+  }
+
+  // send some of the oldest segment before the log fills
+  Telemetry telemetry;
+  for (uint32_t n = 0; n < 10; n++) { CHECK(spillLog.peek(telemetry)); spillLog.release(); }
+
+  uint32_t dropped = spillLog.droppedCount();
+
+  for (uint32_t n = PerSegment; n < Count; n++) {
+    enqueue(n,200);
+    spill_to_flash(0);
+  }
+
+  // only the records of the oldest segment still unsent are lost
+  CHECK_EQUAL(dropped + PerSegment - 10,spillLog.droppedCount());
+  CHECK(isInOrder(drain(200),PerSegment,Count - PerSegment));
+
+  hostEnd();
+
+}
+
+
+// (last, as it adds a topic)
+static void testTopicTableChange() {
+
+  hostBegin();
+  CHECK(spillLog.begin());
+
+  for (uint32_t n = 0; n < 100; n++) { enqueue(n,50); }
+  spill_to_flash(0);
+
+  // the same table - picked up again
+  SpillLog same(LittleFS);
+  CHECK(same.begin());
+  CHECK(!same.isEmpty());
+  CHECK_EQUAL(0,same.droppedCount());
+
+  // a firmware with another topic would send them to the wrong places
+  CHECK(registerTopic("extra") != InvalidTopicID);
+
+  SpillLog changed(LittleFS);
+  CHECK(changed.begin());
+  CHECK(changed.isEmpty());
+  CHECK_EQUAL(100,changed.droppedCount());
+
+  // and what it writes now is kept
+  SpillLog again(LittleFS);
+  CHECK(again.begin());
+  CHECK_EQUAL(0,again.droppedCount());
+
+  hostEnd();
+
+}
+
+
+int main() {
+
+  testBackfillOrder();
+  testLongestPayload();
+  testRestart();
+  testFullLog();
+  testFullLogPartlyRead();
+  testTopicTableChange();
+
+  return checkResult();
+
+}
@@ -0,0 +1,170 @@
+/*
+ *
+ *  The trend history's running sums and the integer t² test, against
+ *  the original implementation (see Reference.h)
+ *
+ */
+
+
+#include "Defines.h"
+#include "Check.h"
+#include "Reference.h"
+
+#include <random>
+
+
+// the trend as Reference.h reports it
+static int direction(const char * trend) {
+
+  if (trend == PayloadTrendFallingValue) { return -1; }
+  if (trend == PayloadTrendRisingValue) { return 1; }
+
+  return 0;
+
+}
+
+
+// the running sums must always match a fresh recalculation
+static bool areSumsExact(const PressureHistory & history) {
+
+  int64_t sum_y = 0, sum_yy = 0, sum_xy = 0;
+
+  for (size_t i = 0; i < history.count; i++) {
+    int64_t y = pressureHistoryOffset(history,pressureHistoryAt(history,i));
+    sum_y += y;
+    sum_yy += y * y;
+    sum_xy += i * y;
+  }
+
+  return sum_y == history.sum_y && sum_yy == history.sum_yy && sum_xy == history.sum_xy;
+
+}
+
+
+static void testTraining() {
+
+  PressureHistory history = { };
+
+  for (size_t i = 0; i + 1 < PressureHistorySize; i++) {
+    CHECK(pressureAnalysisIncluding(history,101325 * 256) == PayloadTrendTrainingValue);
+  }
+
+  CHECK(pressureAnalysisIncluding(history,101325 * 256) == PayloadTrendSteadyValue);
+
+  // a perfectly straight line has no residual at all
+  PressureHistory line = { };
+  const char * trend = nullptr;
+
+  for (size_t i = 0; i < PressureHistorySize; i++) { trend = pressureAnalysisIncluding(line,(101325 - 10 * i) * 256); }
+
+  CHECK(trend == PayloadTrendFallingValue);
+
+}
+
+
+/*
+ * Random walks of sea level pressure, each observation 10 minutes
+ * apart, from calm to stormy. Every decision must agree with the
+ * original code except where its t is so close to the critical value
+ * that the two roundings can fall either side.
+ */
+static void testAgainstReference() {
+
+  std::mt19937 random(2026);
+
+  const size_t Walks = 2000;
+  const size_t Steps = 500;
+
+  const double steps_x256[] = { 0.5 * 256, 4 * 256, 20 * 256, 60 * 256 };
+
+  size_t decisions = 0, borderline = 0, disagreements = 0, notSteady = 0;
+
+  for (size_t walk = 0; walk < Walks; walk++) {
+
+    std::normal_distribution<double> step(0.0,steps_x256[walk % 4]);
+    std::normal_distribution<double> drift(0.0,30 * 256);
+
+    PressureHistory history = { };
+    double window[PressureHistorySize] = { };
+    size_t seen = 0;
+
+    double pressure_x256 = 101325 * 256 + drift(random) * 20;
+    double trend_x256 = drift(random);
+
+    for (size_t s = 0; s < Steps; s++) {
+
+      pressure_x256 += trend_x256 + step(random);
+
+      uint32_t observation = (uint32_t)pressure_x256;
+      const char * trend = pressureAnalysisIncluding(history,observation);
+
+      if (!areSumsExact(history)) { CHECK(areSumsExact(history)); break; }
+
+      // the reference sees exactly the 1/16 Pa values the history holds
+      for (size_t i = 1; i < PressureHistorySize; i++) { window[i - 1] = window[i]; }
+      window[PressureHistorySize - 1] = (observation + 8) >> 4;
+
+      if (++seen < PressureHistorySize) {
+        CHECK(trend == PayloadTrendTrainingValue);
+        continue;
+      }
+
+      double tObserved = 0;
+      int expected = referenceTrend(window,Critical_t_value,tObserved);
+
+      decisions++;
+      if (expected != 0) { notSteady++; }
+
+      if (fabs(tObserved / Critical_t_value - 1.0) < 1e-6) { borderline++; continue; }
+
+      if (direction(trend) != expected) { disagreements++; }
+
+    }
+
+  }
+
+  printf("%zu decisions (%zu rising or falling), %zu borderline, %zu disagreements\n",decisions,notSteady,borderline,disagreements);
+
+  CHECK_EQUAL(0,disagreements);
+
+  // the walks must exercise all three outcomes
+  CHECK(notSteady > decisions / 10);
+  CHECK(notSteady < decisions * 9 / 10);
+
+}
+
+
+static void testRestore() {
+
+  // a history rebuilt from its observations (as after a warm restart) carries on identically
+  PressureHistory original = { };
+
+  for (size_t i = 0; i < 3 * PressureHistorySize + 2; i++) {
+    pressureAnalysisIncluding(original,(100000 + 37 * i * i % 900) * 256);
+  }
+
+  int32_t observations[PressureHistorySize];
+  for (size_t i = 0; i < original.count; i++) { observations[i] = pressureHistoryAt(original,i); }
+
+  PressureHistory restored = { };
+  pressureHistoryRestore(restored,observations,original.count);
+
+  CHECK(areSumsExact(restored));
+
+  for (size_t i = 0; i < 50; i++) {
+    uint32_t observation = (99500 + 53 * i % 700) * 256;
+    CHECK(pressureAnalysisIncluding(original,observation) == pressureAnalysisIncluding(restored,observation));
+  }
+
+}
+
+
+int main() {
+
+  testTraining();
+  testAgainstReference();
+  testRestore();
+
+  return checkResult();
+
+}
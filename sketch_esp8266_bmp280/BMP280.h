@@ -0,0 +1,1182 @@
+#pragma once
+
+/*
+ *
+ *  BMP280 driver (see SensorTask.h)
+ *
+ *  Each BMP280Driver looks after one sensor at a given I2C address and
+ *  publishes its reports to «device key»/temperature and «device
+ *  key»/pressure, with its own samples, trend history and deadbands.
+ *
+ */
+
+
+constexpr const char * TopicTemperatureKey   = "temperature";
+constexpr const char * TopicPressureKey      = "pressure";
+
+const char *    PayloadCelsiusKey           = "\"temp_C\"";
+const char *    PayloadFahrenheitKey        = "\"temp_F\"";
+
+const char*     PayloadLocalPressureKey     = "\"local_hPa\"";
+const char*     PayloadSeaLevelPressureKey  = "\"sea_hPa\"";
+const char*     PayloadTrendKey             = "\"trend\"";
+const char*     PayloadTrendTrainingValue   = "\"training\"";
+const char*     PayloadTrendFallingValue    = "\"falling\"";
+const char*     PayloadTrendSteadyValue     = "\"steady\"";
+const char*     PayloadTrendRisingValue     = "\"rising\"";
+
+// summary of the samples behind each report
+const char *    PayloadMinimumCelsiusKey    = "\"min_C\"";
+const char *    PayloadMaximumCelsiusKey    = "\"max_C\"";
+const char *    PayloadDeviationCelsiusKey  = "\"sd_C\"";
+const char *    PayloadMinimumPressureKey   = "\"min_hPa\"";
+const char *    PayloadMaximumPressureKey   = "\"max_hPa\"";
+const char *    PayloadDeviationPressureKey = "\"sd_hPa\"";
+const char *    PayloadSamplesKey           = "\"samples\"";
+
+// CBOR map keys (when CBORPayloads is true)
+const uint8_t   CBORCelsiusKey              = 1;
+const uint8_t   CBORFahrenheitKey           = 2;
+const uint8_t   CBORMinimumCelsiusKey       = 3;
+const uint8_t   CBORMaximumCelsiusKey       = 4;
+const uint8_t   CBORDeviationCelsiusKey     = 5;
+const uint8_t   CBORTemperatureSamplesKey   = 6;
+
+const uint8_t   CBORLocalPressureKey        = 1;
+const uint8_t   CBORSeaLevelPressureKey     = 2;
+const uint8_t   CBORTrendKey                = 3;
+const uint8_t   CBORMinimumPressureKey      = 4;
+const uint8_t   CBORMaximumPressureKey      = 5;
+const uint8_t   CBORDeviationPressureKey    = 6;
+const uint8_t   CBORPressureSamplesKey      = 7;
+
+// CBOR trend values
+const uint8_t   CBORTrendTraining           = 0;
+const uint8_t   CBORTrendFalling            = 1;
+const uint8_t   CBORTrendSteady             = 2;
+const uint8_t   CBORTrendRising             = 3;
+
+#if (CompressedBacklog)
+constexpr const char * TopicSeriesKey        = "series";
+
+const char *    PayloadSeriesReadingsKey    = "\"readings\"";
+const char *    PayloadSeriesClockKey       = "\"clock_s\"";
+const char *    PayloadSeriesBlockKey       = "\"block\"";
+
+const uint8_t   CBORSeriesReadingsKey       = 1;
+const uint8_t   CBORSeriesClockKey          = 2;
+const uint8_t   CBORSeriesBlockKey          = 3;
+#endif
+
+/*
+ * Readings travel through the driver in the BMP280's own fixed-point
+ * units (datasheet section 8.2):
+ *
+ * - temperature in hundredths of a degree Celsius (celsius_x100);
+ * - pressure in 1/256ths of a pascal (pascals_x256).
+ *
+ * The ESP8266 has no FPU, so everything from the sensor through the
+ * sea level correction and trend analysis to the payload is integer
+ * arithmetic.
+ */
+
+/*
+ * The BMP280's operating range (datasheet section 1). Anything
+ * outside the range is treated as a malfunction - but 0.0 °C is a
+ * perfectly good temperature.
+ */
+const int32_t BMP280MinimumCelsius_x100 = -40 * 100;
+const int32_t BMP280MaximumCelsius_x100 = 85 * 100;
+const uint32_t BMP280MinimumPascals_x256 = 300UL * 100 * 256;
+const uint32_t BMP280MaximumPascals_x256 = 1100UL * 100 * 256;
+
+/*
+ * Reports are only queued when something has changed (see Deadband.h):
+ *
+ * - temperature when the mean has moved by SensorTemperatureDeadband_x100;
+ * - pressure when the sea level pressure has moved by
+ *   SensorPressureDeadband_x256 or the trend has changed;
+ * - either, regardless, if it has been silent for SensorHeartbeat_ms.
+ */
+const uint32_t SensorTemperatureDeadband_x100 = 20;       // 0.2 °C
+const uint32_t SensorPressureDeadband_x256 = 20 * 256;    // 0.2 hPa
+const unsigned long SensorHeartbeat_ms = 60*60*1000;
+
+const uint16_t SensorHeartbeatReports = SensorHeartbeat_ms / sensorScanTime_ms;
+
+static_assert(SensorHeartbeat_ms >= sensorScanTime_ms,"SensorHeartbeat_ms is shorter than a report");
+
+/*
+ * The sensor runs in forced mode (datasheet section 3.6.2). Rather
+ * than converting continuously, it sleeps until trigger() writes
+ * ctrl_meas, takes one reading and goes back to sleep by itself. The
+ * event loop carries on while the conversion runs (SensorConverting)
+ * and the status register is only polled once the datasheet's maximum
+ * measurement time has passed.
+ *
+ * Oversampling does the smoothing. With samples minutes apart the IIR
+ * filter would be averaging over hours, so it is off.
+ */
+const uint8_t BMP280StatusRegister = 0xF3;
+const uint8_t BMP280ControlRegister = 0xF4;
+const uint8_t BMP280StatusMeasuring = 0x08;
+
+constexpr Adafruit_BMP280::sensor_sampling BMP280TemperatureSampling = Adafruit_BMP280::SAMPLING_X2;
+constexpr Adafruit_BMP280::sensor_sampling BMP280PressureSampling = Adafruit_BMP280::SAMPLING_X16;
+
+// ctrl_meas - oversampling plus "take one reading"
+const uint8_t BMP280ForcedControl =
+  (BMP280TemperatureSampling << 5) | (BMP280PressureSampling << 2) | Adafruit_BMP280::MODE_FORCED;
+
+// oversampling setting to number of samples (0, 1, 2, 4, 8 or 16)
+constexpr uint32_t bmp280Samples(uint8_t setting) { return (setting == 0) ? 0 : 1UL << (setting - 1); }
+
+// maximum measurement time (datasheet appendix B)
+constexpr uint32_t BMP280ConversionTime_us =
+  1250 +
+  2300 * bmp280Samples(BMP280TemperatureSampling) +
+  ((BMP280PressureSampling == Adafruit_BMP280::SAMPLING_NONE) ? 0 : 2300 * bmp280Samples(BMP280PressureSampling) + 575);
+
+
+/*
+ * Equivalent pressure at sea level (see
+ * https://keisan.casio.com/exec/system/1224575267):
+ *
+ *     p₀ = p · (1 - x)^-5.257   where x = 0.0065h / (t + 0.0065h + 273.15)
+ *
+ * Rather than calling pow() (software floating point on the ESP8266),
+ * the factor (1 - x)^-5.257 is summed in Q28 fixed point as the first
+ * SeaLevelTerms terms of its binomial series:
+ *
+ *     1 + c₁x + c₂x² + ...   where c₀ = 1 and cₖ = cₖ₋₁ · (5.257 + k - 1) / k
+ *
+ * The coefficients are worked out by the compiler and x is small (0.0075
+ * at 338 m and 20 °C). Compared with pow() in double precision, over
+ * the BMP280's -40..85 °C range, the factor is within:
+ *
+ * - 1 part in 10⁷ up to 2000 m (under 0.01 Pa - the payload is
+ *   rounded to 1 Pa);
+ * - 1 part in 10⁶ up to 3000 m (series truncation starts to show).
+ *
+ * LocalHeightAboveSeaLevelInMetres is checked against that range.
+ */
+constexpr double SeaLevelExponent = 5.257;
+const uint8_t SeaLevelFractionBits = 28;
+const uint8_t SeaLevelTerms = 8;
+
+static_assert(LocalHeightAboveSeaLevelInMetres >= -500 && LocalHeightAboveSeaLevelInMetres <= 3000,"LocalHeightAboveSeaLevelInMetres outside the range of the sea level series");
+
+constexpr double seaLevelCoefficient(int k) {
+
+  return (k == 0) ? 1.0 : seaLevelCoefficient(k - 1) * (SeaLevelExponent + k - 1) / k;
+
+}
+
+constexpr int64_t seaLevelFixed(double value) {
+
+  return (int64_t)(value * (1LL << SeaLevelFractionBits) + 0.5);
+
+}
+
+constexpr int64_t SeaLevelSeries[SeaLevelTerms] = {
+  seaLevelFixed(seaLevelCoefficient(0)), seaLevelFixed(seaLevelCoefficient(1)),
+  seaLevelFixed(seaLevelCoefficient(2)), seaLevelFixed(seaLevelCoefficient(3)),
+  seaLevelFixed(seaLevelCoefficient(4)), seaLevelFixed(seaLevelCoefficient(5)),
+  seaLevelFixed(seaLevelCoefficient(6)), seaLevelFixed(seaLevelCoefficient(7))
+};
+
+// 0.0065h in hundredths of a kelvin, scaled by 2¹⁶ so rounding it costs nothing
+constexpr int64_t SeaLevelLapse_x100_x65536 =
+  (int64_t)(LocalHeightAboveSeaLevelInMetres * 0.0065 * 100 * 65536 + ((LocalHeightAboveSeaLevelInMetres < 0) ? -0.5 : 0.5));
+
+
+uint32_t equivalentPressureAtSeaLevel  (
+  uint32_t pascals_x256,    // pressure at this altitude
+  int32_t celsius_x100      // temperature at this altitude
+) {
+
+  // x in Q28
+  int64_t denominator = ((int64_t)celsius_x100 + 27315) * 65536 + SeaLevelLapse_x100_x65536;
+  int64_t x = SeaLevelLapse_x100_x65536 * (1LL << SeaLevelFractionBits) / denominator;
+
+  // Horner's method, highest power first
+  int64_t factor = SeaLevelSeries[SeaLevelTerms - 1];
+
+  for (int k = SeaLevelTerms - 2; k >= 0; k--) {
+    factor = SeaLevelSeries[k] + ((factor * x) >> SeaLevelFractionBits);
+  }
+
+  return ((int64_t)pascals_x256 * factor + (1LL << (SeaLevelFractionBits - 1))) >> SeaLevelFractionBits;
+
+}
+
+
+/*
+ *  The trend analysis fits a line through the last
+ *  PressureHistorySize observations and tests whether its
+ *  slope is significantly different from zero at the
+ *  TrendSignificance level (see pressureAnalysisIncluding()).
+ *
+ *  With observations 10 minutes apart, the default of 6
+ *  takes an hour to fill and looks back over an hour.
+ *  A longer window (eg 18 for three hours) gives a steadier
+ *  but slower-to-react trend. A smaller TrendSignificance
+ *  (eg 0.01) needs stronger evidence before reporting
+ *  rising or falling.
+ *
+ *  The critical value of t for the test depends on both:
+ *
+ *      ν = PressureHistorySize - 2
+ *
+ *  and is worked out by the compiler (see StudentT.h) so
+ *  either can be changed without recalculating anything.
+ *  For the defaults, ν = 4 and the value is 2.776445105.
+ */
+const size_t PressureHistorySize = 6;
+constexpr double TrendSignificance = 0.05;
+
+static_assert(PressureHistorySize >= 3,"the trend test needs at least 3 observations");
+static_assert(PressureHistorySize <= 32,"the trend sums are only sized for up to 32 observations");
+static_assert(TrendSignificance > 0.0 && TrendSignificance < 1.0,"TrendSignificance must be between 0 and 1");
+
+constexpr double Critical_t_value = studentTCritical(TrendSignificance,PressureHistorySize - 2);
+
+// the test compares t² rather than t (so needs no square roots), in Q16
+constexpr int64_t Critical_t_squared_q16 = (int64_t)(Critical_t_value * Critical_t_value * 65536 + 0.5);
+
+static_assert(Critical_t_squared_q16 < (1LL << 31),"TrendSignificance too small for so few observations");
+
+/*
+ * The trend history. Each sensor has its own, and it is a plain struct
+ * so it can be carried across a deliberate reboot (see Restart.h).
+ *
+ * The history is a circular buffer with running sums, so adding an
+ * observation and re-fitting the line of best fit costs the same
+ * whatever PressureHistorySize is:
+ *
+ * - x is an observation's position in the window (0 = oldest) so,
+ *   once the window is full, ∑(x) and ∑(x²) are constants;
+ * - when the window slides, every x drops by one, so ∑(xy) loses
+ *   ∑(y) (less the departing observation, whose x was 0) before the
+ *   new observation is added at x = n-1;
+ * - SSE follows from ∑(y²) without revisiting the observations.
+ *
+ * Observations are sea level pressures in 1/16ths of a pascal (well
+ * below the sensor's resolution) and y is stored relative to
+ * reference, so the sums are exact integers which never drift. Each
+ * time the buffer wraps, the reference moves to the oldest observation
+ * and the sums are recomputed. That keeps y small, and clamping it to
+ * ±PressureTrendRange_x16 (far more change than the weather manages
+ * within a window) guarantees the arithmetic in
+ * pressureAnalysisIncluding() fits in 64 bits.
+ */
+const int32_t PressureTrendRange_x16 = 40 * 100 * 16;   // 40 hPa
+
+typedef struct {
+  int32_t pressures[PressureHistorySize];   // the observations
+  size_t count;                             // how many the array holds
+  size_t head;                              // index of the oldest once the array is full
+  int32_t reference;                        // y is relative to this
+  int64_t sum_y;                            // ∑(y)
+  int64_t sum_yy;                           // ∑(y²)
+  int64_t sum_xy;                           // ∑(xy)
+} PressureHistory;
+
+
+
+// the i-th oldest observation
+int32_t pressureHistoryAt(const PressureHistory & history, size_t i) {
+
+  return history.pressures[(history.head + i) % PressureHistorySize];
+
+}
+
+
+// an observation's y
+int64_t pressureHistoryOffset(const PressureHistory & history, int32_t pressure) {
+
+  int32_t y = pressure - history.reference;
+
+  if (y > PressureTrendRange_x16) { return PressureTrendRange_x16; }
+  if (y < -PressureTrendRange_x16) { return -PressureTrendRange_x16; }
+
+  return y;
+
+}
+
+
+void pressureHistoryResum(PressureHistory & history) {
+
+  history.reference = pressureHistoryAt(history,0);
+
+  history.sum_y = 0;
+  history.sum_yy = 0;
+  history.sum_xy = 0;
+
+  for (size_t i = 0; i < history.count; i++) {
+
+    int64_t y = pressureHistoryOffset(history,pressureHistoryAt(history,i));
+
+    history.sum_y += y;
+    history.sum_yy += y * y;
+    history.sum_xy += i * y;
+
+  }
+
+}
+
+
+void pressureHistoryAdd(PressureHistory & history, int32_t newPressure) {
+
+  // the first observation becomes the reference
+  if (history.count == 0) { history.reference = newPressure; }
+
+  int64_t y = pressureHistoryOffset(history,newPressure);
+
+  // have we filled the array?
+  if (history.count < PressureHistorySize) {
+
+    // no! add this observation to the array at x = count
+    history.pressures[history.count] = newPressure;
+
+    history.sum_y += y;
+    history.sum_yy += y * y;
+    history.sum_xy += history.count * y;
+
+    // bump n
+    history.count++;
+
+    return;
+      
+  }
+
+  // yes! the array is full so the oldest observation makes way
+  int64_t oldest = pressureHistoryOffset(history,history.pressures[history.head]);
+
+  history.sum_xy += (int64_t)(PressureHistorySize - 1) * y - (history.sum_y - oldest);
+  history.sum_y += y - oldest;
+  history.sum_yy += y * y - oldest * oldest;
+
+  history.pressures[history.head] = newPressure;
+  history.head = (history.head + 1) % PressureHistorySize;
+
+  // once per lap, move the reference and start the sums afresh
+  if (history.head == 0) { pressureHistoryResum(history); }
+
+}
+
+
+// reload the history, oldest first (see Restart.h)
+void pressureHistoryRestore(PressureHistory & history, const int32_t * observations, size_t count) {
+
+  history.count = 0;
+  history.head = 0;
+  history.sum_y = 0;
+  history.sum_yy = 0;
+  history.sum_xy = 0;
+
+  for (size_t i = 0; i < count && i < PressureHistorySize; i++) {
+    pressureHistoryAdd(history,observations[i]);
+  }
+
+}
+
+
+const char* pressureAnalysisIncluding(PressureHistory & history, uint32_t seaLevelPascals_x256) {
+
+  pressureHistoryAdd(history,(seaLevelPascals_x256 + 8) >> 4);
+
+  // is the array full yet?
+  if (history.count < PressureHistorySize) {
+
+    // no! we are still training
+    return PayloadTrendTrainingValue;
+      
+  }
+
+  /*
+    * Step 1 : calculate the straight line of best fit (least-squares
+    *          (linear regression). In effect we are assuming we can put
+    *          time on the X axis and pressure on the Y axis, and then
+    *          estimate the likely pressure at a point in time, depending
+    *          on a sliding window of equally-spaced observations taken
+    *          at 10-minute intervals over the last hour.
+    *
+    *          ∑(y), ∑(y²) and ∑(xy) are maintained by pressureHistoryAdd().
+    *          ∑(x) and ∑(x²) over x = 0..n-1 are constants.
+    */
+
+  const int64_t n = PressureHistorySize;
+  const int64_t sum_x = n * (n - 1) / 2;                  // ∑(x)
+  const int64_t sum_xx = (n - 1) * n * (2 * n - 1) / 6;   // ∑(x²)
+
+  // corrected sums of squares and products, times n to keep them whole
+  int64_t nS_xx = n * sum_xx - sum_x * sum_x;
+  int64_t nS_xy = n * history.sum_xy - sum_x * history.sum_y;
+  int64_t nS_yy = n * history.sum_yy - history.sum_y * history.sum_y;
+
+  // the slope is S_xy / S_xx and S_xx is positive, so only its sign matters
+
+  /*
+    * Step 2 : Perform an hypothesis test on the equation of the linear model
+    *          to see whether, statistically, the available data suggests
+    *          the slope is non-zero.
+    *          
+    *          Let beta1 = the slope of the regression line between fixed time
+    *          intervals and pressure observations.
+    *          
+    *          H0: β₁ = 0    (the slope is zero)
+    *          H1: β₁ ≠ 0    (the slope is not zero)
+    *          
+    *          The level of significance: α is TrendSignificance (eg 5%)
+    *          
+    *          The test statistic is:
+    *          
+    *              tObserved = (b₁ - β₁) / s_b₁
+    *              
+    *          In this context, b₁ is the estimated slope of the linear model
+    *          and β₁ the reference value from the hypothesis being tested.
+    *          s_b₁ is the standard error of b₁.
+    *
+    *          From H0, β₁ = 0 so the test statistic simplifies to:
+    * 
+    *              tObserved = b₁ / s_b₁
+    *      
+    *          This is a two-tailed test so half of α goes on each side of
+    *          the T distribution.
+    *          
+    *          The degrees-of-freedom, ν, for the test is:
+    *          
+    *              ν = n-2 (eg 6 - 2 = 4)
+    *              
+    *          The critical value (calculated by the compiler - see
+    *          StudentT.h) is, for example:
+    * 
+    *              -tCritical = invt(0.05/2,4) = -2.776445105
+    *      
+    *          By symmetry:
+    * 
+    *              +tCritical = abs(-tCritical)
+    *              
+    *          The decision rule is:
+    * 
+    *              reject H0 if tObserved < -tCritical or tObserved > +tCritical
+    *      
+    *          which can be simplified to:
+    * 
+    *              reject H0 if abs(tObserved) > +tCritical
+    *              
+    *          The next step is to calculate the test statistic. With
+    *          SSE = S_yy - S_xy²/S_xx (the residual sum of squares) and
+    *          s_b₁ = √(SSE / (n-2) / S_xx), its square is:
+    *
+    *              tObserved² = (n-2) · nS_xy² / (nS_xx · nS_yy - nS_xy²)
+    *
+    *          Both sides of the decision rule are positive, so squaring
+    *          them changes nothing and does away with the square roots:
+    *
+    *              reject H0 if (n-2) · nS_xy² > tCritical² · (nS_xx · nS_yy - nS_xy²)
+    *      
+    */
+
+  // n²·S_xy² and n²·S_xx·SSE - exact, and never negative
+  int64_t explained = nS_xy * nS_xy;
+  int64_t residual = nS_xx * nS_yy - explained;
+
+  // scale both down alike until the comparison below fits in 64 bits
+  while (explained >= (1LL << 32) || residual >= (1LL << 32)) {
+    explained >>= 1;
+    residual >>= 1;
+  }
+
+  /*    
+    *          Finally, make the decision and return a string summarising
+    *          the conclusion.
+    */
+
+  // is tObserved further to the left or right than tCritical?
+  if ((n - 2) * explained * 65536 > Critical_t_squared_q16 * residual) {
+
+    // yes! what is the sign of the slope?
+    if (nS_xy < 0) {
+
+      return PayloadTrendFallingValue;
+        
+    } else {
+
+      return PayloadTrendRisingValue;
+        
+    }
+
+  }
+
+  // otherwise, the slope may be zero
+  return PayloadTrendSteadyValue;
+
+}
+
+
+// value / divisor, rounded half away from zero
+int32_t roundedQuotient(int32_t value, int32_t divisor) {
+
+  return (value < 0) ? -((divisor / 2 - value) / divisor) : (value + divisor / 2) / divisor;
+
+}
+
+
+// the trend as a number (also its CBOR value)
+uint8_t trendCode(const char * trend) {
+
+  return
+    (trend == PayloadTrendFallingValue) ? CBORTrendFalling :
+    (trend == PayloadTrendSteadyValue)  ? CBORTrendSteady :
+    (trend == PayloadTrendRisingValue)  ? CBORTrendRising :
+                                          CBORTrendTraining;
+
+}
+
+
+// pascals_x256 to whole pascals (ie hPa to two decimal places)
+int32_t wholePascals(uint32_t pascals_x256) { return (pascals_x256 + 128) >> 8; }
+
+
+bool isPlausibleReading(int32_t celsius_x100, uint32_t pascals_x256) {
+
+  return
+    (celsius_x100 >= BMP280MinimumCelsius_x100) && (celsius_x100 <= BMP280MaximumCelsius_x100) &&
+    (pascals_x256 >= BMP280MinimumPascals_x256) && (pascals_x256 <= BMP280MaximumPascals_x256);
+
+}
+
+
+/*
+ * Compensation (datasheet section 8.2). The trimming parameters are
+ * read once by BMP280Driver::initialise(). Each reading is then a single
+ * burst of the six data registers (pressure then temperature, so both
+ * come from the same conversion) compensated in integer arithmetic -
+ * the temperature once, for both results.
+ */
+const uint8_t BMP280CalibrationRegister = 0x88;
+const uint8_t BMP280CalibrationLength = 24;
+const uint8_t BMP280DataRegister = 0xF7;
+const uint8_t BMP280DataLength = 6;
+
+// what the data registers hold if a measurement was skipped
+const int32_t BMP280SkippedReading = 0x80000;
+
+typedef struct {
+  uint16_t dig_T1;
+  int16_t dig_T2;
+  int16_t dig_T3;
+  uint16_t dig_P1;
+  int16_t dig_P2;
+  int16_t dig_P3;
+  int16_t dig_P4;
+  int16_t dig_P5;
+  int16_t dig_P6;
+  int16_t dig_P7;
+  int16_t dig_P8;
+  int16_t dig_P9;
+} BMP280Calibration;
+
+static_assert(sizeof(BMP280Calibration) == BMP280CalibrationLength,"BMP280Calibration does not match the registers");
+
+
+bool readBMP280Calibration(uint8_t address, BMP280Calibration & calibration) {
+
+  uint8_t data[BMP280CalibrationLength];
+
+  if (!i2cReadRegisters(address,BMP280CalibrationRegister,data,BMP280CalibrationLength)) { return false; }
+
+  // little-endian 16-bit values, in the same order as the struct
+  uint16_t * dig = (uint16_t *)&calibration;
+
+  for (uint8_t i = 0; i < BMP280CalibrationLength / 2; i++) {
+    dig[i] = data[2 * i] | (data[2 * i + 1] << 8);
+  }
+
+  // dig_P1 divides - zero means the read went wrong
+  return (calibration.dig_P1 != 0);
+
+}
+
+
+// temperature in the form the pressure compensation needs ("t_fine")
+int32_t bmp280FineTemperature(const BMP280Calibration & c, int32_t adc_T) {
+
+  int32_t var1 = ((((adc_T >> 3) - ((int32_t)c.dig_T1 << 1))) * ((int32_t)c.dig_T2)) >> 11;
+  int32_t var2 = (((((adc_T >> 4) - ((int32_t)c.dig_T1)) * ((adc_T >> 4) - ((int32_t)c.dig_T1))) >> 12) * ((int32_t)c.dig_T3)) >> 14;
+
+  return var1 + var2;
+
+}
+
+
+// pressure in 1/256ths of a pascal
+uint32_t bmp280Pascals_x256(const BMP280Calibration & c, int32_t adc_P, int32_t t_fine) {
+
+  int64_t var1 = ((int64_t)t_fine) - 128000;
+  int64_t var2 = var1 * var1 * (int64_t)c.dig_P6;
+  var2 = var2 + ((var1 * (int64_t)c.dig_P5) << 17);
+  var2 = var2 + (((int64_t)c.dig_P4) << 35);
+  var1 = ((var1 * var1 * (int64_t)c.dig_P3) >> 8) + ((var1 * (int64_t)c.dig_P2) << 12);
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)c.dig_P1) >> 33;
+
+  // avoid dividing by zero
+  if (var1 == 0) { return 0; }
+
+  int64_t p = 1048576 - adc_P;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)c.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)c.dig_P8) * p) >> 19;
+
+  return ((p + var1 + var2) >> 8) + (((int64_t)c.dig_P7) << 4);
+
+}
+
+
+/*
+ * Read the result of the last conversion. Returns false if the sensor
+ * didn't respond or had nothing to report.
+ */
+bool readBMP280(
+  uint8_t address,
+  const BMP280Calibration & calibration,
+  int32_t & celsius_x100,
+  uint32_t & pascals_x256
+) {
+
+  uint8_t data[BMP280DataLength];
+
+  if (!i2cReadRegisters(address,BMP280DataRegister,data,BMP280DataLength)) { return false; }
+
+  // 20-bit readings, most significant byte first
+  int32_t adc_P = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
+  int32_t adc_T = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
+
+  if (adc_P == BMP280SkippedReading || adc_T == BMP280SkippedReading) { return false; }
+
+  int32_t t_fine = bmp280FineTemperature(calibration,adc_T);
+
+  celsius_x100 = (t_fine * 5 + 128) >> 8;
+  pascals_x256 = bmp280Pascals_x256(calibration,adc_P,t_fine);
+
+  return true;
+
+}
+
+
+#if (CompressedBacklog)
+
+/*
+ * Reports held while the broker is unreachable (see Series.h). Each
+ * reading has four channels: the mean temperature (0.01 °C), the mean
+ * local and the sea level pressure (Pa) and the trend code. A block
+ * is limited to what still fits in a payload once base64 encoded and,
+ * because every sensor's block goes in the warm restart snapshot, the
+ * more sensors there are, the smaller the blocks.
+ */
+const uint8_t SeriesChannels = 4;
+const size_t SeriesBlockCapacity_bytes = (BMP280Count == 1) ? 153 : 60;
+
+// {"readings":255,"clock_s":4294967295,"block":"«base64»"} plus the null
+static_assert(48 + 4 * ((SeriesBlockCapacity_bytes + 2) / 3) + 1 <= TelemetryPayloadMax_bytes,"series block does not fit in a payload");
+
+static_assert(SeriesBlockCapacity_bytes >= SeriesHeader_bytes + 2 * SeriesVarintMax_bytes * (1 + SeriesChannels),"too many sensors for a useful series block");
+
+typedef SeriesBlock<SeriesChannels,SeriesBlockCapacity_bytes> BMP280SeriesBlock;
+
+#endif
+
+
+class BMP280Driver {
+
+  public:
+
+    static const unsigned long ConversionTime_ms = (BMP280ConversionTime_us + 999) / 1000;
+
+
+    // carried across deep sleep and reboots in the warm restart snapshot
+    typedef struct {
+      int32_t pressures[PressureHistorySize];   // oldest first
+      uint32_t pressureCount;
+      DeadbandState temperatureDeadband;
+      DeadbandState pressureDeadband;
+      #if (CompressedBacklog)
+      BMP280SeriesBlock series;
+      #endif
+    } Retained;
+
+
+    BMP280Driver(uint8_t address, const char * deviceKey) :
+      address(address), deviceKey(deviceKey) {
+
+      temperatureTopic = registerTopic(deviceKey,TopicTemperatureKey);
+      pressureTopic = registerTopic(deviceKey,TopicPressureKey);
+
+      #if (CompressedBacklog)
+      seriesTopic = registerTopic(deviceKey,TopicSeriesKey);
+      #endif
+
+    }
+
+
+    const char * name() { return deviceKey; }
+
+
+    // reports held back by the deadbands (see Status.h)
+    uint32_t temperatureReportsSuppressed() { return temperatureDeadband.suppressedCount; }
+    uint32_t pressureReportsSuppressed() { return pressureDeadband.suppressedCount; }
+
+
+    bool initialise() {
+
+      // can we start the sensor?
+      if (!bmp280.begin(address)) { return false; }
+
+      // fast mode (Wire.begin() puts the bus back to 100 kHz)
+      Wire.setClock(SensorI2CClock_Hz);
+
+      // compensation needs this sensor's trimming parameters
+      if (!readBMP280Calibration(address,calibration)) { return false; }
+
+      // sensor found - configure (asleep until trigger())
+      bmp280.setSampling(
+        Adafruit_BMP280::MODE_SLEEP,      /* Operating Mode. */
+        BMP280TemperatureSampling,        /* Temp. oversampling */
+        BMP280PressureSampling,           /* Pressure oversampling */
+        Adafruit_BMP280::FILTER_OFF,      /* Filtering. */
+        Adafruit_BMP280::STANDBY_MS_500   /* Standby time (normal mode only). */
+      );
+
+      #if (SerialDebugging)
+      // report
+      bmp280.getTemperatureSensor()->printSensorDetails();
+      #endif
+
+      return true;
+
+    }
+
+
+    // start one conversion
+    bool trigger() { return i2cWriteRegister(address,BMP280ControlRegister,BMP280ForcedControl); }
+
+
+    bool checkConversion(bool & isDone) {
+
+      uint8_t status = 0;
+
+      if (!i2cReadRegisters(address,BMP280StatusRegister,&status,1)) { return false; }
+
+      isDone = !(status & BMP280StatusMeasuring);
+
+      return true;
+
+    }
+
+
+    bool read() {
+
+      // readings in the sensor's fixed-point units
+      int32_t celsius_x100;
+      uint32_t pascals_x256;
+
+      // read temperature and pressure values
+      bool isResponding = readBMP280(address,calibration,celsius_x100,pascals_x256);
+
+      #if (SerialDebugging)
+      // diagnostic
+      if (isResponding) {
+        Serial.printf("%s temp: %ld (0.01 C)\n",deviceKey,(long)celsius_x100);
+        Serial.printf("%s local pressure: %lu (1/256 Pa)\n",deviceKey,(unsigned long)pascals_x256);
+      }
+      #endif
+
+      // sense bad reading
+      if (!isResponding || !isPlausibleReading(celsius_x100,pascals_x256)) { return false; }
+
+      temperatureSamples.add(celsius_x100);
+      pressureSamples.add(pascals_x256);
+
+      updateReportExpected();
+
+      return true;
+
+    }
+
+
+    void report() {
+
+      // calculate equivalent barometric pressure at sea level
+      uint32_t seaLevelPascals_x256 = equivalentPressureAtSeaLevel(pressureSamples.mean(),temperatureSamples.mean());
+
+      // the trend analysis needs every observation, sent or not
+      const char * trend = pressureAnalysisIncluding(history,seaLevelPascals_x256);
+
+      #if (CompressedBacklog)
+      // broker unreachable? hold the report back rather than queueing it
+      if (mqttBrokerUnreachable) {
+
+        holdSeriesReading(temperatureSamples.mean(),pressureSamples.mean(),seaLevelPascals_x256,trend);
+
+        temperatureSamples.reset();
+        pressureSamples.reset();
+
+        updateReportExpected();
+
+        return;
+
+      }
+      #endif
+
+      // transmit temperature (if it has changed)
+      if (deadbandShouldReport(
+        temperatureDeadband,
+        temperatureSamples.mean(),
+        0,
+        SensorTemperatureDeadband_x100,
+        SensorHeartbeatReports
+      )) {
+        publishTemperature();
+      }
+      #if (SerialDebugging)
+      else {
+        Serial.printf("%s() - %s temperature unchanged, not sent (%u in a row)\n",__func__,deviceKey,temperatureDeadband.silentReports);
+      }
+      #endif
+
+      // transmit pressure (if it or the trend has changed)
+      if (deadbandShouldReport(
+        pressureDeadband,
+        seaLevelPascals_x256,
+        trendCode(trend),
+        SensorPressureDeadband_x256,
+        SensorHeartbeatReports
+      )) {
+        publishPressure(seaLevelPascals_x256,trend);
+      }
+      #if (SerialDebugging)
+      else {
+        Serial.printf("%s() - %s pressure unchanged, not sent (%u in a row)\n",__func__,deviceKey,pressureDeadband.silentReports);
+      }
+      #endif
+
+      // start the next report
+      temperatureSamples.reset();
+      pressureSamples.reset();
+
+      updateReportExpected();
+
+    }
+
+
+    /*
+     * Would report() queue anything if it ran now? (see
+     * updateReportExpected())
+     */
+    bool isReportExpected() {
+
+      #if (CompressedBacklog)
+      // held back rather than queued
+      if (mqttBrokerUnreachable) { return false; }
+      #endif
+
+      return isReportLikely;
+
+    }
+
+
+    void save(Retained & retained) {
+
+      // trend history
+      for (size_t i = 0; i < history.count; i++) {
+        retained.pressures[i] = pressureHistoryAt(history,i);
+      }
+      retained.pressureCount = history.count;
+
+      // report by exception
+      retained.temperatureDeadband = temperatureDeadband;
+      retained.pressureDeadband = pressureDeadband;
+
+      #if (CompressedBacklog)
+      // readings held back
+      retained.series = series;
+      #endif
+
+    }
+
+
+    void restore(const Retained & retained) {
+
+      pressureHistoryRestore(history,retained.pressures,retained.pressureCount);
+
+      temperatureDeadband = retained.temperatureDeadband;
+      pressureDeadband = retained.pressureDeadband;
+
+      updateReportExpected();
+
+      #if (CompressedBacklog)
+      series = retained.series;
+      #endif
+
+    }
+
+
+    #if (CompressedBacklog)
+
+    void publishBacklog() {
+
+      // sense nothing held
+      if (series.count() == 0) { return; }
+
+      // reserve space at the tail of the queue
+      size_t capacity = 0;
+      char * payload = try_to_reserve(capacity);
+
+      // construct payload in place
+      #if (CBORPayloads)
+      CBORWriter cbor(payload,capacity);
+      cbor.map(3);
+      cbor.key(CBORSeriesReadingsKey);    cbor.unsignedInteger(series.count());
+      cbor.key(CBORSeriesClockKey);       cbor.unsignedInteger(seriesTime_s(series.timebase()));
+      cbor.key(CBORSeriesBlockKey);       cbor.byteString(series.data(),series.length());
+      size_t payloadLength = cbor.length();
+      #else
+      JSONWriter json(payload,capacity);
+      json.beginObject();
+      json.key(PayloadSeriesReadingsKey);   json.unsignedInteger(series.count());
+      json.key(PayloadSeriesClockKey);      json.unsignedInteger(seriesTime_s(series.timebase()));
+      json.key(PayloadSeriesBlockKey);      json.base64(series.data(),series.length());
+      json.endObject();
+      size_t payloadLength = json.length();
+      #endif
+
+      // publish the block
+      try_to_enqueue(__func__,seriesTopic,payloadLength);
+
+      series.reset();
+
+    }
+
+    #endif
+
+
+  private:
+
+    uint8_t address;
+    const char * deviceKey;
+
+    TopicID temperatureTopic;
+    TopicID pressureTopic;
+
+    // report by exception
+    DeadbandState temperatureDeadband = { };
+    DeadbandState pressureDeadband = { };
+
+    // the sensor API (I2C interface)
+    Adafruit_BMP280 bmp280;
+
+    BMP280Calibration calibration;
+
+    // the samples for the report in progress
+    SampleStatistics temperatureSamples;    // celsius_x100
+    SampleStatistics pressureSamples;       // pascals_x256 (local)
+
+    PressureHistory history = { };
+
+    // see updateReportExpected()
+    bool isReportLikely = true;
+
+    #if (CompressedBacklog)
+    TopicID seriesTopic;
+    BMP280SeriesBlock series = { };
+    #endif
+
+
+    /*
+     * Judged on the samples so far (or the last values sent, before
+     * there are any) and assuming the trend stays as it is - a guess,
+     * but it stops a sensor whose reports are being suppressed from
+     * keeping the MQTT session held open (see Telemetry.h). Worked out
+     * when a sample is added rather than on every pass of the loop, as
+     * it needs the sea-level pressure.
+     */
+    void updateReportExpected() {
+
+      int32_t temperature_x100 = temperatureDeadband.lastValue;
+      int32_t seaLevelPascals_x256 = pressureDeadband.lastValue;
+
+      if (temperatureSamples.count() > 0 && pressureSamples.count() > 0) {
+        temperature_x100 = temperatureSamples.mean();
+        seaLevelPascals_x256 = equivalentPressureAtSeaLevel(pressureSamples.mean(),temperatureSamples.mean());
+      }
+
+      isReportLikely =
+        deadbandWouldReport(
+          temperatureDeadband,
+          temperature_x100,
+          0,
+          SensorTemperatureDeadband_x100,
+          SensorHeartbeatReports
+        ) ||
+        deadbandWouldReport(
+          pressureDeadband,
+          seaLevelPascals_x256,
+          pressureDeadband.lastCategory,
+          SensorPressureDeadband_x256,
+          SensorHeartbeatReports
+        );
+
+    }
+
+
+    void publishTemperature() {
+
+      const SampleStatistics & celsius_x100 = temperatureSamples;
+
+      // reserve space at the tail of the queue
+      size_t capacity = 0;
+      char * payload = try_to_reserve(capacity);
+
+      // when it was captured (0 until the clock has been set)
+      uint32_t captured_s = epochNow_s();
+
+      // both to one decimal place (tenths of a degree)
+      int32_t celsius_x10 = roundedQuotient(celsius_x100.mean(),10);
+      int32_t fahrenheit_x10 = 320 + roundedQuotient(celsius_x100.mean() * 9,50);
+    
+      // construct payload in place
+      #if (CBORPayloads)
+      CBORWriter cbor(payload,capacity);
+      cbor.map(6 + (captured_s ? 1 : 0));
+      if (captured_s) { cbor.key(CBORTimeKey); cbor.epochTime(captured_s); }
+      cbor.key(CBORCelsiusKey);           cbor.decimal(celsius_x10,1);
+      cbor.key(CBORFahrenheitKey);        cbor.decimal(fahrenheit_x10,1);
+      cbor.key(CBORMinimumCelsiusKey);    cbor.decimal(celsius_x100.minimum(),2);
+      cbor.key(CBORMaximumCelsiusKey);    cbor.decimal(celsius_x100.maximum(),2);
+      cbor.key(CBORDeviationCelsiusKey);  cbor.decimal(celsius_x100.standardDeviation(),2);
+      cbor.key(CBORTemperatureSamplesKey); cbor.unsignedInteger(celsius_x100.count());
+      size_t payloadLength = cbor.length();
+      #else
+      JSONWriter json(payload,capacity);
+      json.beginObject();
+      if (captured_s) { json.key(PayloadTimeKey); json.unsignedInteger(captured_s); }
+      json.key(PayloadCelsiusKey);          json.decimal(celsius_x10,1);
+      json.key(PayloadFahrenheitKey);       json.decimal(fahrenheit_x10,1);
+      json.key(PayloadMinimumCelsiusKey);   json.decimal(celsius_x100.minimum(),2);
+      json.key(PayloadMaximumCelsiusKey);   json.decimal(celsius_x100.maximum(),2);
+      json.key(PayloadDeviationCelsiusKey); json.decimal(celsius_x100.standardDeviation(),2);
+      json.key(PayloadSamplesKey);          json.unsignedInteger(celsius_x100.count());
+      json.endObject();
+      size_t payloadLength = json.length();
+      #endif
+
+      // publish the temperature payload
+      try_to_enqueue(__func__,temperatureTopic,payloadLength);
+
+    }
+
+
+    void publishPressure(
+      uint32_t seaLevelPascals_x256,
+      const char * trend
+    ) {
+
+      const SampleStatistics & localPascals_x256 = pressureSamples;
+
+      // reserve space at the tail of the queue
+      size_t capacity = 0;
+      char * payload = try_to_reserve(capacity);
+
+      // when it was captured (0 until the clock has been set)
+      uint32_t captured_s = epochNow_s();
+
+      // construct payload in place
+      #if (CBORPayloads)
+      CBORWriter cbor(payload,capacity);
+      cbor.map(7 + (captured_s ? 1 : 0));
+      if (captured_s) { cbor.key(CBORTimeKey); cbor.epochTime(captured_s); }
+      cbor.key(CBORLocalPressureKey);     cbor.decimal(wholePascals(localPascals_x256.mean()),2);
+      cbor.key(CBORSeaLevelPressureKey);  cbor.decimal(wholePascals(seaLevelPascals_x256),2);
+      cbor.key(CBORTrendKey);             cbor.integer(trendCode(trend));
+      cbor.key(CBORMinimumPressureKey);   cbor.decimal(wholePascals(localPascals_x256.minimum()),2);
+      cbor.key(CBORMaximumPressureKey);   cbor.decimal(wholePascals(localPascals_x256.maximum()),2);
+      cbor.key(CBORDeviationPressureKey); cbor.decimal(wholePascals(localPascals_x256.standardDeviation()),2);
+      cbor.key(CBORPressureSamplesKey);   cbor.unsignedInteger(localPascals_x256.count());
+      size_t payloadLength = cbor.length();
+      #else
+      JSONWriter json(payload,capacity);
+      json.beginObject();
+      if (captured_s) { json.key(PayloadTimeKey); json.unsignedInteger(captured_s); }
+      json.key(PayloadLocalPressureKey);      json.decimal(wholePascals(localPascals_x256.mean()),2);
+      json.key(PayloadSeaLevelPressureKey);   json.decimal(wholePascals(seaLevelPascals_x256),2);
+      json.key(PayloadTrendKey);              json.literal(trend);
+      json.key(PayloadMinimumPressureKey);    json.decimal(wholePascals(localPascals_x256.minimum()),2);
+      json.key(PayloadMaximumPressureKey);    json.decimal(wholePascals(localPascals_x256.maximum()),2);
+      json.key(PayloadDeviationPressureKey);  json.decimal(wholePascals(localPascals_x256.standardDeviation()),2);
+      json.key(PayloadSamplesKey);            json.unsignedInteger(localPascals_x256.count());
+      json.endObject();
+      size_t payloadLength = json.length();
+      #endif
+
+      // publish the pressure payload
+      try_to_enqueue(__func__,pressureTopic,payloadLength);
+
+    }
+
+
+    #if (CompressedBacklog)
+
+    // a block keeps the timebase it started with
+    uint8_t seriesTimebase() {
+
+      if (series.count() > 0) { return series.timebase(); }
+
+      return epochNow_s() ? SeriesTimebaseUnix : SeriesTimebaseDevice;
+
+    }
+
+
+    void holdSeriesReading(
+      int32_t celsius_x100,
+      uint32_t localPascals_x256,
+      uint32_t seaLevelPascals_x256,
+      const char * trend
+    ) {
+
+      int32_t values[SeriesChannels] = {
+        celsius_x100,
+        wholePascals(localPascals_x256),
+        wholePascals(seaLevelPascals_x256),
+        trendCode(trend)
+      };
+
+      uint8_t timebase = seriesTimebase();
+
+      // sense block full - queue it and start another (perhaps on the wall clock)
+      if (!series.add(seriesTime_s(timebase),values,timebase)) {
+
+        publishBacklog();
+
+        timebase = seriesTimebase();
+
+        series.add(seriesTime_s(timebase),values,timebase);
+
+      }
+
+      #if (SerialDebugging)
+      Serial.printf(
+        "%s() - broker unreachable, %s has %u readings held (%u bytes)\n",
+        __func__,
+        deviceKey,
+        series.count(),
+        series.length()
+      );
+      #endif
+
+    }
+
+    #endif
+
+};
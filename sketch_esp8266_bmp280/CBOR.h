@@ -0,0 +1,169 @@
+#pragma once
+
+/*
+ *
+ *  Minimal CBOR (RFC 8949) encoder
+ *
+ *  Used when CBORPayloads is true (see Defines.h). Writes directly into
+ *  caller-provided storage (normally space reserved in the telemetry
+ *  queue) and never allocates.
+ *
+ *  Only what the sketch needs is implemented:
+ *
+ *  - definite-length maps with small unsigned integer keys;
+ *  - unsigned and signed integers;
+ *  - text strings;
+ *  - decimal fractions (tag 4), which is how fixed-point values are
+ *    sent. A decimal fraction is a two-element array of a base-10
+ *    exponent and an integer mantissa, so 22.3 with one decimal place
+ *    is encoded as 4([-1, 223]). Standard CBOR decoders (eg Python's
+ *    cbor2, Node-RED's cbor node) turn that back into a number with no
+ *    special handling.
+ *
+ *  If the storage runs out, the writer stops writing and length()
+ *  returns the full capacity so that try_to_enqueue() rejects the
+ *  payload rather than queueing a truncated one.
+ *
+ */
+
+
+// CBOR major types (RFC 8949 section 3.1)
+const uint8_t   CBORUnsigned                = 0 << 5;
+const uint8_t   CBORNegative                = 1 << 5;
+const uint8_t   CBORBytes                   = 2 << 5;
+const uint8_t   CBORText                    = 3 << 5;
+const uint8_t   CBORArray                   = 4 << 5;
+const uint8_t   CBORMap                     = 5 << 5;
+const uint8_t   CBORTag                     = 6 << 5;
+
+const uint8_t   CBOREpochTimeTag            = 1;
+const uint8_t   CBORDecimalFractionTag      = 4;
+
+// indefinite-length array start and "break" (used by MQTTBatchMode)
+const uint8_t   CBORIndefiniteArray         = CBORArray | 31;
+const uint8_t   CBORBreak                   = 0xFF;
+
+
+class CBORWriter {
+
+  public:
+
+    CBORWriter(char * storage, size_t capacity) :
+      buffer((uint8_t *)storage), capacity(capacity) { }
+
+
+    size_t length() { return overflowed ? capacity : used; }
+
+
+    void map(size_t pairs) { head(CBORMap,pairs); }
+
+
+    void key(uint8_t key) { head(CBORUnsigned,key); }
+
+
+    // counts, times and the like, which can use all 32 bits
+    void unsignedInteger(uint32_t value) { head(CBORUnsigned,value); }
+
+
+    void integer(int32_t value) {
+
+      if (value < 0) {
+        head(CBORNegative,(uint32_t)(-1 - value));
+      } else {
+        head(CBORUnsigned,(uint32_t)value);
+      }
+
+    }
+
+
+    void text(const char * value) {
+
+      size_t length = strlen(value);
+
+      head(CBORText,length);
+      bytes((const uint8_t *)value,length);
+
+    }
+
+
+    // seconds since 1970-01-01T00:00Z
+    void epochTime(uint32_t seconds) {
+
+      head(CBORTag,CBOREpochTimeTag);
+      head(CBORUnsigned,seconds);
+
+    }
+
+
+    void byteString(const uint8_t * data, size_t length) {
+
+      head(CBORBytes,length);
+      bytes(data,length);
+
+    }
+
+
+    // scaled × 10^-places as a decimal fraction - no floating point
+    void decimal(int32_t scaled, uint8_t places) {
+
+      head(CBORTag,CBORDecimalFractionTag);
+      head(CBORArray,2);
+      integer(-(int32_t)places);
+      integer(scaled);
+
+    }
+
+
+  private:
+
+    uint8_t * buffer;
+    size_t capacity;
+    size_t used = 0;
+    bool overflowed = false;
+
+
+    void bytes(const uint8_t * data, size_t length) {
+
+      if (overflowed || used + length > capacity) {
+        overflowed = true;
+        return;
+      }
+
+      memcpy(buffer + used,data,length);
+      used += length;
+
+    }
+
+
+    // initial byte plus argument, in the shortest form
+    void head(uint8_t major, uint32_t argument) {
+
+      uint8_t encoded[5];
+      size_t length;
+
+      if (argument < 24) {
+        encoded[0] = major | argument;
+        length = 1;
+      } else if (argument <= 0xFF) {
+        encoded[0] = major | 24;
+        encoded[1] = argument;
+        length = 2;
+      } else if (argument <= 0xFFFF) {
+        encoded[0] = major | 25;
+        encoded[1] = argument >> 8;
+        encoded[2] = argument;
+        length = 3;
+      } else {
+        encoded[0] = major | 26;
+        encoded[1] = argument >> 24;
+        encoded[2] = argument >> 16;
+        encoded[3] = argument >> 8;
+        encoded[4] = argument;
+        length = 5;
+      }
+
+      bytes(encoded,length);
+
+    }
+
+};
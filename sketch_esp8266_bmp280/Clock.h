@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+ *
+ *  Wall clock
+ *
+ *  Telemetry can sit in the queue (or the spill log) for minutes or
+ *  hours before it is sent, so each payload carries the time it was
+ *  captured rather than leaving the broker or database to stamp it
+ *  on arrival.
+ *
+ *  Once WiFi and OTA are up, clock_begin() starts the SDK's SNTP
+ *  client, which resynchronises every hour. Each synchronisation pins
+ *  the Unix time to a value of millis(), so epochNow_s() is just a
+ *  subtraction and a division rather than a trip through the C
+ *  library's time functions.
+ *
+ *  The mapping is carried across deep sleeps and deliberate reboots,
+ *  advanced by the time spent asleep (see Restart.h), so reports made
+ *  before SNTP next answers are still stamped. After a power-up there
+ *  is nothing to go on until the first synchronisation, epochNow_s()
+ *  returns 0 and payloads leave the time out.
+ *
+ *  deviceClock_s() is a second clock which needs no SNTP: seconds
+ *  since power-up, carried across deep sleeps and deliberate reboots
+ *  in the same way. It times anything which has to survive a restart
+ *  but can't wait for the wall clock - readings held back in a series
+ *  block (see Series.h) and the age of a cached DHCP lease (see
+ *  Comms.h).
+ *
+ */
+
+
+// the capture time (Unix seconds) - CBOR key 0 is unused by every payload
+const char *    PayloadTimeKey              = "\"time\"";
+const uint8_t   CBORTimeKey                 = 0;
+
+// anything earlier means the C library clock has not been set
+const time_t    ClockValidFrom_s            = 1577836800;     // 2020-01-01
+
+bool isClockStarted = false;
+
+// Unix time ...
+uint32_t clockEpoch_s = 0;
+
+// ... at this value of millis()
+unsigned long clockMillis = 0;
+
+
+// called by the SDK whenever SNTP sets the time
+void clockSynchronised() {
+
+  timeval now;
+  gettimeofday(&now,nullptr);
+
+  if (now.tv_sec < ClockValidFrom_s) { return; }
+
+  // back-date millis() to the start of the current second
+  clockMillis = millis() - now.tv_usec / 1000;
+  clockEpoch_s = now.tv_sec;
+
+  #if (SerialDebugging)
+  Serial.printf("%s() - Unix time %lu\n",__func__,(unsigned long)clockEpoch_s);
+  #endif
+
+}
+
+
+void clock_begin() {
+
+  if (isClockStarted) { return; }
+
+  settimeofday_cb(clockSynchronised);
+
+  // UTC - payloads carry Unix time, subscribers localise it
+  configTime(0,0,NTPServer);
+
+  isClockStarted = true;
+
+}
+
+
+// Unix time now, or 0 if the clock has never been synchronised
+uint32_t epochNow_s() {
+
+  if (clockEpoch_s == 0) { return 0; }
+
+  return clockEpoch_s + (millis() - clockMillis) / 1000;
+
+}
+
+
+// deviceClock_s() at millis() == 0
+uint32_t deviceClockOffset_s = 0;
+
+uint32_t deviceClock_s() { return deviceClockOffset_s + millis() / 1000; }
+
+
+// resume after a warm restart (see Restart.h)
+void deviceClockRestore(uint32_t device_s) {
+
+  deviceClockOffset_s = device_s - millis() / 1000;
+
+}
+
+
+// resume after a warm restart (see Restart.h)
+void clockRestore(uint32_t epoch_s) {
+
+  clockEpoch_s = epoch_s;
+  clockMillis = millis();
+
+}
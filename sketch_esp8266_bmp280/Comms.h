@@ -9,7 +9,8 @@ typedef enum {
   WiFiIdleState,
   WifiStartState,
   WiFiWaitConnectState,
-  WiFiStartOTAState
+  WiFiStartOTAState,
+  WiFiBackoffState
     
 } WiFi_State;
 
@@ -27,6 +28,60 @@ bool isOTAServiceAvailable = false;
 AsyncDelay wifi_startup_timer;
 const unsigned long WiFi_startup_timeout_ms = 30*1000;
 
+/*
+ * Fast reconnect
+ *
+ * A full WiFi.begin() scans every channel for the access point and
+ * then waits for DHCP, which keeps the radio on for several seconds.
+ * After each successful connection the access point's BSSID and
+ * channel and the DHCP lease are cached (and carried across reboots
+ * and deep sleeps in the warm restart snapshot - see Restart.h). The
+ * next connection goes straight to that access point on that channel
+ * and reuses the lease, skipping both the scan and DHCP.
+ *
+ * If a fast connect has not succeeded within WiFi_fast_connect_timeout_ms
+ * the cache is discarded and a full connect is made instead. A cached
+ * lease is only reused until it is WiFi_lease_reuse_limit_s old, then
+ * DHCP is asked again (so the lease is renewed well before the server
+ * can expire it). Its age is measured on the device clock (see
+ * Clock.h), which carries on across deep sleeps and reboots. If a
+ * static IP profile is configured in Defines.h, DHCP is never used.
+ */
+const unsigned long WiFi_fast_connect_timeout_ms = 5*1000;
+const uint32_t WiFi_lease_reuse_limit_s = 60*60;
+
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t channel;                            // zero if nothing cached
+  uint32_t leaseObtained_s;                   // deviceClock_s() when the lease came from DHCP
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t mask;
+  uint32_t dns;
+} WiFiCache;
+
+WiFiCache wifiCache = { };
+
+// time to WL_CONNECTED (smoothed) for each kind of connect
+typedef struct {
+  uint32_t lastConnect_ms;
+  uint32_t fastConnect_ms;
+  uint32_t fullConnect_ms;
+  uint32_t fastCount;
+  uint32_t fullCount;
+  uint32_t fallbackCount;                     // fast connects which timed out
+} WiFiConnectStats;
+
+WiFiConnectStats wifiConnectStats = { };
+
+// what to do when a full connect fails (see Recovery.h)
+RecoveryLadder wifiRecovery(RecoveryNetworkFault);
+
+// the attempt in progress
+bool isWiFiFastConnect = false;
+bool isWiFiLeaseReused = false;
+unsigned long wifiConnectStart_ms = 0;
+
 
 void setHostIDforDHCP (const char * hostid, bool force = false) {
 
@@ -104,17 +159,53 @@ void do_wifiStartState() {
   // do not save any WiFi information
   WiFi.persistent(false);
 
-  // off mode (in theory this is no longer needed)
-  WiFi.mode(WIFI_OFF);
+  // is there an access point to go straight to?
+  isWiFiFastConnect = (wifiCache.channel != 0);
+
+  // off mode (in theory this is no longer needed) - not worth the time when fast connecting
+  if (!isWiFiFastConnect) { WiFi.mode(WIFI_OFF); }
 
   // set connection mode (as a station)
   WiFi.mode(WIFI_STA);
 
+  // let the radio and CPU sleep between beacons while the sketch is idle
+  WiFi.setSleepMode(SchedulerWiFiSleepMode);
+
+  // addressing: static profile, cached lease or DHCP
+  isWiFiLeaseReused =
+    !WIFI_StaticIP.isSet() &&
+    isWiFiFastConnect &&
+    (wifiCache.ip != 0) &&
+    (deviceClock_s() - wifiCache.leaseObtained_s < WiFi_lease_reuse_limit_s);
+
+  if (WIFI_StaticIP.isSet()) {
+    WiFi.config(WIFI_StaticIP,WIFI_StaticGateway,WIFI_StaticSubnet,WIFI_StaticDNS);
+  } else if (isWiFiLeaseReused) {
+    WiFi.config(IPAddress(wifiCache.ip),IPAddress(wifiCache.gateway),IPAddress(wifiCache.mask),IPAddress(wifiCache.dns));
+  } else {
+    WiFi.config(IPAddress(),IPAddress(),IPAddress());
+  }
+
   // start the connection process
-  WiFi.begin(WIFI_SSID,WIFI_PSK);
+  wifiConnectStart_ms = millis();
+
+  if (isWiFiFastConnect) {
+
+    #if (SerialDebugging)
+    Serial.printf("fast connect on channel %u\n",wifiCache.channel);
+    #endif
+
+    WiFi.begin(WIFI_SSID,WIFI_PSK,wifiCache.channel,wifiCache.bssid);
+
+    wifi_startup_timer.start(WiFi_fast_connect_timeout_ms, AsyncDelay::MILLIS);
+
+  } else {
 
-  // initialise a wait timer
-  wifi_startup_timer.start(WiFi_startup_timeout_ms, AsyncDelay::MILLIS);
+    WiFi.begin(WIFI_SSID,WIFI_PSK);
+
+    wifi_startup_timer.start(WiFi_startup_timeout_ms, AsyncDelay::MILLIS);
+
+  }
 
   // wait for WiFi to come up
   wifiState = WiFiWaitConnectState;
@@ -126,14 +217,49 @@ void do_wifiStartState() {
 }
     
 
+void recordWiFiConnection() {
+
+  uint32_t elapsed = millis() - wifiConnectStart_ms;
+
+  // smoothed (7/8 old + 1/8 new) once seeded by the first sample
+  uint32_t & average = (isWiFiFastConnect ? wifiConnectStats.fastConnect_ms : wifiConnectStats.fullConnect_ms);
+  average = (average == 0) ? elapsed : (average * 7 + elapsed) / 8;
+
+  wifiConnectStats.lastConnect_ms = elapsed;
+
+  if (isWiFiFastConnect) {
+    wifiConnectStats.fastCount++;
+  } else {
+    wifiConnectStats.fullCount++;
+  }
+
+  // a lease obtained from DHCP starts a new reuse period
+  if (!isWiFiLeaseReused) { wifiCache.leaseObtained_s = deviceClock_s(); }
+
+  // remember where we are for next time
+  memcpy(wifiCache.bssid,WiFi.BSSID(),sizeof(wifiCache.bssid));
+  wifiCache.channel = WiFi.channel();
+  wifiCache.ip = WiFi.localIP();
+  wifiCache.gateway = WiFi.gatewayIP();
+  wifiCache.mask = WiFi.subnetMask();
+  wifiCache.dns = WiFi.dnsIP();
+
+}
+
+
 void do_wifiWaitConnectState() {
 
   // has WiFi become available?
   if (WiFi.status() == WL_CONNECTED) {
 
+    recordWiFiConnection();
+
+    wifiRecovery.succeeded();
+
     #if (SerialDebugging)
     Serial.print("WiFi connected using ");
-    Serial.println(WiFi.localIP());
+    Serial.print(WiFi.localIP());
+    Serial.printf(" after %lu ms (%s)\n",wifiConnectStats.lastConnect_ms,(isWiFiFastConnect ? "fast" : "full"));
     #endif
 
     setHostIDforDHCP(WIFI_DHCP_ClientID,true);
@@ -148,12 +274,35 @@ void do_wifiWaitConnectState() {
   // not connected. Has the timeout expired?
   if (wifi_startup_timer.isExpired()) {
 
+    // sense fast connect failed - forget the cache and do it the long way
+    if (isWiFiFastConnect) {
+
+      #if (SerialDebugging)
+      Serial.println("WiFi fast connect timeout expired, falling back to a full connect");
+      #endif
+
+      wifiCache = { };
+      wifiConnectStats.fallbackCount++;
+
+      WiFi.disconnect();
+
+      wifiState = WifiStartState;
+
+      return;
+
+    }
+
     #if (SerialDebugging)
     Serial.println("WiFi connection timeout expired");
     #endif
-        
-    // yes! nothing else we can do
-    fatalError(wiFiStartError,__func__);
+
+    // back off (and maybe reset the WiFi stack) before trying again
+    if (wifiRecovery.escalate(wiFiStartError,__func__) == RecoveryReset) {
+      WiFi.disconnect(true);
+      WiFi.mode(WIFI_OFF);
+    }
+
+    wifiState = WiFiBackoffState;
           
   }
     
@@ -210,6 +359,9 @@ void do_wifiStartOTAState() {
 
   }
 
+  // set the clock (once - SNTP then keeps it in step)
+  clock_begin();
+
   // move to next state
   wifiState = WiFiIdleState;
 
@@ -220,10 +372,15 @@ void do_wifiStartOTAState() {
 }
 
 
-void wifi_handle() {
+void do_wifiBackoffState() {
 
-  // give WiFi some guaranteed time
-  delay(1);
+  // try again once the backoff has run its course
+  if (!wifiRecovery.isBackingOff()) { wifiState = WifiStartState; }
+
+}
+
+
+void wifi_handle() {
 
   // service OTA if it is running
   if (isOTAServiceAvailable) { ArduinoOTA.handle(); }
@@ -235,6 +392,7 @@ void wifi_handle() {
     case WifiStartState:                do_wifiStartState();                break;
     case WiFiWaitConnectState:          do_wifiWaitConnectState();          break;
     case WiFiStartOTAState:             do_wifiStartOTAState();             break; 
+    case WiFiBackoffState:              do_wifiBackoffState();              break;
 
     default: // WiFiIdleState
 
@@ -243,4 +401,14 @@ void wifi_handle() {
 
   }
 
+  // when to come back (idle needs nothing beyond the scheduler's maximum sleep)
+  switch (wifiState) {
+
+    case WiFiIdleState:                                                     break;
+    case WiFiWaitConnectState:          scheduleWithin(SchedulerPoll_ms);   break;
+    case WiFiBackoffState:              scheduleTimer(wifiRecovery.backoffTimer()); break;
+    default:                            scheduleWithin(0);
+
+  }
+
 }
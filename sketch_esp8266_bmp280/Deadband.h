@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ *
+ *  Report by exception
+ *
+ *  Each report used to be queued (and so cost a connect, publish,
+ *  disconnect cycle) even when nothing had changed. Now a report is
+ *  only queued when:
+ *
+ *  - its value has moved by at least the deadband since the value
+ *    last sent;
+ *  - its category (eg the pressure trend) has changed; or
+ *  - heartbeat reports in a row would otherwise have been suppressed,
+ *    so subscribers can tell a quiet sensor from a dead one.
+ *
+ *  The first report is always sent. A deadband of 0 sends everything.
+ *
+ *  The state is a plain struct so it can be carried across deep sleep
+ *  and deliberate reboots (see Restart.h). suppressedCount is reported
+ *  with the status report (see Status.h).
+ *
+ */
+
+
+typedef struct {
+  int32_t lastValue;            // last value sent
+  uint8_t lastCategory;         // ... and its category
+  uint8_t hasReported;          // 0 until the first report is sent
+  uint16_t silentReports;       // suppressed since the last one sent
+  uint32_t suppressedCount;     // suppressed in total
+} DeadbandState;
+
+
+/*
+ * Would a report of value be sent? The same test as
+ * deadbandShouldReport() but without changing anything, so a sensor
+ * can tell whether its next report is likely to be queued.
+ */
+bool deadbandWouldReport(
+  const DeadbandState & state,
+  int32_t value,
+  uint8_t category,
+  uint32_t deadband,
+  uint16_t heartbeat
+) {
+
+  uint32_t movement = (value < state.lastValue) ?
+    (uint32_t)state.lastValue - (uint32_t)value :
+    (uint32_t)value - (uint32_t)state.lastValue;
+
+  return
+    !state.hasReported ||
+    (movement >= deadband) ||
+    (category != state.lastCategory) ||
+    (state.silentReports + 1 >= heartbeat);
+
+}
+
+
+bool deadbandShouldReport(
+  DeadbandState & state,
+  int32_t value,
+  uint8_t category,
+  uint32_t deadband,
+  uint16_t heartbeat
+) {
+
+  bool isReportable = deadbandWouldReport(state,value,category,deadband,heartbeat);
+
+  if (isReportable) {
+
+    state.lastValue = value;
+    state.lastCategory = category;
+    state.hasReported = 1;
+    state.silentReports = 0;
+
+  } else {
+
+    state.silentReports++;
+    state.suppressedCount++;
+
+  }
+
+  return isReportable;
+
+}
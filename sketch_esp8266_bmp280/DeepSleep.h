@@ -0,0 +1,153 @@
+#pragma once
+
+/*
+ *
+ *  Duty-cycled deep sleep (see DeepSleepMode in Defines.h)
+ *
+ *  Rather than staying awake and polling between readings, each wake
+ *  is one cycle:
+ *
+ *  1. setup() restores the warm restart snapshot (pressure history,
+ *     cycle count and any unsent telemetry - see Restart.h) and queues
+ *     a report of how long the previous cycle was awake;
+ *  2. each sensor takes SensorSamplesPerReport forced-mode samples back
+ *     to back and queues their summary, whether or not WiFi is up;
+ *  3. WiFi and MQTT stay up just long enough to send the queue plus,
+ *     on every DeepSleepStatusEvery-th cycle, a status report;
+ *  4. loop() calls deepSleepUntilNextCycle() which saves the snapshot
+ *     and sleeps for the rest of sensorScanTime_ms.
+ *
+ *  A wake never lasts longer than DeepSleepMaxAwake_ms. If WiFi, the
+ *  broker or a sensor is out, the cycle is cut short there: whatever
+ *  is still queued goes into the snapshot (or the spill log - see
+ *  Restart.h) and the board sleeps anyway, so an outage costs one
+ *  short wake per reading rather than keeping the radio on until it
+ *  ends.
+ *
+ *  Waking depends on D0 (GPIO16) being jumpered to RST, the same as
+ *  reboot().
+ *
+ */
+
+
+// cycles between status reports (1 = every wake) - with the sensor heartbeat, as
+// each wake costs a WiFi connection and status would outweigh the readings
+const uint32_t DeepSleepStatusEvery = SensorHeartbeatReports;
+
+// never sleep for less than this, even if a cycle overran
+const unsigned long DeepSleepMinimum_ms = 1000;
+
+// give up on the rest of a cycle after this long awake (a healthy one takes a few seconds)
+const unsigned long DeepSleepMaxAwake_ms = 30*1000;
+
+static_assert(DeepSleepMaxAwake_ms + DeepSleepMinimum_ms < sensorScanTime_ms,"DeepSleepMaxAwake_ms leaves no time to sleep");
+
+// carried across sleeps in the warm restart snapshot
+uint32_t deepSleepCycleCount = 0;
+uint32_t deepSleepLastAwake_ms = 0;
+
+
+#if (DeepSleepMode)
+
+// topic components
+constexpr const char * TopicDeepSleepKey     = "sleep";
+
+static_assert(topicLength(TopicDeepSleepKey) <= MaxTopicLength,"sleep topic too long");
+
+const TopicID   TopicDeepSleepID            = registerTopic(TopicDeepSleepKey);
+
+// payload components
+const char *    PayloadCycleKey             = "\"cycle\"";
+const char *    PayloadAwakeKey             = "\"awake_ms\"";
+
+// CBOR map keys (when CBORPayloads is true)
+const uint8_t   CBORCycleKey                = 1;
+const uint8_t   CBORAwakeKey                = 2;
+
+
+bool deepSleepStatusDue() {
+
+  return (deepSleepCycleCount % DeepSleepStatusEvery) == 0;
+
+}
+
+
+// this wake has run out of time, done or not
+bool deepSleepIsOverdue() {
+
+  return millis() >= DeepSleepMaxAwake_ms;
+
+}
+
+
+/*
+ * How long the previous cycle was awake (from setup() to going back
+ * to sleep, as measured by millis()). Called from setup().
+ */
+void publish_deep_sleep_cycle() {
+
+  // sense first cycle after power-up - nothing to report
+  if (deepSleepLastAwake_ms == 0) { return; }
+
+  // reserve space at the tail of the queue
+  size_t capacity = 0;
+  char * payload = try_to_reserve(capacity);
+
+  // when it was captured (0 until the clock has been set)
+  uint32_t captured_s = epochNow_s();
+
+  // construct the payload in place
+  #if (CBORPayloads)
+  CBORWriter cbor(payload,capacity);
+  cbor.map(2 + (captured_s ? 1 : 0));
+  if (captured_s) { cbor.key(CBORTimeKey); cbor.epochTime(captured_s); }
+  cbor.key(CBORCycleKey);       cbor.unsignedInteger(deepSleepCycleCount - 1);
+  cbor.key(CBORAwakeKey);       cbor.unsignedInteger(deepSleepLastAwake_ms);
+  size_t payloadLength = cbor.length();
+  #else
+  JSONWriter json(payload,capacity);
+  json.beginObject();
+  if (captured_s) { json.key(PayloadTimeKey); json.unsignedInteger(captured_s); }
+  json.key(PayloadCycleKey);    json.unsignedInteger(deepSleepCycleCount - 1);
+  json.key(PayloadAwakeKey);    json.unsignedInteger(deepSleepLastAwake_ms);
+  json.endObject();
+  size_t payloadLength = json.length();
+  #endif
+
+  // push onto the queue and check the result
+  try_to_enqueue(__func__,TopicDeepSleepID,payloadLength);
+
+}
+
+
+void deepSleepUntilNextCycle() {
+
+  unsigned long awake_ms = millis();
+
+  unsigned long sleep_ms =
+    (awake_ms + DeepSleepMinimum_ms < sensorScanTime_ms) ?
+    sensorScanTime_ms - awake_ms :
+    DeepSleepMinimum_ms;
+
+  deepSleepLastAwake_ms = awake_ms;
+  deepSleepCycleCount++;
+
+  #if (SerialDebugging)
+  Serial.printf(
+    "%s() - cycle %u awake for %lu ms, sleeping for %lu ms\n",
+    __func__,
+    deepSleepCycleCount - 1,
+    awake_ms,
+    sleep_ms
+  );
+  #endif
+
+  // carry the trend history and counters across the sleep
+  saveWarmRestartSnapshot(sleep_ms);
+
+  // depends on D0 (GPIO16) being jumpered to RST
+  ESP.deepSleep((uint64_t)sleep_ms * 1000);
+
+}
+
+#endif
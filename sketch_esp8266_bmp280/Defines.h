@@ -5,8 +5,10 @@
 #include <ESP8266WiFi.h>
 #include <ArduinoOTA.h>
 #include <MQTT.h>
-#include <cppQueue.h>
 #include <Wire.h>
+#include <LittleFS.h>
+#include <time.h>
+#include <coredecls.h>
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BMP280.h>
 
@@ -21,6 +23,76 @@
  */
 #define SerialDebugging true
 
+/*
+ * If MQTTBatchMode is true, each pass of a transmission run sends the
+ * oldest queued message together with every other queued message for
+ * the same topic that will fit in one MQTT packet, as a JSON array:
+ *
+ *    [{"temp_C":22.3,"temp_F":72.1},{"temp_C":22.4,"temp_F":72.3}]
+ *
+ * This cuts the number of PUBLISH packets needed to catch up after an
+ * outage but anything subscribing to the topics must be prepared to
+ * receive arrays. Leave false for one message per PUBLISH.
+ */
+#define MQTTBatchMode false
+
+/*
+ * If CBORPayloads is true, payloads are encoded as CBOR (RFC 8949)
+ * maps with small integer keys instead of JSON text, and fractional
+ * values are sent as fixed-point decimal fractions. The key numbers
+ * are listed in BMP280.h and Status.h. Payloads are roughly half the
+ * size but subscribers need a CBOR decoder.
+ */
+#define CBORPayloads false
+
+/*
+ * If MQTTAtLeastOnce is true, telemetry is published with QoS 1 and a
+ * message only leaves the queue once the broker has acknowledged it
+ * (PUBACK). A message which is not acknowledged (eg because the TCP
+ * session dropped) stays at the front of the queue and is resent,
+ * with the same packet ID and the DUP flag set, after reconnecting
+ * with a persistent session. Up to MQTTWindow packets are sent
+ * without waiting for their PUBACKs (see Telemetry.h). If false,
+ * QoS 0 is used and a failed publish is retried after reconnecting
+ * (see Recovery.h), which may deliver it twice.
+ */
+#define MQTTAtLeastOnce false
+
+/*
+ * How many QoS 1 packets (1 to 16) may be awaiting their PUBACK at
+ * once when MQTTAtLeastOnce is true. 1 sends one message per round
+ * trip to the broker.
+ */
+#define MQTTWindow 8
+
+/*
+ * If CompressedBacklog is true, reports made while the MQTT broker is
+ * unreachable are packed into compressed blocks of readings (a few
+ * bytes each, see Series.h) instead of being queued as individual
+ * messages. Each block is published as one message on the
+ * sensor's series topic (eg bmp280/series), once the broker is back or the block is full,
+ * so a much longer outage fits in the queue. Subscribers need to
+ * decode the blocks (see the README).
+ */
+#define CompressedBacklog false
+
+/*
+ * If DeepSleepMode is true, the ESP8266 deep sleeps between readings
+ * instead of staying awake. Each wake takes one report's samples,
+ * connects just long enough to send it (plus any status report that is due)
+ * and goes back to sleep until the next reading (see DeepSleep.h).
+ * Like reboot(), this depends on D0 (GPIO16) being jumpered to RST.
+ * OTA updates are only possible during the brief periods awake.
+ */
+#define DeepSleepMode false
+
+/*
+ * The number of BMP280s on the I2C bus: 1 (at 0x77, SDO high) or 2
+ * (at 0x77 and 0x76). The first publishes to the bmp280 topics and the
+ * second to bmp280_76 (see Sensor.h).
+ */
+#define BMP280Count 1
+
 /*
  * Connection definition for WiFi:
  * 
@@ -32,7 +104,18 @@
  */
 const char *    WIFI_SSID                   = "YourWiFiNetwork";
 const char *    WIFI_PSK                    = "YourWiFiPassword";
-const char *    WIFI_DHCP_ClientID          = "sketch";
+constexpr const char * WIFI_DHCP_ClientID    = "sketch";
+
+/*
+ * Optional static IP profile. Leave WIFI_StaticIP as 0.0.0.0 to use
+ * DHCP. Otherwise, the ESP uses these settings and never asks DHCP
+ * (which saves a little time on every connection). Make sure the
+ * address is outside your DHCP server's pool.
+ */
+const IPAddress WIFI_StaticIP               (0,0,0,0);
+const IPAddress WIFI_StaticGateway          (0,0,0,0);
+const IPAddress WIFI_StaticSubnet           (255,255,255,0);
+const IPAddress WIFI_StaticDNS              (0,0,0,0);
 
 /*
  * Connection definition for Over The Air updating:
@@ -67,17 +150,27 @@ const uint16_t  OTA_Host_Port               = 8266;
  *   two variables:
  *   
  *      «MQTTTopicPrefix»/«MQTTClientID»
+ *
+ *   Both are constexpr so the lengths of the topic strings built from
+ *   them can be checked at compile time (see Topics.h).
  */
 const char *    MQTTHostFQDN_or_IP          = "raspberrypi.local";
 const uint16_t  MQTTHostPort                = 1883;
-const char *    MQTTTopicPrefix             = "home";
-const char *    MQTTClientID                = WIFI_DHCP_ClientID;
+constexpr const char * MQTTTopicPrefix       = "home";
+constexpr const char * MQTTClientID          = WIFI_DHCP_ClientID;
+
+/*
+ * The SNTP server used to set the clock so payloads can carry the
+ * time they were captured (see Clock.h). pool.ntp.org is fine unless
+ * your router or network provides its own.
+ */
+const char *    NTPServer                   = "pool.ntp.org";
 
 /*
 * Your altitude in meters above sea level.
 * You need to determine this value yourself.
 */
-const float LocalHeightAboveSeaLevelInMetres = 338;
+constexpr float LocalHeightAboveSeaLevelInMetres = 338;
 
 // Assumption is that this is a D1 R3 with a button on GPIO0/D3
 #if (ARDUINO_ESP8266_WEMOS_D1MINI)
@@ -88,8 +181,24 @@ const float LocalHeightAboveSeaLevelInMetres = 338;
 
 
 #include "Errors.h"
+#include "Scheduler.h"
+#include "Recovery.h"
+#include "Clock.h"
 #include "Comms.h"
+#include "Topics.h"
+#include "Queue.h"
+#include "Spill.h"
+#include "CBOR.h"
+#include "JSON.h"
 #include "Telemetry.h"
+#include "StudentT.h"
+#include "Statistics.h"
+#include "Deadband.h"
+#include "Series.h"
+#include "SensorTask.h"
+#include "BMP280.h"
 #include "Sensor.h"
+#include "DeepSleep.h"
 #include "Status.h"
+#include "Restart.h"
 
@@ -77,10 +77,20 @@ const char * stringForError(Sensor_Error error) {
 }
 
 
+// defined in Restart.h
+void saveWarmRestartSnapshot(unsigned long sleep_ms);
+
+// how long reboot() sleeps for
+const unsigned long RebootSleep_ms = 1000;
+
+
 void reboot () {
 
+  // carry queued telemetry and trend history across the restart
+  saveWarmRestartSnapshot(RebootSleep_ms);
+
   // depends on D0 (GPIO16) being jumpered to RST 
-  ESP.deepSleep(1E6);
+  ESP.deepSleep(RebootSleep_ms * 1000);
 
 }
 
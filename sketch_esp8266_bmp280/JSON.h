@@ -0,0 +1,194 @@
+#pragma once
+
+/*
+ *
+ *  Minimal streaming JSON writer
+ *
+ *  Builds payloads directly in caller-provided storage (normally space
+ *  reserved in the telemetry queue). It never allocates and never
+ *  writes past the end of the storage.
+ *
+ *  Numbers are formatted without printf. Fixed-point values are
+ *  scaled and rounded to an integer once, then written digit by digit,
+ *  so the ESP8266's large and slow software-float printf code is not
+ *  needed.
+ *
+ *  If the storage runs out, the writer stops writing, isTruncated()
+ *  becomes true and length() returns the full capacity so that
+ *  try_to_enqueue() rejects the payload rather than queueing a
+ *  truncated one. The output is always null-terminated.
+ *
+ */
+
+
+class JSONWriter {
+
+  public:
+
+    JSONWriter(char * storage, size_t capacity) :
+      buffer(storage), capacity(capacity) {
+
+      if (capacity > 0) { buffer[0] = 0; }
+
+    }
+
+
+    bool isTruncated() { return truncated; }
+
+    size_t length() { return truncated ? capacity : used; }
+
+
+    void beginObject() { put('{'); isFirstMember = true; }
+
+    void endObject() { put('}'); }
+
+
+    // keys are passed already quoted (eg PayloadCelsiusKey)
+    void key(const char * quotedKey) {
+
+      if (!isFirstMember) { put(','); }
+      isFirstMember = false;
+
+      literal(quotedKey);
+      put(':');
+
+    }
+
+
+    // pre-formatted JSON (eg PayloadTrendSteadyValue)
+    void literal(const char * json) {
+
+      while (*json) { put(*json++); }
+
+    }
+
+
+    // a string value, quoted and escaped
+    void text(const char * value) {
+
+      put('"');
+
+      for ( ; *value; value++) {
+
+        char c = *value;
+
+        if (c == '"' || c == '\\') {
+          put('\\');
+          put(c);
+        } else if ((uint8_t)c < 0x20) {
+          const char * hex = "0123456789abcdef";
+          literal("\\u00");
+          put(hex[(c >> 4) & 0x0F]);
+          put(hex[c & 0x0F]);
+        } else {
+          put(c);
+        }
+
+      }
+
+      put('"');
+
+    }
+
+
+    // binary data as a quoted base64 (RFC 4648) string
+    void base64(const uint8_t * data, size_t length) {
+
+      const char * alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+      put('"');
+
+      for (size_t i = 0; i < length; i += 3) {
+
+        uint32_t group = (uint32_t)data[i] << 16;
+        if (i + 1 < length) { group |= (uint32_t)data[i+1] << 8; }
+        if (i + 2 < length) { group |= data[i+2]; }
+
+        put(alphabet[(group >> 18) & 0x3F]);
+        put(alphabet[(group >> 12) & 0x3F]);
+        put((i + 1 < length) ? alphabet[(group >> 6) & 0x3F] : '=');
+        put((i + 2 < length) ? alphabet[group & 0x3F] : '=');
+
+      }
+
+      put('"');
+
+    }
+
+
+    void integer(int32_t value) {
+
+      if (value < 0) {
+        put('-');
+        digits(0 - (uint32_t)value,1);
+      } else {
+        digits(value,1);
+      }
+
+    }
+
+
+    void unsignedInteger(uint32_t value) { digits(value,1); }
+
+
+    // scaled × 10^-places (eg 1234,2 is 12.34) - no floating point
+    void decimal(int32_t scaled, uint8_t places) {
+
+      uint32_t scale = 1;
+      for (uint8_t i = 0; i < places; i++) { scale *= 10; }
+
+      uint32_t magnitude = (scaled < 0) ? 0 - (uint32_t)scaled : scaled;
+
+      if (scaled < 0) { put('-'); }
+
+      digits(magnitude / scale,1);
+
+      if (places > 0) {
+        put('.');
+        digits(magnitude % scale,places);
+      }
+
+    }
+
+
+  private:
+
+    char * buffer;
+    size_t capacity;
+    size_t used = 0;
+    bool truncated = false;
+    bool isFirstMember = true;
+
+
+    void put(char c) {
+
+      // always leave room for the terminating null
+      if (truncated || used + 1 >= capacity) {
+        truncated = true;
+        return;
+      }
+
+      buffer[used++] = c;
+      buffer[used] = 0;
+
+    }
+
+
+    // decimal digits of value, zero-padded to at least width
+    void digits(uint32_t value, uint8_t width) {
+
+      char reversed[10];
+      uint8_t count = 0;
+
+      do {
+        reversed[count++] = '0' + (value % 10);
+        value /= 10;
+      } while (value > 0 && count < sizeof(reversed));
+
+      while (count < width) { put('0'); width--; }
+
+      while (count > 0) { put(reversed[--count]); }
+
+    }
+
+};
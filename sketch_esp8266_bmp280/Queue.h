@@ -0,0 +1,336 @@
+#pragma once
+
+/*
+ *
+ *  Telemetry queue
+ *
+ *  Messages waiting to be sent are packed end-to-end into a single
+ *  fixed-size byte arena which is used as a ring buffer. Each message
+ *  occupies one variable-length record:
+ *
+ *      [TelemetryHeader][payload\0]
+ *
+ *  where the header carries the one-byte TopicID (see Topics.h) rather
+ *  than the topic string, so a message only costs as many bytes as its
+ *  payload actually needs. Records are never split across the end of
+ *  the arena. If a record will not fit in the space remaining at the
+ *  end, it is placed at the start and the end of the valid data in the
+ *  upper region is remembered.
+ *
+ *  Producers:
+ *
+ *  1. call reserve() to obtain a pointer into the arena plus the
+ *     number of contiguous bytes available at that pointer;
+ *  2. format the payload directly into that space;
+ *  3. call commit() to make the record visible to the consumer.
+ *
+ *  Consumer:
+ *
+ *  1. call peek() to obtain a view of the oldest record (in place,
+ *     no copying);
+ *  2. transmit;
+ *  3. call release() to discard the record.
+ *
+ *  A consumer which sends several records at once (eg MQTTBatchMode)
+ *  can walk the queue with peekNext(), mark each record it has sent
+ *  with markSent() and then call release(), which discards the oldest
+ *  record plus any sent records immediately behind it. Sent records
+ *  further back are skipped by peekNext() and discarded as soon as
+ *  they reach the front of the queue.
+ *
+ *  A consumer with several packets awaiting acknowledgement (see
+ *  MQTTAtLeastOnce) marks their records RecordInFlight instead, so
+ *  peekNext() passes over them when looking for the next records to
+ *  send but can still find them (by asking for RecordInFlight) to
+ *  resend them, and marks them sent once acknowledged.
+ *
+ */
+
+
+/*
+ * The size of the arena. The old cppQueue arrangement used 10 slots
+ * of 511 bytes (5110 bytes). Typical payloads are under 80 bytes so
+ * this arena holds five times as many messages in less memory.
+ */
+const size_t TelemetryQueueSize_bytes = 4096;
+
+
+/*
+ * The longest payload a record may carry, excluding its terminating
+ * null (the same as the old fixed-size Telemetry.payload). Nothing
+ * longer is queued (see try_to_enqueue() in Telemetry.h), so every
+ * record can also be spilled to flash (see Spill.h).
+ */
+const size_t TelemetryPayloadMax_bytes = 255;
+
+
+// how far a record has got (a single byte, so the header is unchanged from when it was a bool "sent")
+const uint8_t RecordQueued = 0;
+const uint8_t RecordSent = 1;
+const uint8_t RecordInFlight = 2;
+
+
+// the per-record header as it is stored in the arena
+typedef struct {
+  uint16_t payloadLength;     // excluding the terminating null
+  TopicID topic;
+  bool retain;
+  uint8_t progress;           // RecordQueued etc - only meaningful in the RAM queue
+} TelemetryHeader;
+
+
+// a view of a queued message (points into the arena)
+typedef struct {
+  TopicID topic;
+  const char * payload;
+  size_t payloadLength;
+  bool retain;
+} Telemetry;
+
+
+// a position in the queue for peekNext() and mark()
+typedef struct {
+  size_t index;               // records visited so far
+  size_t offset;              // next record to visit
+  size_t current;             // record most recently returned
+} QueueCursor;
+
+
+class TelemetryQueue {
+
+  public:
+
+    bool isEmpty() { return (records == 0); }
+
+    size_t count() { return records; }
+
+    size_t bytesUsed() { return used; }
+
+
+    /*
+     * Return a pointer to the largest contiguous free space in the
+     * arena and set capacity to its size. The pointer is always valid
+     * but capacity may be zero if the arena is full.
+     */
+    char * reserve(size_t & capacity) {
+
+      // an empty arena can always start from the beginning
+      if (records == 0) { head = tail = 0; limit = TelemetryQueueSize_bytes; }
+
+      size_t space = 0;
+
+      if (records == 0 || head > tail) {
+
+        // data (if any) lies in [tail,head) - free space at both ends
+        size_t atEnd = TelemetryQueueSize_bytes - head;
+        size_t atStart = tail;
+
+        if (atEnd >= atStart) {
+          reservedAt = head;
+          space = atEnd;
+        } else {
+          reservedAt = 0;
+          space = atStart;
+        }
+
+      } else {
+
+        // wrapped - data lies in [tail,limit) and [0,head)
+        reservedAt = head;
+        space = tail - head;
+
+      }
+
+      // the header comes out of the same space
+      reservedSpace = (space > sizeof(TelemetryHeader)) ? space - sizeof(TelemetryHeader) : 0;
+
+      capacity = reservedSpace;
+
+      return (char *)(arena + reservedAt + (reservedSpace ? sizeof(TelemetryHeader) : 0));
+
+    }
+
+
+    /*
+     * Make the record most recently formatted into reserved space
+     * visible to the consumer. Returns false (and queues nothing)
+     * if the payload did not fit in the reserved space.
+     */
+    bool commit(TopicID topic, size_t payloadLength, bool retain) {
+
+      size_t body = payloadLength + 1;
+
+      // sense truncation
+      if (body > reservedSpace) { return false; }
+
+      TelemetryHeader header;
+      header.payloadLength = payloadLength;
+      header.topic = topic;
+      header.retain = retain;
+      header.progress = RecordQueued;
+
+      // the arena carries no alignment guarantees
+      memcpy(arena + reservedAt, &header, sizeof(TelemetryHeader));
+
+      // encoders need not terminate their output
+      arena[reservedAt + sizeof(TelemetryHeader) + payloadLength] = 0;
+
+      // did the record start a new lap of the arena?
+      if (reservedAt != head) { limit = head; }
+
+      head = reservedAt + sizeof(TelemetryHeader) + body;
+
+      used += sizeof(TelemetryHeader) + body;
+      records++;
+
+      // the reservation has been consumed
+      reservedSpace = 0;
+
+      return true;
+
+    }
+
+
+    /*
+     * Point telemetry at the oldest record. Returns false if the
+     * queue is empty.
+     */
+    bool peek(Telemetry & telemetry) {
+
+      if (records == 0) { return false; }
+
+      TelemetryHeader header;
+      memcpy(&header, arena + tail, sizeof(TelemetryHeader));
+
+      telemetry.topic = header.topic;
+      telemetry.payload = (const char *)(arena + tail + sizeof(TelemetryHeader));
+      telemetry.payloadLength = header.payloadLength;
+      telemetry.retain = header.retain;
+
+      return true;
+
+    }
+
+
+    /*
+     * Walk the queue from oldest to newest without releasing anything,
+     * returning only records which have got as far as progress (by
+     * default, those not yet sent or in flight). A zero-initialised
+     * cursor starts at the oldest record.
+     */
+    bool peekNext(Telemetry & telemetry, QueueCursor & cursor, uint8_t progress = RecordQueued) {
+
+      if (cursor.index == 0) { cursor.offset = tail; }
+
+      TelemetryHeader header;
+
+      while (cursor.index < records) {
+
+        // sense end of the upper region
+        if (cursor.offset == limit) { cursor.offset = 0; }
+
+        memcpy(&header, arena + cursor.offset, sizeof(TelemetryHeader));
+
+        size_t current = cursor.offset;
+
+        cursor.offset += sizeof(TelemetryHeader) + header.payloadLength + 1;
+        cursor.index++;
+
+        if (header.progress != progress) { continue; }
+
+        cursor.current = current;
+
+        telemetry.topic = header.topic;
+        telemetry.payload = (const char *)(arena + cursor.current + sizeof(TelemetryHeader));
+        telemetry.payloadLength = header.payloadLength;
+        telemetry.retain = header.retain;
+
+        return true;
+
+      }
+
+      return false;
+
+    }
+
+
+    /*
+     * Record how far the record most recently returned by peekNext()
+     * has got.
+     */
+    void mark(const QueueCursor & cursor, uint8_t progress) {
+
+      // a single byte so no alignment concerns
+      arena[cursor.current + offsetof(TelemetryHeader,progress)] = progress;
+
+    }
+
+
+    void markSent(const QueueCursor & cursor) { mark(cursor,RecordSent); }
+
+
+    /*
+     * Discard the oldest record, plus any records behind it that
+     * have already been marked as sent.
+     */
+    void release() {
+
+      TelemetryHeader header;
+
+      do {
+
+        if (records == 0) { return; }
+
+        memcpy(&header, arena + tail, sizeof(TelemetryHeader));
+
+        size_t size = sizeof(TelemetryHeader) + header.payloadLength + 1;
+
+        tail += size;
+        used -= size;
+        records--;
+
+        // sense end of the upper region
+        if (records > 0 && tail == limit) {
+          tail = 0;
+          limit = TelemetryQueueSize_bytes;
+        }
+
+        // look at the new oldest record
+        if (records > 0) { memcpy(&header, arena + tail, sizeof(TelemetryHeader)); }
+
+      } while (records > 0 && header.progress == RecordSent);
+
+    }
+
+
+    /*
+     * Discard whatever has been marked as sent at the front of the
+     * queue (and nothing else).
+     */
+    void releaseSent() {
+
+      TelemetryHeader header;
+
+      if (records == 0) { return; }
+
+      memcpy(&header, arena + tail, sizeof(TelemetryHeader));
+
+      if (header.progress == RecordSent) { release(); }
+
+    }
+
+
+  private:
+
+    uint8_t arena[TelemetryQueueSize_bytes];
+
+    size_t head = 0;                                  // next free byte
+    size_t tail = 0;                                  // oldest record
+    size_t limit = TelemetryQueueSize_bytes;          // end of data in upper region
+    size_t records = 0;
+    size_t used = 0;
+
+    size_t reservedAt = 0;
+    size_t reservedSpace = 0;
+
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+/*
+ *
+ *  Recovery ladder
+ *
+ *  A timeout or failure in WiFi, MQTT or the sensor used to go straight
+ *  to fatalError() and a reboot. Now each of those subsystems has a
+ *  RecoveryLadder and reports each failure to escalate(), which says
+ *  what to do next:
+ *
+ *  1. RecoveryRetry - for the first RecoveryRetryLimit consecutive
+ *     failures, wait out a backoff and try again;
+ *  2. RecoveryReset - after that, reset the subsystem (MQTT client,
+ *     WiFi stack, I2C bus), wait out a backoff and try again. A ladder
+ *     for a network fault only resets every RecoveryResetInterval
+ *     failures and retries in between;
+ *  3. a ladder for a local fault calls fatalError() once the backoff
+ *     has reached RecoveryBackoffMax_ms and the subsystem has still
+ *     failed, and the board reboots (keeping the queue and trend
+ *     history - see Restart.h). A network fault never reboots - an
+ *     access point or broker which is down stays down however often
+ *     the board restarts, so the ladder stays on its top rung.
+ *
+ *  The backoff doubles with each consecutive failure (from
+ *  RecoveryBackoffBase_ms, up to RecoveryBackoffMax_ms) and is
+ *  jittered so devices which lost the same access point or broker at
+ *  the same moment don't all retry in lock step. succeeded() puts a
+ *  ladder back on the bottom rung.
+ *
+ *  Retry and reset counts for each ladder, plus the number of last
+ *  resort reboots, are published with the status report (Status.h).
+ *
+ */
+
+
+const uint8_t       RecoveryRetryLimit          = 3;
+const uint8_t       RecoveryResetInterval       = 4;
+const unsigned long RecoveryBackoffBase_ms      = 1000;
+const unsigned long RecoveryBackoffMax_ms       = 60*1000;
+
+
+// consecutive failures until the backoff reaches RecoveryBackoffMax_ms
+constexpr uint32_t recoveryFailuresToCap(unsigned long backoff_ms = RecoveryBackoffBase_ms) {
+
+  return (backoff_ms >= RecoveryBackoffMax_ms) ? 1 : 1 + recoveryFailuresToCap(backoff_ms * 2);
+
+}
+
+// a local fault reboots after failing once more at the capped backoff
+const uint32_t      RecoveryRebootAfter         = recoveryFailuresToCap();
+
+static_assert(RecoveryRebootAfter > RecoveryRetryLimit,"no reset before a reboot");
+
+
+typedef enum {
+
+  RecoveryRetry,
+  RecoveryReset
+
+} RecoveryTier;
+
+
+// what kind of fault a ladder handles (see above)
+typedef enum {
+
+  RecoveryNetworkFault,         // WiFi, MQTT - never reboots
+  RecoveryLocalFault            // sensor, I2C bus
+
+} RecoveryScope;
+
+
+// last resort reboots (carried across them in the warm restart snapshot)
+uint32_t recoveryRebootCount = 0;
+
+
+class RecoveryLadder {
+
+  public:
+
+    RecoveryLadder(RecoveryScope scope) : scope(scope) { }
+
+
+    /*
+     * Record a failure. Returns the tier the caller should act on,
+     * having started the backoff timer, or does not return at all if
+     * the ladder has run out.
+     */
+    RecoveryTier escalate(Sensor_Error error, const char * caller) {
+
+      failures++;
+
+      // sense out of options
+      if (scope == RecoveryLocalFault && failures > RecoveryRebootAfter) {
+
+        recoveryRebootCount++;
+
+        fatalError(error,caller); // forces restart - no return
+
+      }
+
+      RecoveryTier tier = RecoveryRetry;
+
+      if (failures > RecoveryRetryLimit) {
+
+        bool isResetDue =
+          (scope == RecoveryLocalFault) ||
+          ((failures - RecoveryRetryLimit - 1) % RecoveryResetInterval == 0);
+
+        if (isResetDue) { tier = RecoveryReset; }
+
+      }
+
+      if (tier == RecoveryReset) { resets++; } else { retries++; }
+
+      // exponential, capped, then jittered over its upper half
+      unsigned long backoff_ms = RecoveryBackoffBase_ms;
+      for (uint32_t i = 1; i < failures && backoff_ms < RecoveryBackoffMax_ms; i++) { backoff_ms *= 2; }
+      if (backoff_ms > RecoveryBackoffMax_ms) { backoff_ms = RecoveryBackoffMax_ms; }
+
+      backoff_ms = backoff_ms / 2 + random(backoff_ms / 2 + 1);
+
+      backoff.start(backoff_ms, AsyncDelay::MILLIS);
+
+      #if (SerialDebugging)
+      Serial.printf(
+        "%s() - %s, failure %u - %s after %lu ms\n",
+        caller,
+        stringForError(error),
+        failures,
+        (tier == RecoveryReset ? "reset and retry" : "retry"),
+        backoff_ms
+      );
+      #endif
+
+      return tier;
+
+    }
+
+
+    void succeeded() { failures = 0; }
+
+
+    bool isBackingOff() { return !backoff.isExpired(); }
+
+    AsyncDelay & backoffTimer() { return backoff; }
+
+
+    uint32_t retryCount() { return retries; }
+
+    uint32_t resetCount() { return resets; }
+
+
+  private:
+
+    RecoveryScope scope;
+    AsyncDelay backoff;
+    uint32_t failures = 0;
+    uint32_t retries = 0;
+    uint32_t resets = 0;
+
+};
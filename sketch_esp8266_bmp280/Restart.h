@@ -0,0 +1,310 @@
+#pragma once
+
+/*
+ *
+ *  Warm restart
+ *
+ *  A deliberate reboot (fatalError() or periodicRestartCheck()) goes
+ *  through a timed deep sleep. RTC user memory survives that so,
+ *  just before the sleep, reboot() calls saveWarmRestartSnapshot() to
+ *  write a compact CRC-protected snapshot of:
+ *
+ *  1. each sensor's driver state (see Sensor.h) - for a BMP280, its
+ *     pressure trend history (so the trend analysis does not have to
+ *     spend another hour "training"), the last values reported (see
+ *     Deadband.h) and any readings held back in a series block;
+ *  2. the deep sleep cycle counters (see DeepSleep.h);
+ *  3. the WiFi fast reconnect cache and connection statistics (see
+ *     Comms.h);
+ *  4. the count of last resort reboots (see Recovery.h);
+ *  5. the spill log read position (see Spill.h);
+ *  6. the device clock and the wall clock, advanced by the length of
+ *     the sleep (see Clock.h);
+ *  7. whether the broker was unreachable (CompressedBacklog only - see
+ *     Series.h);
+ *  8. any telemetry still waiting in the RAM queue.
+ *
+ *  deepSleepUntilNextCycle() saves the same snapshot before each sleep
+ *  in DeepSleepMode.
+ *
+ *  setup() calls restoreWarmRestartSnapshot() which puts everything
+ *  back and then invalidates the snapshot so it can only be used once.
+ *  RTC memory is undefined after a power-up but the CRC check rejects
+ *  that.
+ *
+ *  The first 128 bytes of RTC user memory belong to the OTA updater
+ *  (eboot) so the snapshot lives in the remaining 384 bytes. If the
+ *  RAM queue holds more than will fit, the whole queue is moved to
+ *  the spill log instead (which keeps the messages in order). If that
+ *  fails too (eg no file system), the oldest messages go in the
+ *  snapshot and the rest are lost - they are counted in
+ *  telemetryDiscardedCount, which is carried in the snapshot (with
+ *  the records the spill log has dropped) and reported with the MQTT
+ *  status (see Status.h).
+ *
+ */
+
+
+const uint32_t  WarmRestartMagic            = 0x57524D41;     // "WRMA"
+const uint32_t  WarmRestartOffset_blocks    = 32;             // 4-byte blocks (skip eboot)
+const size_t    WarmRestartSize_bytes       = 512 - WarmRestartOffset_blocks * 4;
+
+
+typedef struct {
+  uint32_t magic;
+  uint32_t crc;                               // covers everything after this field
+  uint32_t deepSleepCycleCount;
+  uint32_t deepSleepLastAwake_ms;
+  WiFiCache wifiCache;
+  WiFiConnectStats wifiConnectStats;
+  uint32_t recoveryRebootCount;
+  uint32_t deviceClock_s;
+  uint32_t clockEpoch_s;                      // 0 if never synchronised
+  uint32_t spillSeq;
+  uint32_t spillOffset;
+  uint16_t recordCount;
+  uint16_t recordBytes;
+  uint16_t discardedCount;                    // see telemetryDiscardedCount
+  #if (CompressedBacklog)
+  bool brokerUnreachable;
+  #endif
+  uint8_t sensors[SensorRetained_bytes];      // see saveSensors()
+} WarmRestartHeader;
+
+static_assert(sizeof(WarmRestartHeader) < WarmRestartSize_bytes,"sensor state does not fit the warm restart snapshot");
+
+
+typedef struct {
+  WarmRestartHeader header;
+  uint8_t records[WarmRestartSize_bytes - sizeof(WarmRestartHeader)];
+} WarmRestartSnapshot;
+
+static_assert(sizeof(WarmRestartSnapshot) == WarmRestartSize_bytes,"warm restart snapshot does not fit RTC memory");
+
+
+/*
+ * Queued records name their topics by TopicID, which only means the
+ * same thing under the same topic table (see Topics.h), so the table
+ * is part of what the magic number checks.
+ */
+uint32_t warmRestartMagic() {
+
+  return WarmRestartMagic ^ topicTableSignature();
+
+}
+
+
+uint32_t warmRestartCRC(const WarmRestartSnapshot & snapshot) {
+
+  // CRC-32 (IEEE 802.3) over everything after the crc field
+  const uint8_t * data = (const uint8_t *)&snapshot.header.crc + sizeof(snapshot.header.crc);
+  const uint8_t * end = (const uint8_t *)&snapshot + sizeof(WarmRestartSnapshot);
+
+  uint32_t crc = 0xFFFFFFFF;
+
+  while (data < end) {
+
+    crc ^= *data++;
+
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+
+  }
+
+  return ~crc;
+
+}
+
+
+void saveWarmRestartSnapshot(unsigned long sleep_ms) {
+
+  WarmRestartSnapshot snapshot;
+  memset(&snapshot,0,sizeof(snapshot));
+
+  WarmRestartHeader & header = snapshot.header;
+
+  header.magic = warmRestartMagic();
+
+  // trend histories, deadbands and held back readings
+  saveSensors(header.sensors);
+
+  // deep sleep cycle counters
+  header.deepSleepCycleCount = deepSleepCycleCount;
+  header.deepSleepLastAwake_ms = deepSleepLastAwake_ms;
+
+  // where and how WiFi last connected
+  header.wifiCache = wifiCache;
+  header.wifiConnectStats = wifiConnectStats;
+
+  // last resort reboots
+  header.recoveryRebootCount = recoveryRebootCount;
+
+  #if (CompressedBacklog)
+  header.brokerUnreachable = mqttBrokerUnreachable;
+  #endif
+
+  // the device clock skips the time spent asleep
+  header.deviceClock_s = deviceClock_s() + sleep_ms / 1000;
+
+  // the time on waking
+  uint32_t epoch_s = epochNow_s();
+  header.clockEpoch_s = epoch_s ? epoch_s + sleep_ms / 1000 : 0;
+
+  // if the RAM queue won't fit, move all of it to flash
+  if (mqttQueue.bytesUsed() > sizeof(snapshot.records)) { spill_to_flash(0); }
+
+  // spill log position (after spilling, which only appends)
+  spillLog.cursor(header.spillSeq,header.spillOffset);
+
+  // whatever is left in the RAM queue
+  Telemetry telemetry;
+  TelemetryHeader record = { };
+
+  while (mqttQueue.peek(telemetry)) {
+
+    size_t size = sizeof(TelemetryHeader) + telemetry.payloadLength + 1;
+
+    if (header.recordBytes + size > sizeof(snapshot.records)) { break; }
+
+    record.payloadLength = telemetry.payloadLength;
+    record.topic = telemetry.topic;
+    record.retain = telemetry.retain;
+
+    uint8_t * destination = snapshot.records + header.recordBytes;
+
+    memcpy(destination,&record,sizeof(TelemetryHeader));
+    memcpy(destination + sizeof(TelemetryHeader),telemetry.payload,telemetry.payloadLength + 1);
+
+    header.recordBytes += size;
+    header.recordCount++;
+
+    mqttQueue.release();
+
+  }
+
+  // sense messages which fitted neither the spill log nor the snapshot
+  if (!mqttQueue.isEmpty()) {
+
+    #if (SerialDebugging)
+    Serial.printf("%s() - no room for %u messages, discarding them\n",__func__,(unsigned)mqttQueue.count());
+    #endif
+
+    uint32_t discarded = telemetryDiscardedCount + mqttQueue.count();
+    telemetryDiscardedCount = (discarded < UINT16_MAX) ? discarded : UINT16_MAX;
+
+  }
+
+  // along with any the spill log dropped this boot
+  header.discardedCount = telemetryDiscarded();
+
+  header.crc = warmRestartCRC(snapshot);
+
+  ESP.rtcUserMemoryWrite(WarmRestartOffset_blocks,(uint32_t *)&snapshot,sizeof(snapshot));
+
+  #if (SerialDebugging)
+  Serial.printf(
+    "%s() - %u bytes of sensor state, %u messages (%u bytes)\n",
+    __func__,
+    sizeof(header.sensors),
+    header.recordCount,
+    header.recordBytes
+  );
+  Serial.flush();
+  #endif
+
+}
+
+
+void restoreWarmRestartSnapshot() {
+
+  WarmRestartSnapshot snapshot;
+
+  if (!ESP.rtcUserMemoryRead(WarmRestartOffset_blocks,(uint32_t *)&snapshot,sizeof(snapshot))) { return; }
+
+  WarmRestartHeader & header = snapshot.header;
+
+  bool isValid =
+    (header.magic == warmRestartMagic()) &&
+    (header.crc == warmRestartCRC(snapshot)) &&
+    (header.recordBytes <= sizeof(snapshot.records));
+
+  // a snapshot can only be used once
+  uint32_t invalid = 0;
+  ESP.rtcUserMemoryWrite(WarmRestartOffset_blocks,&invalid,sizeof(invalid));
+
+  if (!isValid) {
+
+    #if (SerialDebugging)
+    Serial.printf("%s() - no warm restart snapshot\n",__func__);
+    #endif
+
+    return;
+
+  }
+
+  // trend histories, deadbands and held back readings
+  restoreSensors(header.sensors);
+
+  // deep sleep cycle counters
+  deepSleepCycleCount = header.deepSleepCycleCount;
+  deepSleepLastAwake_ms = header.deepSleepLastAwake_ms;
+
+  // where and how WiFi last connected
+  wifiCache = header.wifiCache;
+  wifiConnectStats = header.wifiConnectStats;
+
+  // last resort reboots
+  recoveryRebootCount = header.recoveryRebootCount;
+
+  // messages lost at earlier reboots
+  telemetryDiscardedCount = header.discardedCount;
+
+  #if (CompressedBacklog)
+  mqttBrokerUnreachable = header.brokerUnreachable;
+  #endif
+
+  // the device clock, and the time if it was known
+  deviceClockRestore(header.deviceClock_s);
+  if (header.clockEpoch_s) { clockRestore(header.clockEpoch_s); }
+
+  // spill log position
+  spillLog.resume(header.spillSeq,header.spillOffset);
+
+  // pending telemetry
+  size_t offset = 0;
+  TelemetryHeader record;
+
+  for (uint16_t i = 0; i < header.recordCount; i++) {
+
+    if (offset + sizeof(TelemetryHeader) > header.recordBytes) { break; }
+
+    memcpy(&record,snapshot.records + offset,sizeof(TelemetryHeader));
+
+    size_t length = record.payloadLength + 1;
+    size_t size = sizeof(TelemetryHeader) + length;
+
+    if (offset + size > header.recordBytes) { break; }
+
+    size_t capacity = 0;
+    char * payload = mqttQueue.reserve(capacity);
+
+    if (capacity < length) { break; }
+
+    memcpy(payload,snapshot.records + offset + sizeof(TelemetryHeader),length);
+
+    mqttQueue.commit(record.topic,record.payloadLength,record.retain);
+
+    offset += size;
+
+  }
+
+  #if (SerialDebugging)
+  Serial.printf(
+    "%s() - %u messages restored\n",
+    __func__,
+    mqttQueue.count()
+  );
+  #endif
+
+}
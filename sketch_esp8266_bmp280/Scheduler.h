@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+ *
+ *  Tickless cooperative scheduling
+ *
+ *  Rather than each handler calling delay(1) and the event loop
+ *  spinning thousands of times a second, each handler says when it
+ *  next needs to run:
+ *
+ *  - scheduleWithin(ms) - "run me again within ms milliseconds". A
+ *    handler in the middle of something (eg connecting, transmitting)
+ *    asks for 0.
+ *  - scheduleTimer(timer) - "run me again when this AsyncDelay
+ *    expires".
+ *
+ *  At the end of each pass through loop(), scheduler_idle() sleeps
+ *  until the earliest of those deadlines, but never for longer than
+ *  SchedulerMaxSleep_ms so that OTA requests and the MQTT keep-alive
+ *  are still serviced in time. Neither has a deadline of its own, so
+ *  that cap is what an idle sketch wakes for - about 3600 times an
+ *  hour.
+ *
+ *  The sleep is a delay(), during which the ESP8266 core services
+ *  WiFi and, with WiFi in WIFI_LIGHT_SLEEP mode (set by Comms.h), the
+ *  radio and CPU drop into light sleep between access-point beacons.
+ *
+ *  Instrumentation: the proportion of time spent idle and the number
+ *  of passes through loop() (wakeups) are accumulated and reported in
+ *  each status report (see Status.h).
+ *
+ */
+
+
+/*
+ * espota.py waits 10 s for the board to answer an OTA invitation and
+ * arduino-mqtt's keep-alive is 10 s, so a held session needs loop()
+ * well within that. A second leaves plenty in hand for both.
+ */
+const unsigned long SchedulerMaxSleep_ms = 1000;
+
+// applied whenever WiFi is started
+const WiFiSleepType_t SchedulerWiFiSleepMode = WIFI_LIGHT_SLEEP;
+
+// how often to poll things that have no timer (eg WiFi.status())
+const unsigned long SchedulerPoll_ms = 20;
+
+// the earliest deadline requested during the current pass
+unsigned long schedulerSleep_ms = SchedulerMaxSleep_ms;
+
+// instrumentation (reset by schedulerResetStatistics())
+unsigned long schedulerIdle_ms = 0;
+uint32_t schedulerWakeups = 0;
+unsigned long schedulerWindowStart_ms = 0;
+
+
+void scheduleWithin(unsigned long ms) {
+
+  if (ms < schedulerSleep_ms) { schedulerSleep_ms = ms; }
+
+}
+
+
+void scheduleTimer(AsyncDelay & timer) {
+
+  if (timer.isExpired()) {
+    scheduleWithin(0);
+  } else {
+    scheduleWithin(timer.getExpiry() - millis());
+  }
+
+}
+
+
+void scheduler_idle() {
+
+  unsigned long sleep_ms = schedulerSleep_ms;
+
+  // start afresh for the next pass
+  schedulerSleep_ms = SchedulerMaxSleep_ms;
+
+  schedulerWakeups++;
+
+  if (sleep_ms == 0) {
+
+    // busy - but still give WiFi some guaranteed time
+    yield();
+
+    return;
+
+  }
+
+  unsigned long start = millis();
+
+  delay(sleep_ms);
+
+  schedulerIdle_ms += millis() - start;
+
+}
+
+
+void schedulerStatistics(
+  uint8_t & idlePercent,
+  uint32_t & wakeupsPerHour
+) {
+
+  unsigned long elapsed = millis() - schedulerWindowStart_ms;
+
+  if (elapsed == 0) {
+    idlePercent = 0;
+    wakeupsPerHour = 0;
+    return;
+  }
+
+  idlePercent = (uint64_t)schedulerIdle_ms * 100 / elapsed;
+  wakeupsPerHour = (uint64_t)schedulerWakeups * 3600000 / elapsed;
+
+}
+
+
+void schedulerResetStatistics() {
+
+  schedulerIdle_ms = 0;
+  schedulerWakeups = 0;
+  schedulerWindowStart_ms = millis();
+
+}
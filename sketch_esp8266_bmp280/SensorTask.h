@@ -0,0 +1,457 @@
+#pragma once
+
+/*
+ *
+ *  Sensor scheduling
+ *
+ *  Whatever it measures, each sensor goes through the same cycle:
+ *
+ *      Initialise → Stabilising → Idle → Trigger → Converting → Read → Idle ...
+ *
+ *  SensorTask owns that cycle - the timers, the recovery ladder (see
+ *  Recovery.h), how many samples make a report and telling the
+ *  scheduler and the telemetry queue when it next needs attention.
+ *  Everything which depends on the sensor itself is left to a driver
+ *  class, which supplies:
+ *
+ *      static const unsigned long ConversionTime_ms;
+ *
+ *      bool initialise();                   find and configure the sensor
+ *      bool trigger();                      start one conversion
+ *      bool checkConversion(bool & isDone); is it finished?
+ *      bool read();                         add the result to its samples
+ *      void report();                       summarise them and queue payloads
+ *      bool isReportExpected();             would report() queue anything now?
+ *      const char * name();
+ *
+ *      uint32_t temperatureReportsSuppressed();   held back by report by
+ *      uint32_t pressureReportsSuppressed();      exception (0 if it
+ *                                                 doesn't measure that)
+ *
+ *      typedef struct { ... } Retained;     kept across warm restarts
+ *      void save(Retained & retained);
+ *      void restore(const Retained & retained);
+ *
+ *      void publishBacklog();               CompressedBacklog only
+ *
+ *  The hooks return false if the sensor didn't respond or its reading
+ *  was implausible, which the task hands to the recovery ladder.
+ *  report() is called after every SensorSamplesPerReport successful
+ *  reads.
+ *
+ *  SensorTask is a template over its driver, so every hook is resolved
+ *  by the compiler (no virtual functions). The board's sensors are
+ *  listed in Sensor.h.
+ *
+ */
+
+
+/*
+ * The states a sensor can be in
+ */
+typedef enum {
+  SensorInitialise,
+  SensorStabilising,
+  SensorTrigger,
+  SensorConverting,
+  SensorRead,
+  SensorIdle,
+  SensorBackoff
+} SensorState;
+
+/*
+ * Some sensors benefit from being given a bit of time to
+ * warm up when first initialised. This time can be adjusted
+ * via sensorStabilisationTime_ms
+ */
+const unsigned long sensorStabilisationTime_ms = 500;
+
+/*
+ * The frequency with which the sensor is read. This can be reduced for
+ * testing but should be set to 10 minutes for production. That's because
+ * the reliability of the "trend" estimate really needs 6 observations
+ * equally-spaced in time over at least one hour. If the time between
+ * observations is significantly shorter, you'll get an answer but it
+ * might not be a sensible answer.
+ */
+const unsigned long sensorScanTime_ms = 10*60*1000;
+
+/*
+ * Each report summarises SensorSamplesPerReport samples (mean, minimum,
+ * maximum and standard deviation - see Statistics.h) so sampling more
+ * often improves the data without sending more messages. The samples
+ * are spread evenly across sensorScanTime_ms or, in DeepSleepMode,
+ * taken back to back during the one wake. 1 reports each sample as it
+ * is taken.
+ */
+const uint8_t SensorSamplesPerReport = 5;
+
+static_assert(SensorSamplesPerReport >= 1 && SensorSamplesPerReport <= SampleStatisticsMaxCount,"SensorSamplesPerReport out of range");
+
+const unsigned long sensorSampleInterval_ms = sensorScanTime_ms / SensorSamplesPerReport;
+
+// I2C fast mode (drivers set it once their sensor has started)
+const uint32_t SensorI2CClock_Hz = 400000;
+
+// if a sensor is still converting after its ConversionTime_ms, look again
+// every SensorStatusPoll_ms but give up (see Recovery.h) after
+// SensorConversionTimeoutFactor times as long
+const unsigned long SensorStatusPoll_ms = 2;
+const unsigned long SensorConversionTimeoutFactor = 4;
+
+
+bool i2cWriteRegister(uint8_t address, uint8_t reg, uint8_t value) {
+
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(value);
+
+  return (Wire.endTransmission() == 0);
+
+}
+
+
+bool i2cReadRegisters(uint8_t address, uint8_t reg, uint8_t * data, uint8_t length) {
+
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+
+  // repeated start - keep the bus
+  if (Wire.endTransmission(false) != 0) { return false; }
+
+  if (Wire.requestFrom(address,length) != length) { return false; }
+
+  for (uint8_t i = 0; i < length; i++) { data[i] = Wire.read(); }
+
+  return true;
+
+}
+
+
+/*
+ * A slave interrupted mid-transfer can be left holding SDA low, which
+ * blocks the bus until it has been clocked through the rest of its
+ * byte. Do that, send a STOP and restart the I2C driver.
+ */
+void resetI2CBus() {
+
+  pinMode(SDA,INPUT_PULLUP);
+  pinMode(SCL,OUTPUT_OPEN_DRAIN);
+
+  for (int i = 0; i < 9 && digitalRead(SDA) == LOW; i++) {
+    digitalWrite(SCL,LOW);
+    delayMicroseconds(5);
+    digitalWrite(SCL,HIGH);
+    delayMicroseconds(5);
+  }
+
+  // STOP - SDA rises while SCL is high
+  pinMode(SDA,OUTPUT_OPEN_DRAIN);
+  digitalWrite(SDA,LOW);
+  delayMicroseconds(5);
+  digitalWrite(SDA,HIGH);
+
+  Wire.begin();
+
+}
+
+
+template <typename Driver>
+class SensorTask {
+
+  public:
+
+    Driver driver;
+
+
+    // the arguments are passed on to the driver's constructor
+    template <typename... DriverArgs>
+    SensorTask(DriverArgs... args) : driver(args...) { }
+
+
+    void handle() {
+
+      switch (state) {
+
+        case SensorInitialise:          doInitialise();           break;
+        case SensorStabilising:         doStabilising();          break;
+        case SensorTrigger:             doTrigger();              break;
+        case SensorConverting:          doConverting();           break;
+        case SensorRead:                doRead();                 break;
+        case SensorIdle:                doIdle();                 break;
+        case SensorBackoff:             doBackoff();              break;
+        default:                        enterIdleLoop();
+
+      }
+
+      // when to come back
+      switch (state) {
+
+        case SensorStabilising:
+        case SensorConverting:
+        case SensorIdle:                scheduleTimer(timer);     break;
+        case SensorBackoff:             scheduleTimer(recovery.backoffTimer()); break;
+        default:                        scheduleWithin(0);
+
+      }
+
+      // a report which will be suppressed (see Deadband.h) is no reason to hold the MQTT session
+      if (!driver.isReportExpected()) { return; }
+
+      // the next report is published once the timer (or backoff) expires and the rest of its samples have been taken
+      AsyncDelay & next = (state == SensorBackoff) ? recovery.backoffTimer() : timer;
+      unsigned long next_ms = next.isExpired() ? 0 : next.getExpiry() - millis();
+
+      expectTelemetryWithin(next_ms + (SensorSamplesPerReport - 1 - samples) * sensorSampleInterval_ms);
+
+    }
+
+
+    // between samples (in DeepSleepMode, this wake's report has been queued)
+    bool isIdle() { return state == SensorIdle; }
+
+    RecoveryLadder & recoveryLadder() { return recovery; }
+
+
+    // the driver's state for the warm restart snapshot (see Restart.h)
+    size_t save(uint8_t * retained) {
+
+      typename Driver::Retained kept = { };
+      driver.save(kept);
+
+      memcpy(retained,&kept,sizeof(kept));
+
+      return sizeof(kept);
+
+    }
+
+
+    size_t restore(const uint8_t * retained) {
+
+      typename Driver::Retained kept;
+      memcpy(&kept,retained,sizeof(kept));
+
+      driver.restore(kept);
+
+      return sizeof(kept);
+
+    }
+
+
+  private:
+
+    SensorState state = SensorInitialise;
+
+    // a timer for sensor operations
+    AsyncDelay timer;
+
+    // what to do when the sensor fails (see Recovery.h), and the state to go back to afterwards
+    RecoveryLadder recovery{RecoveryLocalFault};
+    SensorState resumeState = SensorInitialise;
+
+    // successful reads towards the next report
+    uint8_t samples = 0;
+
+    unsigned long conversionStart_ms = 0;
+
+
+    /*
+     * Back off and then try again from resumeState, or from the top
+     * after resetting the I2C bus if the ladder says so.
+     */
+    void recover(Sensor_Error error, const char * caller, SensorState resume) {
+
+      if (recovery.escalate(error,caller) == RecoveryReset) {
+
+        resetI2CBus();
+
+        resume = SensorInitialise;
+
+      }
+
+      resumeState = resume;
+      state = SensorBackoff;
+
+    }
+
+
+    void enterIdleLoop() {
+
+      // start a timer
+      timer.start(sensorSampleInterval_ms, AsyncDelay::MILLIS);
+
+      // move to idle state
+      state = SensorIdle;
+
+    }
+
+
+    void doInitialise() {
+
+      #if (SerialDebugging)
+      Serial.printf("%s() - %s\n",__func__,driver.name());
+      #endif
+
+      // can we start the sensor?
+      if (!driver.initialise()) {
+
+        recover(sensorStartError,__func__,SensorInitialise);
+
+        return;
+
+      }
+
+      // start a timer
+      timer.start(sensorStabilisationTime_ms, AsyncDelay::MILLIS);
+
+      // move to stabilising mode (wait for it to react to power being applied)
+      state = SensorStabilising;
+
+    }
+
+
+    void doStabilising() {
+
+      // has the timeout expired?
+      if (!timer.isExpired()) {
+
+        // no! shortstop
+        return;
+
+      }
+
+      #if (DeepSleepMode)
+      // each wake exists to take a reading
+      state = SensorTrigger;
+      #else
+      // go idle
+      enterIdleLoop();
+      #endif
+
+    }
+
+
+    void doTrigger() {
+
+      // start one conversion
+      if (!driver.trigger()) {
+
+        recover(sensorMalfunctionError,__func__,SensorTrigger);
+
+        return;
+
+      }
+
+      conversionStart_ms = millis();
+
+      // come back when it should be finished
+      timer.start(Driver::ConversionTime_ms, AsyncDelay::MILLIS);
+
+      state = SensorConverting;
+
+    }
+
+
+    void doConverting() {
+
+      // has the conversion time passed?
+      if (!timer.isExpired()) {
+
+        // no! shortstop
+        return;
+
+      }
+
+      bool isDone = false;
+
+      if (!driver.checkConversion(isDone)) {
+
+        recover(sensorMalfunctionError,__func__,SensorTrigger);
+
+        return;
+
+      }
+
+      // is the sensor still converting?
+      if (!isDone) {
+
+        // sense stuck
+        if (millis() - conversionStart_ms > SensorConversionTimeoutFactor * Driver::ConversionTime_ms) {
+
+          recover(sensorMalfunctionError,__func__,SensorTrigger);
+
+          return;
+
+        }
+
+        // look again shortly
+        timer.start(SensorStatusPoll_ms, AsyncDelay::MILLIS);
+
+        return;
+
+      }
+
+      state = SensorRead;
+
+    }
+
+
+    void doRead() {
+
+      // sense bad reading - nothing is published
+      if (!driver.read()) {
+
+        recover(sensorMalfunctionError,__func__,SensorTrigger);
+
+        return;
+
+      }
+
+      recovery.succeeded();
+
+      // more samples to take before reporting?
+      if (++samples < SensorSamplesPerReport) {
+
+        #if (DeepSleepMode)
+        // back to back - this wake exists to take them
+        state = SensorTrigger;
+        #else
+        enterIdleLoop();
+        #endif
+
+        return;
+
+      }
+
+      driver.report();
+
+      // start the next report
+      samples = 0;
+
+      // go idle
+      enterIdleLoop();
+
+    }
+
+
+    void doIdle() {
+
+      // has the idle timer expired?
+      if (timer.isExpired()) {
+
+        // yes! go and read the sensor
+        state = SensorTrigger;
+
+      }
+
+    }
+
+
+    void doBackoff() {
+
+      // try again once the backoff has run its course
+      if (!recovery.isBackingOff()) { state = resumeState; }
+
+    }
+
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+/*
+ *
+ *  Compressed time series blocks
+ *
+ *  While the broker is unreachable, every report used to sit in the
+ *  queue as its own formatted message (well over 100 bytes each).
+ *  With CompressedBacklog, the readings are packed into a SeriesBlock
+ *  instead, which costs a few bytes per reading, and each block is
+ *  sent as one message (see BMP280Driver::publishBacklog() in BMP280.h).
+ *
+ *  A block is a byte string:
+ *
+ *      [version][timebase][channels][count][t0]
+ *      [record 1][record 2]...[record count]
+ *
+ *  where t0 is the time of the first reading and each record is:
+ *
+ *      [Δ²t][Δv1][Δv2]...[Δv«channels»]
+ *
+ *  - Δ²t is the delta of delta of the timestamps. Readings are taken
+ *    at a steady interval so it is almost always 0;
+ *  - Δv is the change in each channel's value (an integer in its
+ *    fixed-point units) since the previous record, or the value itself
+ *    in the first record.
+ *
+ *  t0 is an unsigned LEB128 varint (7 bits per byte, least significant
+ *  first, top bit set on all but the last byte). Δ²t and Δv are signed
+ *  so they are zigzag mapped first (0,-1,1,-2,2... to 0,1,2,3,4...),
+ *  which keeps small changes of either sign to one byte.
+ *
+ *  timebase says what t is counted in:
+ *
+ *  - SeriesTimebaseUnix - Unix time (see Clock.h);
+ *  - SeriesTimebaseDevice - seconds on the device's own clock, which
+ *    has no fixed epoch (the clock had not been set when the block
+ *    was started). The payload carrying a block says what that clock
+ *    read when the block was queued.
+ *
+ *  The timebase is chosen by the first reading and kept for the rest
+ *  of the block.
+ *
+ */
+
+
+const uint8_t SeriesBlockVersion = 1;
+const uint8_t SeriesTimebaseDevice = 0;
+const uint8_t SeriesTimebaseUnix = 1;
+
+// header bytes before t0
+const size_t SeriesHeader_bytes = 4;
+
+// the longest LEB128 encoding of a 32-bit value
+const size_t SeriesVarintMax_bytes = 5;
+
+
+// 0,-1,1,-2,2... to 0,1,2,3,4...
+uint32_t zigzag(int32_t value) {
+
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+
+}
+
+
+template <uint8_t Channels, size_t Capacity>
+class SeriesBlock {
+
+  public:
+
+    static_assert(Capacity <= 255,"series block too big for its length");
+
+
+    // false (nothing added) if the block is full - the timebase only matters for the first reading
+    bool add(uint32_t time_s, const int32_t (&values)[Channels], uint8_t timebase) {
+
+      // room for the worst case (the first record also needs the header)?
+      size_t worst = SeriesVarintMax_bytes * (1 + Channels);
+      if (records == 0) { worst += SeriesHeader_bytes + SeriesVarintMax_bytes; }
+
+      if (used + worst > Capacity) { return false; }
+
+      if (records == 0) {
+
+        buffer[0] = SeriesBlockVersion;
+        buffer[1] = timebase;
+        buffer[2] = Channels;
+        used = SeriesHeader_bytes;
+        varint(time_s);
+
+        previousTime = time_s;
+        previousDelta = 0;
+        for (uint8_t c = 0; c < Channels; c++) { previous[c] = 0; }
+
+      }
+
+      // differences wrap modulo 2^32 (a clock passing 2^32 costs nothing extra)
+      int32_t delta = time_s - previousTime;
+      varint(zigzag(difference(delta,previousDelta)));
+      previousTime = time_s;
+      previousDelta = delta;
+
+      for (uint8_t c = 0; c < Channels; c++) {
+        varint(zigzag(difference(values[c],previous[c])));
+        previous[c] = values[c];
+      }
+
+      buffer[3] = ++records;
+
+      return true;
+
+    }
+
+
+    void reset() { records = 0; used = 0; }
+
+
+    uint8_t count() const { return records; }
+
+    uint8_t timebase() const { return buffer[1]; }
+
+    size_t length() const { return used; }
+
+    const uint8_t * data() const { return buffer; }
+
+
+  private:
+
+    // no initialisers - a plain object that can go in the warm restart snapshot
+    uint8_t buffer[Capacity];
+    uint8_t used;
+    uint8_t records;
+
+    uint32_t previousTime;
+    int32_t previousDelta;
+    int32_t previous[Channels];
+
+
+    // a - b without signed overflow
+    static int32_t difference(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+
+
+    void varint(uint32_t value) {
+
+      while (value >= 0x80) {
+        buffer[used++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+      }
+
+      buffer[used++] = value;
+
+    }
+
+};
+
+
+/*
+ * Until the wall clock has been set, reading times are on the device
+ * clock (see Clock.h), which unlike millis() carries on across warm
+ * restarts - a sensor which keeps failing (see Recovery.h) or the
+ * periodic restart reboots the board, and a block can span that.
+ */
+uint32_t seriesTime_s(uint8_t timebase) {
+
+  return (timebase == SeriesTimebaseUnix) ? epochNow_s() : deviceClock_s();
+
+}
@@ -0,0 +1,556 @@
+#pragma once
+
+/*
+ *
+ *  Store-and-forward spill log
+ *
+ *  When the broker is unreachable for long enough to fill the RAM
+ *  queue, the oldest queued records are moved to an append-only log
+ *  in flash rather than forcing a reboot. Records keep the same
+ *  layout they have in the RAM arena:
+ *
+ *      [TelemetryHeader][payload\0]
+ *
+ *  The log is a sequence of segment files:
+ *
+ *      /spill/00000000
+ *      /spill/00000001
+ *      ...
+ *
+ *  Sequence numbers only ever increase so each segment is written
+ *  once, start to finish, and deleted once it has been drained. Flash
+ *  pages are never rewritten in place and LittleFS is free to spread
+ *  new segments across the whole partition. If the log reaches
+ *  SpillMaxSegments, the oldest segment is discarded.
+ *
+ *  Writes are batched: records are spilled in bulk (see
+ *  try_to_reserve() in Telemetry.h) with the segment opened once per
+ *  batch, so LittleFS can coalesce them into whole-page programs.
+ *
+ *  Records spilled before the RAM queue always predate anything still
+ *  in RAM, so the transmitter drains the log first and the RAM queue
+ *  second, preserving FIFO order.
+ *
+ *  Records carry TopicIDs, which are only meaningful with the topic
+ *  table they were written under (see Topics.h). Its signature is kept
+ *  in SpillTopicsPath and, if it no longer matches when the log is
+ *  picked up after a restart, the segments left behind are discarded
+ *  rather than published to the wrong topics.
+ *
+ *  droppedCount() is the number of records lost, whether to a full log,
+ *  a topic table change or a segment that can't be read back. The
+ *  records in a discarded segment are counted by walking its headers,
+ *  which only happens when a segment is thrown away. An unreadable
+ *  record can't be stepped over, so it and the rest of its segment
+ *  count as one.
+ *
+ *  The log only depends on the fs::FS interface so it can be pointed
+ *  at any file system, including a host-side stand-in backed by
+ *  ordinary files.
+ *
+ *  Note: the board must be compiled with a flash layout that includes
+ *  a file system (Tools > Flash Size > "4MB (FS:2MB OTA:~1019KB)" or
+ *  similar). If LittleFS will not mount, spilling is unavailable and a
+ *  full RAM queue reverts to calling fatalError(queuePushError).
+ *
+ */
+
+
+const char *    SpillDirectory              = "/spill";
+const char *    SpillTopicsPath             = "/spill_topics";
+const size_t    SpillSegmentSize_bytes      = 16*1024;
+const uint32_t  SpillMaxSegments            = 16;
+
+// the largest record body (payload plus null) - anything queued fits (see Queue.h)
+const size_t    SpillPayloadMax_bytes       = TelemetryPayloadMax_bytes + 1;
+
+// minimum spacing between backfilled messages after a reconnect (at QoS 0 - see MQTTAtLeastOnce)
+const unsigned long spillBackfillInterval_ms = 50;
+
+
+// a position in the log for peekNext()
+typedef struct {
+  uint32_t index;             // records visited so far
+  uint32_t seq;               // next record to visit
+  size_t offset;
+} SpillCursor;
+
+
+class SpillLog {
+
+  public:
+
+    SpillLog(fs::FS & fileSystem) : fs(fileSystem) { }
+
+
+    /*
+     * Mount the file system and pick up any segments left behind
+     * by a previous run. Returns false if the log is unavailable.
+     */
+    bool begin() {
+
+      if (!available) { available = fs.begin(); }
+
+      if (!available) { return false; }
+
+      bool found = false;
+
+      Dir dir = fs.openDir(SpillDirectory);
+
+      while (dir.next()) {
+
+        uint32_t seq = strtoul(dir.fileName().c_str(),NULL,10);
+
+        if (!found || seq < firstSeq) { firstSeq = seq; }
+        if (!found || seq > lastSeq) { lastSeq = seq; writeOffset = dir.fileSize(); }
+
+        found = true;
+
+      }
+
+      readOffset = 0;
+
+      // sense segments written under another topic table - unusable
+      if (!isSameTopicTable() && found) {
+
+        #if (SerialDebugging)
+        Serial.printf("spill log written under another topic table - discarding it\n");
+        #endif
+
+        for (uint32_t seq = firstSeq; seq <= lastSeq; seq++) {
+          dropped += countRecords(seq,0);
+          removeSegment(seq);
+        }
+
+        found = false;
+
+      }
+
+      if (!found) { firstSeq = lastSeq = 0; writeOffset = 0; }
+
+      return true;
+
+    }
+
+    bool isAvailable() { return available; }
+
+    bool isEmpty() { return (firstSeq == lastSeq) && (readOffset >= writeOffset); }
+
+    uint32_t spilledCount() { return spilled; }
+
+    // records lost since begin()
+    uint32_t droppedCount() { return dropped; }
+
+
+    /*
+     * The read position, so a warm restart can resume part-way
+     * through a segment rather than resending it from the start.
+     */
+    void cursor(uint32_t & seq, uint32_t & offset) {
+
+      seq = firstSeq;
+      offset = readOffset;
+
+    }
+
+
+    void resume(uint32_t seq, uint32_t offset) {
+
+      // only if the segment is still the one being read
+      if (seq != firstSeq) { return; }
+
+      if (firstSeq == lastSeq && offset > writeOffset) { return; }
+
+      readOffset = offset;
+      hasPeeked = false;
+
+    }
+
+
+    /*
+     * A batch of appends. The current segment is held open until
+     * endBatch() so consecutive records share one flash program.
+     */
+    bool beginBatch() {
+
+      if (!available) { return false; }
+
+      return openForAppend();
+
+    }
+
+
+    bool append(const TelemetryHeader & header, const char * payload) {
+
+      if (!writeFile) { return false; }
+
+      size_t length = header.payloadLength + 1;
+
+      // sense record that could never be read back (not queued by try_to_enqueue())
+      if (length > SpillPayloadMax_bytes) {
+        dropped++;
+        return true;
+      }
+
+      size_t size = sizeof(TelemetryHeader) + length;
+
+      // roll over to a new segment if this one is full
+      if (writeOffset + size > SpillSegmentSize_bytes) {
+
+        writeFile.close();
+
+        lastSeq++;
+        writeOffset = 0;
+
+        // sense too many segments - discard the oldest
+        if (lastSeq - firstSeq >= SpillMaxSegments) { discardOldestSegment(); }
+
+        if (!openForAppend()) { return false; }
+
+      }
+
+      bool success =
+        (writeFile.write((const uint8_t *)&header,sizeof(TelemetryHeader)) == sizeof(TelemetryHeader)) &&
+        (writeFile.write((const uint8_t *)payload,length) == length);
+
+      if (success) {
+        writeOffset += size;
+        spilled++;
+      }
+
+      return success;
+
+    }
+
+
+    void endBatch() {
+
+      if (writeFile) { writeFile.close(); }
+
+    }
+
+
+    /*
+     * Read the oldest record into the internal buffer and point
+     * telemetry at it. Returns false if the log is empty.
+     */
+    bool peek(Telemetry & telemetry) {
+
+      if (!hasPeeked && !readNext()) { return false; }
+
+      telemetry.topic = peeked.topic;
+      telemetry.payload = payload;
+      telemetry.payloadLength = peeked.payloadLength;
+      telemetry.retain = peeked.retain;
+
+      return true;
+
+    }
+
+
+    /*
+     * Read the records after the oldest without releasing anything
+     * (for several packets in flight at once - see MQTTAtLeastOnce).
+     * A zero-initialised cursor starts at the oldest record. Returns
+     * false at the end of the log or at a record which can't be read
+     * (which peek() steps over once it reaches the front). Like peek(),
+     * telemetry points into the internal buffer, so only the record
+     * most recently read is valid.
+     */
+    bool peekNext(Telemetry & telemetry, SpillCursor & cursor) {
+
+      // sense a new walk, or the segments walked have been drained since
+      if (cursor.index == 0 || cursor.seq < firstSeq) {
+        cursor.seq = firstSeq;
+        cursor.offset = readOffset;
+      }
+
+      char path[32];
+      File file;
+      size_t size = 0;
+
+      // find the segment holding the next record
+      while (true) {
+
+        segmentPath(cursor.seq,path,sizeof(path));
+
+        file = fs.open(path,"r");
+        size = file ? file.size() : 0;
+
+        if (cursor.offset < size) { break; }
+
+        if (file) { file.close(); }
+
+        if (cursor.seq >= lastSeq) { return false; }
+
+        cursor.seq++;
+        cursor.offset = 0;
+
+      }
+
+      // the buffer is about to be overwritten
+      hasPeeked = false;
+
+      TelemetryHeader header;
+      size_t length = 0;
+
+      bool success =
+        file.seek(cursor.offset,SeekSet) &&
+        (file.read((uint8_t *)&header,sizeof(TelemetryHeader)) == sizeof(TelemetryHeader)) &&
+        ((length = header.payloadLength + 1) <= SpillPayloadMax_bytes) &&
+        (file.read((uint8_t *)payload,length) == length);
+
+      file.close();
+
+      if (!success) { return false; }
+
+      payload[header.payloadLength] = 0;
+
+      cursor.offset += sizeof(TelemetryHeader) + length;
+      cursor.index++;
+
+      telemetry.topic = header.topic;
+      telemetry.payload = payload;
+      telemetry.payloadLength = header.payloadLength;
+      telemetry.retain = header.retain;
+
+      return true;
+
+    }
+
+
+    /*
+     * Discard the oldest record.
+     */
+    void release() {
+
+      if (!hasPeeked && !readNext()) { return; }
+
+      readOffset += sizeof(TelemetryHeader) + peeked.payloadLength + 1;
+      hasPeeked = false;
+
+      // sense log fully drained - start afresh with the next sequence number
+      if (isEmpty()) {
+
+        removeSegment(lastSeq);
+
+        firstSeq = lastSeq = lastSeq + 1;
+        readOffset = writeOffset = 0;
+
+      }
+
+    }
+
+
+  private:
+
+    fs::FS & fs;
+
+    bool available = false;
+
+    uint32_t firstSeq = 0;        // oldest segment (being read)
+    uint32_t lastSeq = 0;         // newest segment (being written)
+    size_t readOffset = 0;        // within firstSeq
+    size_t writeOffset = 0;       // within lastSeq
+
+    File writeFile;
+
+    TelemetryHeader peeked;
+    bool hasPeeked = false;
+    char payload[SpillPayloadMax_bytes];
+
+    uint32_t spilled = 0;
+    uint32_t dropped = 0;
+
+
+    void segmentPath(uint32_t seq, char * path, size_t size) {
+
+      snprintf(path,size,"%s/%08lu",SpillDirectory,(unsigned long)seq);
+
+    }
+
+
+    bool openForAppend() {
+
+      char path[32];
+      segmentPath(lastSeq,path,sizeof(path));
+
+      writeFile = fs.open(path,"a");
+
+      return (bool)writeFile;
+
+    }
+
+
+    void removeSegment(uint32_t seq) {
+
+      char path[32];
+      segmentPath(seq,path,sizeof(path));
+
+      fs.remove(path);
+
+    }
+
+
+    /*
+     * Compare the topic table with the one the log was written under,
+     * recording the current one if they differ (so flash is only
+     * written when the table changes).
+     */
+    bool isSameTopicTable() {
+
+      uint32_t signature = topicTableSignature();
+      uint32_t stored = 0;
+
+      File file = fs.open(SpillTopicsPath,"r");
+
+      bool isSame =
+        file &&
+        (file.read((uint8_t *)&stored,sizeof(stored)) == sizeof(stored)) &&
+        (stored == signature);
+
+      if (file) { file.close(); }
+
+      if (!isSame) {
+
+        file = fs.open(SpillTopicsPath,"w");
+
+        if (file) {
+          file.write((const uint8_t *)&signature,sizeof(signature));
+          file.close();
+        }
+
+      }
+
+      return isSame;
+
+    }
+
+
+    void discardOldestSegment() {
+
+      #if (SerialDebugging)
+      Serial.printf("spill log full - discarding segment %lu\n",(unsigned long)firstSeq);
+      #endif
+
+      // only the records not yet released are lost
+      dropped += countRecords(firstSeq,readOffset);
+
+      removeSegment(firstSeq);
+
+      firstSeq++;
+      readOffset = 0;
+      hasPeeked = false;
+
+    }
+
+
+    /*
+     * The number of records in a segment from offset onwards, as far
+     * as they can be read (at least one if any bytes are left).
+     */
+    uint32_t countRecords(uint32_t seq, size_t offset) {
+
+      char path[32];
+      segmentPath(seq,path,sizeof(path));
+
+      File file = fs.open(path,"r");
+
+      if (!file) { return 0; }
+
+      size_t size = file.size();
+      uint32_t count = 0;
+
+      TelemetryHeader header;
+
+      while (offset < size) {
+
+        count++;
+
+        bool readable =
+          file.seek(offset,SeekSet) &&
+          (file.read((uint8_t *)&header,sizeof(TelemetryHeader)) == sizeof(TelemetryHeader)) &&
+          ((size_t)header.payloadLength + 1 <= SpillPayloadMax_bytes);
+
+        if (!readable) { break; }
+
+        offset += sizeof(TelemetryHeader) + header.payloadLength + 1;
+
+      }
+
+      file.close();
+
+      return count;
+
+    }
+
+
+    bool readNext() {
+
+      // step past any fully-drained segments
+      while (firstSeq < lastSeq) {
+
+        char path[32];
+        segmentPath(firstSeq,path,sizeof(path));
+
+        File file = fs.open(path,"r");
+        size_t size = file ? file.size() : 0;
+        if (file) { file.close(); }
+
+        if (readOffset < size) { break; }
+
+        removeSegment(firstSeq);
+        firstSeq++;
+        readOffset = 0;
+
+      }
+
+      if (isEmpty()) { return false; }
+
+      char path[32];
+      segmentPath(firstSeq,path,sizeof(path));
+
+      File file = fs.open(path,"r");
+
+      if (!file) { return false; }
+
+      size_t length = 0;
+
+      bool success =
+        file.seek(readOffset,SeekSet) &&
+        (file.read((uint8_t *)&peeked,sizeof(TelemetryHeader)) == sizeof(TelemetryHeader)) &&
+        ((length = peeked.payloadLength + 1) <= SpillPayloadMax_bytes) &&
+        (file.read((uint8_t *)payload,length) == length);
+
+      file.close();
+
+      if (!success) {
+
+        // unreadable remainder of segment - abandon it
+        #if (SerialDebugging)
+        Serial.printf("spill segment %lu unreadable at offset %u\n",(unsigned long)firstSeq,readOffset);
+        #endif
+
+        if (firstSeq < lastSeq) {
+          removeSegment(firstSeq);
+          firstSeq++;
+          readOffset = 0;
+        } else {
+          readOffset = writeOffset;
+        }
+
+        dropped++;
+
+        return false;
+
+      }
+
+      payload[peeked.payloadLength] = 0;
+
+      hasPeeked = true;
+
+      return true;
+
+    }
+
+};
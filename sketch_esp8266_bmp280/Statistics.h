@@ -0,0 +1,124 @@
+#pragma once
+
+/*
+ *
+ *  Summary statistics over a run of samples
+ *
+ *  SampleStatistics accumulates integer samples (eg hundredths of a
+ *  degree) and reports their mean, minimum, maximum and standard
+ *  deviation in the same units, in fixed space and without floating
+ *  point.
+ *
+ *  Samples are summed relative to the first one (d) so that ∑(d) and
+ *  ∑(d²) stay small and exact. With up to SampleStatisticsMaxCount
+ *  samples lying within 2²⁵ of each other (more than the BMP280's
+ *  whole pressure range in 1/256ths of a pascal) the arithmetic fits
+ *  in 64 bits.
+ *
+ */
+
+
+const uint8_t SampleStatisticsMaxCount = 60;
+
+
+// ⌊√value⌋ (digit by digit, two bits at a time)
+uint32_t integerSquareRoot(uint64_t value) {
+
+  uint64_t root = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while (bit > value) { bit >>= 2; }
+
+  while (bit != 0) {
+
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+
+    bit >>= 2;
+
+  }
+
+  return root;
+
+}
+
+
+class SampleStatistics {
+
+  public:
+
+    void add(int32_t value) {
+
+      if (samples == 0) {
+        first = value;
+        lowest = value;
+        highest = value;
+      }
+
+      int64_t d = (int64_t)value - first;
+
+      sum_d += d;
+      sum_dd += d * d;
+      samples++;
+
+      if (value < lowest) { lowest = value; }
+      if (value > highest) { highest = value; }
+
+    }
+
+
+    void reset() {
+
+      samples = 0;
+      sum_d = 0;
+      sum_dd = 0;
+
+    }
+
+
+    uint8_t count() const { return samples; }
+
+
+    // rounded half away from zero
+    int32_t mean() const {
+
+      if (samples == 0) { return 0; }
+
+      int64_t half = (sum_d < 0) ? -(int64_t)(samples / 2) : samples / 2;
+
+      return first + (sum_d + half) / samples;
+
+    }
+
+
+    int32_t minimum() const { return lowest; }
+
+    int32_t maximum() const { return highest; }
+
+
+    // sample standard deviation (n-1), rounded down - 0 until there are two samples
+    uint32_t standardDeviation() const {
+
+      if (samples < 2) { return 0; }
+
+      uint64_t spread = samples * sum_dd - sum_d * sum_d;
+
+      return integerSquareRoot(spread / ((uint64_t)samples * (samples - 1)));
+
+    }
+
+
+  private:
+
+    uint8_t samples = 0;
+    int32_t first = 0;
+    int32_t lowest = 0;
+    int32_t highest = 0;
+    int64_t sum_d = 0;     // ∑(d)
+    int64_t sum_dd = 0;    // ∑(d²)
+
+};
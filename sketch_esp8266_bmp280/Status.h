@@ -8,7 +8,20 @@
 
 
 // topic components
-const char *    TopicStatusKey              = "status";
+constexpr const char * TopicStatusKey        = "status";
+constexpr const char * TopicStatusMQTTKey    = "mqtt";
+constexpr const char * TopicStatusWiFiKey    = "wifi";
+constexpr const char * TopicStatusRecoveryKey = "recovery";
+
+static_assert(topicLength(TopicStatusKey) <= MaxTopicLength,"status topic too long");
+static_assert(topicLength(TopicStatusKey,TopicStatusMQTTKey) <= MaxTopicLength,"MQTT status topic too long");
+static_assert(topicLength(TopicStatusKey,TopicStatusWiFiKey) <= MaxTopicLength,"WiFi status topic too long");
+static_assert(topicLength(TopicStatusKey,TopicStatusRecoveryKey) <= MaxTopicLength,"recovery status topic too long");
+
+const TopicID   TopicStatusID               = registerTopic(TopicStatusKey);
+const TopicID   TopicStatusMQTTID           = registerTopic(TopicStatusKey,TopicStatusMQTTKey);
+const TopicID   TopicStatusWiFiID           = registerTopic(TopicStatusKey,TopicStatusWiFiKey);
+const TopicID   TopicStatusRecoveryID       = registerTopic(TopicStatusKey,TopicStatusRecoveryKey);
 
 // payload components
 const char *    PayloadStatusSSIDKey        = "\"ssid\"";
@@ -16,8 +29,80 @@ const char *    PayloadStatusMACKey         = "\"mac\"";
 const char *    PayloadStatusIPKey          = "\"ip\"";
 const char *    PayloadStatusHeapKey        = "\"heap\"";
 const char *    PayloadStatusUpTimeKey      = "\"upTime\"";
+const char *    PayloadStatusIdleKey        = "\"idle_pct\"";
+const char *    PayloadStatusWakeupsKey     = "\"wakeups_hr\"";
+const char *    PayloadStatusTempSuppressedKey     = "\"suppressed_temp\"";
+const char *    PayloadStatusPressureSuppressedKey = "\"suppressed_pressure\"";
+
+const char *    PayloadMQTTConnectKey       = "\"connect_ms\"";
+const char *    PayloadMQTTDisconnectKey    = "\"disconnect_ms\"";
+const char *    PayloadMQTTHeldKey          = "\"held\"";
+const char *    PayloadMQTTReusedKey        = "\"reused\"";
+const char *    PayloadMQTTDroppedKey       = "\"dropped\"";
+const char *    PayloadMQTTSavedKey         = "\"saved_ms\"";
+const char *    PayloadMQTTRunsKey          = "\"runs\"";
+const char *    PayloadMQTTRunMessagesKey   = "\"run_msgs\"";
+const char *    PayloadMQTTRunTimeKey       = "\"run_ms\"";
+const char *    PayloadMQTTFirstPublishKey  = "\"first_ms\"";
+const char *    PayloadMQTTRateKey          = "\"msgs_per_s\"";
+const char *    PayloadMQTTDiscardedKey     = "\"discarded\"";
+
+const char *    PayloadWiFiLastKey          = "\"last_ms\"";
+const char *    PayloadWiFiFastKey          = "\"fast_ms\"";
+const char *    PayloadWiFiFullKey          = "\"full_ms\"";
+const char *    PayloadWiFiFastCountKey     = "\"fast\"";
+const char *    PayloadWiFiFullCountKey     = "\"full\"";
+const char *    PayloadWiFiFallbackKey      = "\"fallback\"";
+
+const char *    PayloadRecoveryWiFiRetryKey     = "\"wifi_retry\"";
+const char *    PayloadRecoveryWiFiResetKey     = "\"wifi_reset\"";
+const char *    PayloadRecoveryMQTTRetryKey     = "\"mqtt_retry\"";
+const char *    PayloadRecoveryMQTTResetKey     = "\"mqtt_reset\"";
+const char *    PayloadRecoverySensorRetryKey   = "\"sensor_retry\"";
+const char *    PayloadRecoverySensorResetKey   = "\"sensor_reset\"";
+const char *    PayloadRecoveryRebootKey        = "\"reboot\"";
+
+// CBOR map keys (when CBORPayloads is true)
+const uint8_t   CBORStatusSSIDKey           = 1;
+const uint8_t   CBORStatusMACKey            = 2;
+const uint8_t   CBORStatusIPKey             = 3;
+const uint8_t   CBORStatusHeapKey           = 4;
+const uint8_t   CBORStatusUpTimeKey         = 5;
+const uint8_t   CBORStatusIdleKey           = 6;
+const uint8_t   CBORStatusWakeupsKey        = 7;
+const uint8_t   CBORStatusTempSuppressedKey = 8;
+const uint8_t   CBORStatusPressureSuppressedKey = 9;
+
+const uint8_t   CBORMQTTConnectKey          = 1;
+const uint8_t   CBORMQTTDisconnectKey       = 2;
+const uint8_t   CBORMQTTHeldKey             = 3;
+const uint8_t   CBORMQTTReusedKey           = 4;
+const uint8_t   CBORMQTTDroppedKey          = 5;
+const uint8_t   CBORMQTTSavedKey            = 6;
+const uint8_t   CBORMQTTRunsKey             = 7;
+const uint8_t   CBORMQTTRunMessagesKey      = 8;
+const uint8_t   CBORMQTTRunTimeKey          = 9;
+const uint8_t   CBORMQTTFirstPublishKey     = 10;
+const uint8_t   CBORMQTTRateKey             = 11;
+const uint8_t   CBORMQTTDiscardedKey        = 12;
 
+const uint8_t   CBORWiFiLastKey             = 1;
+const uint8_t   CBORWiFiFastKey             = 2;
+const uint8_t   CBORWiFiFullKey             = 3;
+const uint8_t   CBORWiFiFastCountKey        = 4;
+const uint8_t   CBORWiFiFullCountKey        = 5;
+const uint8_t   CBORWiFiFallbackKey         = 6;
 
+const uint8_t   CBORRecoveryWiFiRetryKey    = 1;
+const uint8_t   CBORRecoveryWiFiResetKey    = 2;
+const uint8_t   CBORRecoveryMQTTRetryKey    = 3;
+const uint8_t   CBORRecoveryMQTTResetKey    = 4;
+const uint8_t   CBORRecoverySensorRetryKey  = 5;
+const uint8_t   CBORRecoverySensorResetKey  = 6;
+const uint8_t   CBORRecoveryRebootKey       = 7;
+
+
+// in DeepSleepMode, status goes out every DeepSleepStatusEvery wakes instead (see DeepSleep.h)
 AsyncDelay statusReportTimer;
 const unsigned long statusReportTime_ms = 5*60*1000;
 
@@ -27,39 +112,208 @@ void publish_status_update(
   const char * wifi_mac,
   const char * wifi_ip,
   uint32_t freeHeap,
-  uint32_t upTime
+  uint32_t upTime,
+  uint8_t idlePercent,
+  uint32_t wakeupsPerHour,
+  uint32_t temperatureSuppressed,
+  uint32_t pressureSuppressed
 ) {
     
-  // new queue entry
-  Telemetry telemetry;
-
-  // construct the topic
-  sprintf(
-    telemetry.topic,
-    "%s/%s/%s",
-    MQTTTopicPrefix,
-    MQTTClientID,
-    TopicStatusKey
-  );
-
-  // construct the payload
-  sprintf(
-    telemetry.payload,
-    "{%s:\"%s\",%s:\"%s\",%s:\"%s\",%s:%lu,%s:%lu}",
-    PayloadStatusSSIDKey,
-    wifi_ssid,
-    PayloadStatusMACKey,
-    wifi_mac,
-    PayloadStatusIPKey,
-    wifi_ip,
-    PayloadStatusHeapKey,
-    freeHeap,
-    PayloadStatusUpTimeKey,
-    upTime
-  );
+  // reserve space at the tail of the queue
+  size_t capacity = 0;
+  char * payload = try_to_reserve(capacity);
+
+  // when it was captured (0 until the clock has been set)
+  uint32_t captured_s = epochNow_s();
+
+  // construct the payload in place
+  #if (CBORPayloads)
+  CBORWriter cbor(payload,capacity);
+  cbor.map(9 + (captured_s ? 1 : 0));
+  if (captured_s) { cbor.key(CBORTimeKey); cbor.epochTime(captured_s); }
+  cbor.key(CBORStatusSSIDKey);      cbor.text(wifi_ssid);
+  cbor.key(CBORStatusMACKey);       cbor.text(wifi_mac);
+  cbor.key(CBORStatusIPKey);        cbor.text(wifi_ip);
+  cbor.key(CBORStatusHeapKey);      cbor.unsignedInteger(freeHeap);
+  cbor.key(CBORStatusUpTimeKey);    cbor.unsignedInteger(upTime);
+  cbor.key(CBORStatusIdleKey);      cbor.unsignedInteger(idlePercent);
+  cbor.key(CBORStatusWakeupsKey);   cbor.unsignedInteger(wakeupsPerHour);
+  cbor.key(CBORStatusTempSuppressedKey);      cbor.unsignedInteger(temperatureSuppressed);
+  cbor.key(CBORStatusPressureSuppressedKey);  cbor.unsignedInteger(pressureSuppressed);
+  size_t payloadLength = cbor.length();
+  #else
+  JSONWriter json(payload,capacity);
+  json.beginObject();
+  if (captured_s) { json.key(PayloadTimeKey); json.unsignedInteger(captured_s); }
+  json.key(PayloadStatusSSIDKey);     json.text(wifi_ssid);
+  json.key(PayloadStatusMACKey);      json.text(wifi_mac);
+  json.key(PayloadStatusIPKey);       json.text(wifi_ip);
+  json.key(PayloadStatusHeapKey);     json.unsignedInteger(freeHeap);
+  json.key(PayloadStatusUpTimeKey);   json.unsignedInteger(upTime);
+  json.key(PayloadStatusIdleKey);     json.unsignedInteger(idlePercent);
+  json.key(PayloadStatusWakeupsKey);  json.unsignedInteger(wakeupsPerHour);
+  json.key(PayloadStatusTempSuppressedKey);     json.unsignedInteger(temperatureSuppressed);
+  json.key(PayloadStatusPressureSuppressedKey); json.unsignedInteger(pressureSuppressed);
+  json.endObject();
+  size_t payloadLength = json.length();
+  #endif
+
+  // push onto the queue and check the result
+  try_to_enqueue(__func__,TopicStatusID,payloadLength);
+
+}
+
+
+/*
+ * Connection-hold policy measurements and decisions, and the last
+ * transmission run (see Telemetry.h). Counts are since boot, apart
+ * from discarded messages (see telemetryDiscarded()), which are since
+ * power-up.
+ */
+void publish_mqtt_status_update() {
+
+  // messages per second over the last run, to one decimal place
+  int32_t rate_x10 = mqttRunStats.run_ms ? mqttRunStats.messages * 10000 / mqttRunStats.run_ms : 0;
+
+  // reserve space at the tail of the queue
+  size_t capacity = 0;
+  char * payload = try_to_reserve(capacity);
+
+  // when it was captured (0 until the clock has been set)
+  uint32_t captured_s = epochNow_s();
+
+  // construct the payload in place
+  #if (CBORPayloads)
+  CBORWriter cbor(payload,capacity);
+  cbor.map(12 + (captured_s ? 1 : 0));
+  if (captured_s) { cbor.key(CBORTimeKey); cbor.epochTime(captured_s); }
+  cbor.key(CBORMQTTConnectKey);      cbor.unsignedInteger(mqttConnectCost_ms);
+  cbor.key(CBORMQTTDisconnectKey);   cbor.unsignedInteger(mqttDisconnectCost_ms);
+  cbor.key(CBORMQTTHeldKey);         cbor.unsignedInteger(mqttHoldCount);
+  cbor.key(CBORMQTTReusedKey);       cbor.unsignedInteger(mqttHoldReusedCount);
+  cbor.key(CBORMQTTDroppedKey);      cbor.unsignedInteger(mqttDropCount);
+  cbor.key(CBORMQTTSavedKey);        cbor.unsignedInteger(mqttHoldSaved_ms);
+  cbor.key(CBORMQTTRunsKey);         cbor.unsignedInteger(mqttRunStats.runs);
+  cbor.key(CBORMQTTRunMessagesKey);  cbor.unsignedInteger(mqttRunStats.messages);
+  cbor.key(CBORMQTTRunTimeKey);      cbor.unsignedInteger(mqttRunStats.run_ms);
+  cbor.key(CBORMQTTFirstPublishKey); cbor.unsignedInteger(mqttRunStats.firstPublish_ms);
+  cbor.key(CBORMQTTRateKey);         cbor.decimal(rate_x10,1);
+  cbor.key(CBORMQTTDiscardedKey);    cbor.unsignedInteger(telemetryDiscarded());
+  size_t payloadLength = cbor.length();
+  #else
+  JSONWriter json(payload,capacity);
+  json.beginObject();
+  if (captured_s) { json.key(PayloadTimeKey); json.unsignedInteger(captured_s); }
+  json.key(PayloadMQTTConnectKey);      json.unsignedInteger(mqttConnectCost_ms);
+  json.key(PayloadMQTTDisconnectKey);   json.unsignedInteger(mqttDisconnectCost_ms);
+  json.key(PayloadMQTTHeldKey);         json.unsignedInteger(mqttHoldCount);
+  json.key(PayloadMQTTReusedKey);       json.unsignedInteger(mqttHoldReusedCount);
+  json.key(PayloadMQTTDroppedKey);      json.unsignedInteger(mqttDropCount);
+  json.key(PayloadMQTTSavedKey);        json.unsignedInteger(mqttHoldSaved_ms);
+  json.key(PayloadMQTTRunsKey);         json.unsignedInteger(mqttRunStats.runs);
+  json.key(PayloadMQTTRunMessagesKey);  json.unsignedInteger(mqttRunStats.messages);
+  json.key(PayloadMQTTRunTimeKey);      json.unsignedInteger(mqttRunStats.run_ms);
+  json.key(PayloadMQTTFirstPublishKey); json.unsignedInteger(mqttRunStats.firstPublish_ms);
+  json.key(PayloadMQTTRateKey);         json.decimal(rate_x10,1);
+  json.key(PayloadMQTTDiscardedKey);    json.unsignedInteger(telemetryDiscarded());
+  json.endObject();
+  size_t payloadLength = json.length();
+  #endif
+
+  // push onto the queue and check the result
+  try_to_enqueue(__func__,TopicStatusMQTTID,payloadLength);
+
+}
+
+
+/*
+ * Time to WL_CONNECTED for fast (cached access point) and full
+ * connects (see Comms.h). Counts are since power-up.
+ */
+void publish_wifi_status_update() {
+
+  // reserve space at the tail of the queue
+  size_t capacity = 0;
+  char * payload = try_to_reserve(capacity);
+
+  // when it was captured (0 until the clock has been set)
+  uint32_t captured_s = epochNow_s();
+
+  // construct the payload in place
+  #if (CBORPayloads)
+  CBORWriter cbor(payload,capacity);
+  cbor.map(6 + (captured_s ? 1 : 0));
+  if (captured_s) { cbor.key(CBORTimeKey); cbor.epochTime(captured_s); }
+  cbor.key(CBORWiFiLastKey);        cbor.unsignedInteger(wifiConnectStats.lastConnect_ms);
+  cbor.key(CBORWiFiFastKey);        cbor.unsignedInteger(wifiConnectStats.fastConnect_ms);
+  cbor.key(CBORWiFiFullKey);        cbor.unsignedInteger(wifiConnectStats.fullConnect_ms);
+  cbor.key(CBORWiFiFastCountKey);   cbor.unsignedInteger(wifiConnectStats.fastCount);
+  cbor.key(CBORWiFiFullCountKey);   cbor.unsignedInteger(wifiConnectStats.fullCount);
+  cbor.key(CBORWiFiFallbackKey);    cbor.unsignedInteger(wifiConnectStats.fallbackCount);
+  size_t payloadLength = cbor.length();
+  #else
+  JSONWriter json(payload,capacity);
+  json.beginObject();
+  if (captured_s) { json.key(PayloadTimeKey); json.unsignedInteger(captured_s); }
+  json.key(PayloadWiFiLastKey);       json.unsignedInteger(wifiConnectStats.lastConnect_ms);
+  json.key(PayloadWiFiFastKey);       json.unsignedInteger(wifiConnectStats.fastConnect_ms);
+  json.key(PayloadWiFiFullKey);       json.unsignedInteger(wifiConnectStats.fullConnect_ms);
+  json.key(PayloadWiFiFastCountKey);  json.unsignedInteger(wifiConnectStats.fastCount);
+  json.key(PayloadWiFiFullCountKey);  json.unsignedInteger(wifiConnectStats.fullCount);
+  json.key(PayloadWiFiFallbackKey);   json.unsignedInteger(wifiConnectStats.fallbackCount);
+  json.endObject();
+  size_t payloadLength = json.length();
+  #endif
+
+  // push onto the queue and check the result
+  try_to_enqueue(__func__,TopicStatusWiFiID,payloadLength);
+
+}
+
+
+/*
+ * Recovery ladder activity (see Recovery.h). Retries and resets are
+ * since boot, reboots since power-up.
+ */
+void publish_recovery_status_update() {
+
+  // reserve space at the tail of the queue
+  size_t capacity = 0;
+  char * payload = try_to_reserve(capacity);
+
+  // when it was captured (0 until the clock has been set)
+  uint32_t captured_s = epochNow_s();
+
+  // construct the payload in place
+  #if (CBORPayloads)
+  CBORWriter cbor(payload,capacity);
+  cbor.map(7 + (captured_s ? 1 : 0));
+  if (captured_s) { cbor.key(CBORTimeKey); cbor.epochTime(captured_s); }
+  cbor.key(CBORRecoveryWiFiRetryKey);     cbor.unsignedInteger(wifiRecovery.retryCount());
+  cbor.key(CBORRecoveryWiFiResetKey);     cbor.unsignedInteger(wifiRecovery.resetCount());
+  cbor.key(CBORRecoveryMQTTRetryKey);     cbor.unsignedInteger(mqttRecovery.retryCount());
+  cbor.key(CBORRecoveryMQTTResetKey);     cbor.unsignedInteger(mqttRecovery.resetCount());
+  cbor.key(CBORRecoverySensorRetryKey);   cbor.unsignedInteger(sensorRetryCount());
+  cbor.key(CBORRecoverySensorResetKey);   cbor.unsignedInteger(sensorResetCount());
+  cbor.key(CBORRecoveryRebootKey);        cbor.unsignedInteger(recoveryRebootCount);
+  size_t payloadLength = cbor.length();
+  #else
+  JSONWriter json(payload,capacity);
+  json.beginObject();
+  if (captured_s) { json.key(PayloadTimeKey); json.unsignedInteger(captured_s); }
+  json.key(PayloadRecoveryWiFiRetryKey);    json.unsignedInteger(wifiRecovery.retryCount());
+  json.key(PayloadRecoveryWiFiResetKey);    json.unsignedInteger(wifiRecovery.resetCount());
+  json.key(PayloadRecoveryMQTTRetryKey);    json.unsignedInteger(mqttRecovery.retryCount());
+  json.key(PayloadRecoveryMQTTResetKey);    json.unsignedInteger(mqttRecovery.resetCount());
+  json.key(PayloadRecoverySensorRetryKey);  json.unsignedInteger(sensorRetryCount());
+  json.key(PayloadRecoverySensorResetKey);  json.unsignedInteger(sensorResetCount());
+  json.key(PayloadRecoveryRebootKey);       json.unsignedInteger(recoveryRebootCount);
+  json.endObject();
+  size_t payloadLength = json.length();
+  #endif
 
   // push onto the queue and check the result
-  try_to_enqueue(__func__,&telemetry);
+  try_to_enqueue(__func__,TopicStatusRecoveryID,payloadLength);
 
 }
 
@@ -72,24 +326,54 @@ void periodicStatusReport() {
     * 2. statusReportTimer.isExpired() will be true 
     */
 
+  #if (DeepSleepMode)
+  // only some wakes report status
+  if (!deepSleepStatusDue()) { return; }
+  #endif
+
   if (statusReportTimer.isExpired()) {
 
     // (re)start the timer
     statusReportTimer.start(statusReportTime_ms, AsyncDelay::MILLIS);
 
     // pre-calculations
-    uint32_t freeHeap = system_get_free_heap_size();
+    uint32_t freeHeap = ESP.getFreeHeap();
     uint32_t upTime = millis() / 1000;
 
+    // how the event loop has been spending its time since the last report
+    uint8_t idlePercent;
+    uint32_t wakeupsPerHour;
+    schedulerStatistics(idlePercent,wakeupsPerHour);
+    schedulerResetStatistics();
+
     // general status report
     publish_status_update(
       WiFi.SSID().c_str(),
       WiFi.macAddress().c_str(),
       WiFi.localIP().toString().c_str(),
       freeHeap,
-      upTime
+      upTime,
+      idlePercent,
+      wakeupsPerHour,
+      temperatureReportsSuppressed(),
+      pressureReportsSuppressed()
     );
 
+    // how the connection-hold policy is doing
+    publish_mqtt_status_update();
+
+    // how long WiFi takes to connect
+    publish_wifi_status_update();
+
+    // how often things have gone wrong
+    publish_recovery_status_update();
+
   }
+
+  // when to come back
+  scheduleTimer(statusReportTimer);
+
+  // the next report is published when the timer expires
+  expectTelemetry(statusReportTimer);
         
 }
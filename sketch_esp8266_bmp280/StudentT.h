@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+ *
+ *  Student's t distribution at compile time
+ *
+ *  studentTCritical(α,ν) is the two-tailed critical value of t for
+ *  significance level α and ν degrees of freedom, ie the value which
+ *  Excel calls T.INV.2T(α,ν) and a TI-Nspire calls invt(1-α/2,ν).
+ *
+ *  Everything here is constexpr (written recursively, like
+ *  stringLength() in Topics.h) so the value is worked out by the
+ *  compiler and costs nothing at run time. The method:
+ *
+ *  - P(|T| <= t) for integer ν has a closed form as a finite series
+ *    in sin θ and cos θ where θ = atan(t/√ν) (Abramowitz & Stegun
+ *    26.7.3 and 26.7.4). sin θ and cos θ come from t and ν directly,
+ *    so only odd ν needs an arctangent;
+ *  - that probability rises with t, so the critical value is found by
+ *    bisection to well beyond double precision.
+ *
+ *  The static_asserts at the end check the results against published
+ *  tables.
+ *
+ */
+
+
+constexpr double StudentT_Pi                = 3.14159265358979323846;
+
+
+constexpr double studentTAbs(double x) { return (x < 0.0) ? -x : x; }
+
+
+// square root by Newton's method
+constexpr double studentTSqrtIterate(double x, double guess, int steps) {
+
+  return (steps == 0) ? guess : studentTSqrtIterate(x, 0.5 * (guess + x / guess), steps - 1);
+
+}
+
+
+constexpr double studentTSqrt(double x) {
+
+  return (x <= 0.0) ? 0.0 : studentTSqrtIterate(x, (x > 1.0) ? x : 1.0, 64);
+
+}
+
+
+// arctangent: Taylor series once the angle has been halved enough times
+constexpr double studentTAtanSeries(double power, double zz, int i) {
+
+  return (i == 16) ? 0.0 : ((i % 2) ? -power : power) / (2 * i + 1) + studentTAtanSeries(power * zz, zz, i + 1);
+
+}
+
+
+constexpr double studentTAtanHalving(double z, int halvings) {
+
+  return (halvings == 0) ?
+    studentTAtanSeries(z, z * z, 0) :
+    2.0 * studentTAtanHalving(z / (1.0 + studentTSqrt(1.0 + z * z)), halvings - 1);
+
+}
+
+
+constexpr double studentTAtan(double z) { return studentTAtanHalving(z, 4); }
+
+
+// ∑ cos^2k(θ) · (1·3···(2k-1))/(2·4···2k) for k = 0..last (even ν)
+constexpr double studentTEvenSeries(double cc, double term, int k, int last) {
+
+  return (k > last) ? 0.0 : term + studentTEvenSeries(cc, term * cc * (2 * k + 1) / (2 * k + 2), k + 1, last);
+
+}
+
+
+// ∑ cos^(2k-1)(θ) · (2·4···(2k-2))/(1·3···(2k-1)) for k = 1..last (odd ν)
+constexpr double studentTOddSeries(double cc, double term, int k, int last) {
+
+  return (k > last) ? 0.0 : term + studentTOddSeries(cc, term * cc * (2 * k) / (2 * k + 1), k + 1, last);
+
+}
+
+
+// P(|T| <= t) with ν degrees of freedom
+constexpr double studentTAcceptance(double t, int nu) {
+
+  return (nu % 2 == 0) ?
+
+    // sin θ · even series
+    (t / studentTSqrt(nu + t * t)) *
+      studentTEvenSeries(nu / (nu + t * t), 1.0, 0, (nu - 2) / 2) :
+
+    // (2/π)(θ + sin θ · odd series)
+    (2.0 / StudentT_Pi) * (
+      studentTAtan(t / studentTSqrt(nu)) +
+      (t / studentTSqrt(nu + t * t)) *
+        studentTOddSeries(nu / (nu + t * t), studentTSqrt(nu / (nu + t * t)), 1, (nu - 1) / 2)
+    );
+
+}
+
+
+constexpr double studentTBisect(double alpha, int nu, double low, double high, int steps) {
+
+  return (steps == 0) ?
+    0.5 * (low + high) :
+    (1.0 - studentTAcceptance(0.5 * (low + high), nu) > alpha) ?
+      studentTBisect(alpha, nu, 0.5 * (low + high), high, steps - 1) :
+      studentTBisect(alpha, nu, low, 0.5 * (low + high), steps - 1);
+
+}
+
+
+// two-tailed critical value of t for significance alpha and nu degrees of freedom
+constexpr double studentTCritical(double alpha, int nu) {
+
+  return studentTBisect(alpha, nu, 0.0, 1.0E4, 100);
+
+}
+
+
+// reference values (NIST/SEMATECH e-Handbook of Statistical Methods, table 1.3.6.7.2)
+constexpr bool studentTMatches(double alpha, int nu, double expected) {
+
+  return studentTAbs(studentTCritical(alpha, nu) - expected) < 0.0005;
+
+}
+
+static_assert(studentTMatches(0.10,  1,  6.314),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.05,  1, 12.706),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.05,  2,  4.303),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.05,  3,  3.182),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.05,  4,  2.776),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.01,  4,  4.604),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.05, 10,  2.228),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.01, 16,  2.921),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.05, 30,  2.042),"studentTCritical() disagrees with reference table");
+static_assert(studentTMatches(0.10,100,  1.660),"studentTCritical() disagrees with reference table");
@@ -6,6 +6,13 @@ const int       MQTT_QOS_AtMostOnce         = 0;
 const int       MQTT_QOS_AtLeastOnce        = 1;
 const int       MQTT_QOS_ExactlyOnce        = 2;
 
+// the QoS used for all telemetry (see MQTTAtLeastOnce in Defines.h)
+#if (MQTTAtLeastOnce)
+const int       MQTT_QOS_Telemetry          = MQTT_QOS_AtLeastOnce;
+#else
+const int       MQTT_QOS_Telemetry          = MQTT_QOS_AtMostOnce;
+#endif
+
 
 /*
  * The states MQTT processing can be in
@@ -17,222 +24,1363 @@ typedef enum {
   MQTTWaitConnectState,
   MQTTTransmitState,
   MQTTStartDisconnectState,
-  MQTTWaitDisconnectState
+  MQTTWaitDisconnectState,
+  MQTTHoldState,
+  MQTTBackoffState
     
 } MQTT_State;
 
 /*
- * The state this program is in at the moment is...
+ * The state this program is in at the moment is...
+ */
+MQTT_State mqttState = MQTTIdleState;
+
+/*
+ * The MQTT client's packet buffer. A PUBLISH must fit in this along
+ * with its framing: fixed header (1), remaining length (up to 4),
+ * topic length (2) and packet identifier (2, QoS > 0 only).
+ */
+const size_t MQTT_packet_buffer_bytes = 512;
+const size_t MQTT_publish_overhead_bytes = 1 + 4 + 2 + 2;
+
+// comms support
+WiFiClient mqtt_WiFi_client;
+MQTTClient mqtt_service(MQTT_packet_buffer_bytes);
+AsyncDelay mqtt_service_timer;
+const unsigned long MQTT_service_timeout_ms = 30*1000;
+
+#if (MQTTAtLeastOnce)
+
+/*
+ * At-least-once delivery: the QoS 1 PUBLISH packets awaiting their
+ * PUBACK, oldest first (see mqtt_window_fill()).
+ */
+typedef struct {
+  uint16_t packetID;
+  uint8_t records;                // messages in the packet
+  TopicID topic;
+  bool retain;
+  bool isBackfill;                // from the spill log
+  bool isWritten;                 // in the current session
+  bool isDuplicate;               // written in an earlier session - resent with DUP
+  bool isAcked;
+  unsigned long written_ms;
+} MQTTInFlight;
+
+static_assert(MQTTWindow >= 1 && MQTTWindow <= 16,"MQTTWindow out of range");
+
+MQTTInFlight mqttWindow[MQTTWindow];
+uint8_t mqttWindowCount = 0;
+
+uint16_t mqttNextPacketID = 1;
+
+// queues everything in the window again (see spill_to_flash())
+void mqtt_window_abandon();
+
+// resends anything unacknowledged once a session is up again
+void mqtt_window_reconnected();
+
+#endif
+
+// what to do when connecting, publishing or disconnecting fails (see Recovery.h)
+RecoveryLadder mqttRecovery(RecoveryNetworkFault);
+
+// set when connecting or publishing fails, cleared once connected
+bool mqttBrokerUnreachable = false;
+
+#if (CompressedBacklog)
+// queues any readings held while the broker was unreachable (see Sensor.h)
+void publish_series_backlog();
+#endif
+
+// MQTT messages waiting to be sent (see Queue.h)
+TelemetryQueue mqttQueue;
+
+// messages lost unsent because neither the spill log nor the warm restart snapshot had room (see Restart.h), since power-up (saturates)
+uint16_t telemetryDiscardedCount = 0;
+
+// where mqttQueue overflows to (see Spill.h)
+SpillLog spillLog(LittleFS);
+AsyncDelay spill_backfill_timer;
+
+// messages lost unsent since power-up: at a reboot, plus any the spill log has dropped since boot (saturates)
+uint16_t telemetryDiscarded() {
+
+  uint32_t discarded = telemetryDiscardedCount + spillLog.droppedCount();
+
+  return (discarded < UINT16_MAX) ? discarded : UINT16_MAX;
+
+}
+
+/*
+ * try_to_reserve() guarantees room for a payload of up to
+ * TelemetryPayloadMax_bytes (see Queue.h) plus its terminating null,
+ * and offers no more than that. When spilling, records are moved to
+ * flash until at least half the arena is free.
+ */
+const size_t TelemetryPayloadReserve_bytes = TelemetryPayloadMax_bytes + 1;
+const size_t TelemetrySpillTarget_bytes = TelemetryQueueSize_bytes / 2;
+
+
+/*
+ * Connection-hold policy
+ *
+ * When the queue empties, the session is normally torn down. If the
+ * next message is expected soon, it is cheaper to keep the session
+ * open (MQTTHoldState) than to pay for another connect/disconnect
+ * cycle.
+ *
+ * The cost of a cycle is measured (a smoothed average of the time from
+ * starting a connect to being connected, plus from starting a
+ * disconnect to being disconnected). Modules that produce telemetry
+ * say when they next expect to do so via expectTelemetry(). Holding
+ * an idle session (keep-alive pings, light sleep between beacons) is
+ * assumed to cost 1/MQTTHoldCostRatio of the radio time per
+ * millisecond that connecting does, so the session is held when:
+ *
+ *    time to next message / MQTTHoldCostRatio < cycle cost
+ *
+ * A hold ends when a message is queued (the session is reused), or
+ * MQTTHoldGrace_ms after the predicted time (the prediction was wrong
+ * and the session is closed in the normal way).
+ */
+const unsigned long MQTTHoldCostRatio = 100;
+const unsigned long MQTTHoldGrace_ms = 2*1000;
+
+// the earliest expected enqueue this pass (reset by mqtt_handle())
+const unsigned long MQTTNoTelemetryExpected = ~0UL;
+unsigned long mqttNextTelemetry_ms = MQTTNoTelemetryExpected;
+
+// measurements (zero until the first connect/disconnect)
+unsigned long mqttConnectCost_ms = 0;
+unsigned long mqttDisconnectCost_ms = 0;
+unsigned long mqttCycleStart_ms = 0;
+
+// hold state
+AsyncDelay mqtt_hold_timer;
+unsigned long mqttHoldStart_ms = 0;
+
+// decisions and outcomes since boot (see Status.h)
+uint32_t mqttHoldCount = 0;               // sessions held open
+uint32_t mqttHoldReusedCount = 0;         // ... and reused
+uint32_t mqttDropCount = 0;               // sessions closed when the queue emptied
+uint32_t mqttHoldSaved_ms = 0;            // estimated connect/disconnect time avoided
+
+
+/*
+ * Transmission run measurements. A run starts when the queue is found
+ * to be non-empty (from idle, or when a held session is reused) and
+ * ends when both queues are empty again. These give a baseline for
+ * any change to the transmit or connect/disconnect logic.
+ */
+typedef struct {
+  uint32_t runs;                          // completed runs since boot
+  uint32_t messages;                      // messages sent in the last run
+  uint32_t run_ms;                        // start to queues empty, last run
+  uint32_t firstPublish_ms;               // start to first message sent, last run
+} MQTTRunStats;
+
+MQTTRunStats mqttRunStats = { };
+
+// the run in progress
+unsigned long mqttRunStart_ms = 0;
+uint32_t mqttRunMessages = 0;
+uint32_t mqttRunFirstPublish_ms = 0;
+
+
+void mqttRunStarted() {
+
+  mqttRunStart_ms = millis();
+  mqttRunMessages = 0;
+  mqttRunFirstPublish_ms = 0;
+
+}
+
+
+void mqttRunPublished(uint32_t messages) {
+
+  if (mqttRunMessages == 0) { mqttRunFirstPublish_ms = millis() - mqttRunStart_ms; }
+
+  mqttRunMessages += messages;
+
+}
+
+
+void mqttRunEnded() {
+
+  mqttRunStats.runs++;
+  mqttRunStats.messages = mqttRunMessages;
+  mqttRunStats.run_ms = millis() - mqttRunStart_ms;
+  mqttRunStats.firstPublish_ms = mqttRunFirstPublish_ms;
+
+  #if (SerialDebugging)
+  Serial.printf(
+    "%s() - %u messages in %u ms (first after %u ms)\n",
+    __func__,
+    mqttRunStats.messages,
+    mqttRunStats.run_ms,
+    mqttRunStats.firstPublish_ms
+  );
+  #endif
+
+}
+
+
+void expectTelemetryWithin(unsigned long ms) {
+
+  if (ms < mqttNextTelemetry_ms) { mqttNextTelemetry_ms = ms; }
+
+}
+
+
+void expectTelemetry(AsyncDelay & timer) {
+
+  if (timer.isExpired()) {
+    expectTelemetryWithin(0);
+  } else {
+    expectTelemetryWithin(timer.getExpiry() - millis());
+  }
+
+}
+
+
+// smoothed (7/8 old + 1/8 new) once seeded by the first sample
+void mqttMeasureCost(unsigned long & average, unsigned long sample) {
+
+  average = (average == 0) ? sample : (average * 7 + sample) / 8;
+
+}
+
+
+void spill_to_flash(size_t target = TelemetrySpillTarget_bytes) {
+
+  #if (MQTTAtLeastOnce)
+  // records in flight are about to move
+  mqtt_window_abandon();
+  #endif
+
+  if (!spillLog.beginBatch()) {
+
+    #if (SerialDebugging)
+    Serial.printf("%s() - spill log unavailable\n",__func__);
+    #endif
+
+    return;
+
+  }
+
+  Telemetry telemetry;
+  TelemetryHeader header = { };
+
+  // move the oldest records to flash in one batch
+  while (mqttQueue.bytesUsed() > target && mqttQueue.peek(telemetry)) {
+
+    header.payloadLength = telemetry.payloadLength;
+    header.topic = telemetry.topic;
+    header.retain = telemetry.retain;
+
+    if (!spillLog.append(header,telemetry.payload)) { break; }
+
+    mqttQueue.release();
+
+  }
+
+  spillLog.endBatch();
+
+  #if (SerialDebugging)
+  Serial.printf(
+    "%s() - %u queued in RAM, %lu spilled in total\n",
+    __func__,
+    mqttQueue.count(),
+    spillLog.spilledCount()
+  );
+  #endif
+
+}
+
+
+char * try_to_reserve (
+  size_t & capacity
+) {
+
+  char * payload = mqttQueue.reserve(capacity);
+
+  // sense RAM queue too full for a payload - overflow to flash
+  if (capacity < TelemetryPayloadReserve_bytes) {
+
+    spill_to_flash();
+
+    payload = mqttQueue.reserve(capacity);
+
+  }
+
+  // a longer payload could not be spilled - let the encoder sense it as truncation
+  if (capacity > TelemetryPayloadReserve_bytes) { capacity = TelemetryPayloadReserve_bytes; }
+
+  return payload;
+
+}
+
+
+void try_to_enqueue (
+  const char * caller,
+  TopicID topic,
+  size_t payloadLength,
+  bool retain = false
+) {
+
+  // try to commit the record formatted into reserved space
+  bool success =
+    (topic != InvalidTopicID) &&
+    (payloadLength <= TelemetryPayloadMax_bytes) &&
+    mqttQueue.commit(topic,payloadLength,retain);
+
+  #if (SerialDebugging)
+  // report outcome
+  Serial.printf(
+    "%s() %s in queuing MQTT message (%u queued, %u bytes)\n",
+    caller,
+    (success ? "succeeded" : "did not succeed"),
+    mqttQueue.count(),
+    mqttQueue.bytesUsed()
+  );
+  #endif
+
+  if (!success) {
+
+    // something wrong - force restart - no return
+    fatalError(queuePushError,__func__);
+
+  }
+
+}
+
+
+/*
+ * Back off (resetting the client if the ladder says so) and then
+ * start again from MQTTCheckConnectState. Anything unsent stays
+ * queued.
+ */
+void mqtt_recover(Sensor_Error error, const char * caller) {
+
+  // a failed disconnect says nothing about the broker
+  if (error != disconnectMQTTError) { mqttBrokerUnreachable = true; }
+
+  if (mqttRecovery.escalate(error,caller) == RecoveryReset) {
+
+    // drop the session and its socket so the next connect starts afresh
+    mqtt_service.disconnect();
+    mqtt_WiFi_client.stop();
+
+  }
+
+  mqttState = MQTTBackoffState;
+
+}
+
+
+void do_mqttCheckConnectState () {
+
+  #if (SerialDebugging)
+  Serial.printf("%s()\n",__func__);
+  #endif
+
+  // sense service already running
+  if (mqtt_service.connected()) {
+      
+    // yes! move to next state
+    mqttState = MQTTTransmitState;
+
+    // all done
+    return;
+      
+  }
+
+  #if (SerialDebugging)
+  // report connection attempt
+  Serial.printf(
+    "Attempting MQTT connection with %s on port %ld as station %s\n",
+    MQTTHostFQDN_or_IP,
+    MQTTHostPort,
+    MQTTClientID
+  );
+  #endif
+
+  // start timing the connect
+  mqttCycleStart_ms = millis();
+
+  // not connected, timer still running, define connection to MQTT server
+  mqtt_service.begin(MQTTHostFQDN_or_IP,MQTTHostPort,mqtt_WiFi_client);
+
+  #if (MQTTAtLeastOnce)
+  // ask the broker to keep session state (in-flight QoS 1 messages)
+  mqtt_service.setCleanSession(false);
+  #endif
+
+  // Attempt to connect (implied skip=false argument)
+  bool ignore =  mqtt_service.connect(MQTTClientID);
+
+  // initialise a wait timer
+  mqtt_service_timer.start(MQTT_service_timeout_ms, AsyncDelay::MILLIS);
+
+  // wait for MQTT to come up
+  mqttState = MQTTWaitConnectState;
+  
+  #if (SerialDebugging)
+  Serial.println("moving to MQTTWaitConnectState");
+  #endif
+
+}
+
+
+void do_mqttWaitConnectState () {
+
+  /*
+    * Only three possibilities here: 
+    * 
+    * 1. MQTT is available - we move to transmit
+    * 2. The timeout expires and triggers a fatal error
+    * 3. We exit and the main loop brings us straight back
+    * 
+    */
+  
+  // has MQTT become available?
+  if (mqtt_service.connected()) {
+
+    mqttMeasureCost(mqttConnectCost_ms,millis() - mqttCycleStart_ms);
+
+    #if (SerialDebugging)
+    Serial.printf("MQTT service connected (%lu ms on average)\n",mqttConnectCost_ms);
+    #endif
+
+    #if (CompressedBacklog)
+    // send what was held back during the outage in this run
+    if (mqttBrokerUnreachable) { publish_series_backlog(); }
+    #endif
+
+    mqttBrokerUnreachable = false;
+
+    #if (MQTTAtLeastOnce)
+    // anything unacknowledged last time goes again
+    mqtt_window_reconnected();
+    #endif
+
+    // yes! proceed to next phase
+    mqttState = MQTTTransmitState;
+
+    return;
+      
+  }
+
+  // not connected. Has the timeout expired?
+  if (mqtt_service_timer.isExpired()) {
+
+    #if (SerialDebugging)
+    Serial.printf(
+        "MQTT connection timeout expired, err=%d, rc=%d\n",
+        mqtt_service.lastError(),
+        mqtt_service.returnCode()
+    );
+    #endif
+        
+    // yes! back off and try again
+    mqtt_recover(connectMQTTError,__func__);
+          
+  }
+
+  // otherwise remain in this state until connected
+    
+}
+
+
+/*
+ * Publish with QoS 0 (for QoS 1, see mqtt_window_fill()). Returns
+ * true if the message has been sent. On failure, returns false, the
+ * caller must leave the message in the queue, and the state machine
+ * backs off and then goes back to (re)connecting before resending it
+ * (see mqtt_recover()).
+ */
+bool try_to_publish (
+  const char * topic,
+  const char * payload,
+  size_t payloadLength,
+  bool retain
+) {
+
+  #if (SerialDebugging)
+  #if (CBORPayloads)
+  Serial.printf(
+    "publish%s-t %s (%u bytes CBOR)\n",
+    (retain ? " -r " : " "),
+    topic,
+    payloadLength
+  );
+  #else
+  Serial.printf(
+    "mosquitto_pub%s-h %s -t %s -m '%s'\n",
+    (retain ? " -r " : " "),
+    MQTTHostFQDN_or_IP,
+    topic,
+    payload
+  );
+  #endif
+  #endif
+
+  // try to transmit
+  bool success =
+    mqtt_service.publish(
+      topic,
+      payload,
+      payloadLength,
+      retain,
+      MQTT_QOS_AtMostOnce
+    );
+
+  if (!success) {
+
+    #if (SerialDebugging)
+    Serial.printf(
+      "publish failed, err=%d, rc=%d\n",
+      mqtt_service.lastError(),
+      mqtt_service.returnCode()
+    );
+    #endif
+
+    // reconnect (if the session dropped) and try again
+    mqtt_recover(publishMQTTError,__func__);
+
+    return false;
+
+  }
+
+  mqttRecovery.succeeded();
+
+  return true;
+
+}
+
+
+#if (MQTTBatchMode)
+
+// assembly area for batched payloads
+char mqttBatchBuffer[MQTT_packet_buffer_bytes];
+
+// array framing - CBOR batches are indefinite-length arrays
+#if (CBORPayloads)
+const char      BatchOpen                   = CBORIndefiniteArray;
+const char      BatchSeparator              = 0;
+const char      BatchClose                  = CBORBreak;
+#else
+const char      BatchOpen                   = '[';
+const char      BatchSeparator              = ',';
+const char      BatchClose                  = ']';
+#endif
+
+
+/*
+ * Add a message to the array being assembled in mqttBatchBuffer
+ * (count messages and length bytes so far). Returns false if it
+ * would take the array, once closed, past limit bytes.
+ */
+bool mqtt_batch_append(size_t & length, size_t count, const Telemetry & telemetry, size_t limit) {
+
+  // opening or separator + payload + closing
+  if (length + 1 + telemetry.payloadLength + 1 > limit) { return false; }
+
+  if (count == 0) {
+    mqttBatchBuffer[length++] = BatchOpen;
+  } else if (BatchSeparator) {
+    mqttBatchBuffer[length++] = BatchSeparator;
+  }
+
+  memcpy(mqttBatchBuffer + length,telemetry.payload,telemetry.payloadLength);
+  length += telemetry.payloadLength;
+
+  return true;
+
+}
+
+
+void mqtt_batch_close(size_t & length) {
+
+  mqttBatchBuffer[length++] = BatchClose;
+  mqttBatchBuffer[length] = 0;
+
+}
+
+
+// what is left of a packet for the array after the MQTT framing and the topic
+size_t mqtt_batch_limit(TopicID topic) {
+
+  return MQTT_packet_buffer_bytes - MQTT_publish_overhead_bytes - strlen(topicForID(topic));
+
+}
+
+
+/*
+ * Publish the oldest message in the RAM queue together with as many
+ * later messages for the same topic as will fit in one MQTT packet,
+ * as a JSON array:
+ *
+ *    [{...},{...},...]
+ *
+ * or, if CBORPayloads is true, as an indefinite-length CBOR array.
+ *
+ * Anything that doesn't fit is left for the next batch. Returns false
+ * (having sent nothing) if the oldest message is too big to be sent as
+ * part of an array.
+ */
+bool try_to_publish_batch() {
+
+  Telemetry telemetry;
+  QueueCursor cursor = { };
+
+  if (!mqttQueue.peekNext(telemetry,cursor)) { return false; }
+
+  TopicID topic = telemetry.topic;
+  bool retain = telemetry.retain;
+  const char * topicString = topicForID(topic);
+
+  size_t limit = mqtt_batch_limit(topic);
+
+  size_t length = 0;
+  size_t count = 0;
+
+  do {
+
+    // only messages for the same topic travel together
+    if (telemetry.topic != topic || telemetry.retain != retain) { continue; }
+
+    // stop at the first misfit
+    if (!mqtt_batch_append(length,count,telemetry,limit)) { break; }
+
+    count++;
+
+  } while (mqttQueue.peekNext(telemetry,cursor));
+
+  // sense oldest message too big for an array
+  if (count == 0) { return false; }
+
+  mqtt_batch_close(length);
+
+  #if (SerialDebugging)
+  Serial.printf("%s() - %u messages in %u bytes\n",__func__,count,length);
+  #endif
+
+  // sense not acknowledged - everything stays queued for the resend
+  if (!try_to_publish(topicString,mqttBatchBuffer,length,retain)) { return true; }
+
+  // mark the same messages (the first count matches) as sent
+  cursor = { };
+
+  for (size_t marked = 0; marked < count && mqttQueue.peekNext(telemetry,cursor); ) {
+
+    if (telemetry.topic != topic || telemetry.retain != retain) { continue; }
+
+    mqttQueue.markSent(cursor);
+
+    marked++;
+
+  }
+
+  // discards the oldest plus any sent messages immediately behind it
+  mqttQueue.release();
+
+  mqttRunPublished(count);
+
+  return true;
+
+}
+
+#endif
+
+
+#if (MQTTAtLeastOnce)
+
+/*
+ * Pipelined QoS 1
+ *
+ * arduino-mqtt's publish() waits for the PUBACK of a QoS 1 message
+ * before it returns, which would drain a backlog at one message per
+ * round trip. Instead, PUBLISH packets are written straight to the
+ * socket and up to MQTTWindow of them may be awaiting their PUBACK at
+ * once, so a drain is limited by the link rather than its latency.
+ * The PUBACKs are read back from the socket here. The library's loop()
+ * is not called while anything is in flight as it would swallow them.
+ *
+ * mqttWindow lists the packets in flight, oldest first. Each takes
+ * either the next record in the spill log (a backfill, which always
+ * goes first) or the oldest queued records in the RAM queue - one,
+ * or in MQTTBatchMode as many for its topic as fit - which are marked
+ * RecordInFlight. PUBACKs can arrive in any order but records only
+ * leave the queues once every packet before theirs has been
+ * acknowledged, so they leave in order.
+ *
+ * A packet's contents never change. Its records stay where they are
+ * and are found again from how many the packets before it took, so
+ * after a reconnect it is resent exactly as it was, with the same
+ * packet ID and the DUP flag set. If a PUBACK is overdue, the session
+ * is closed and reconnected (MQTT only allows a resend then).
+ *
+ * If the RAM queue spills to flash while packets are in flight, the
+ * window is abandoned and its records are queued again, so a message
+ * whose PUBACK had not arrived may then reach the broker twice without
+ * the DUP flag.
+ */
+
+// arduino-mqtt's own command timeout
+const unsigned long MQTTAckTimeout_ms = 1000;
+
+// how soon to look for PUBACKs when there is nothing more to send
+const unsigned long MQTTAckPoll_ms = 2;
+
+// MQTT control packet types (MQTT 3.1.1 section 2.2.1)
+const uint8_t   MQTTPublishType             = 3;
+const uint8_t   MQTTPubAckType              = 4;
+
+// how far ahead of the oldest record backfill packets have read the spill log
+SpillCursor mqttSpillCursor = { };
+
+// the packet being read from the socket - anything but a PUBACK is passed over
+uint8_t mqttReadHeader = 0;           // fixed header (0 between packets)
+bool mqttReadIsLength = false;        // reading the remaining length, 7 bits a byte
+uint8_t mqttReadShift = 0;
+uint32_t mqttReadRemaining = 0;
+uint16_t mqttReadPacketID = 0;
+
+
+uint16_t mqtt_next_packet_id() {
+
+  uint16_t packetID = mqttNextPacketID++;
+
+  // zero is not a packet ID
+  if (mqttNextPacketID == 0) { mqttNextPacketID = 1; }
+
+  return packetID;
+
+}
+
+
+void mqtt_window_abandon() {
+
+  if (mqttWindowCount == 0) { return; }
+
+  #if (SerialDebugging)
+  Serial.printf("%s() - %u packets in flight\n",__func__,mqttWindowCount);
+  #endif
+
+  // back to being queued
+  Telemetry telemetry;
+  QueueCursor cursor = { };
+
+  while (mqttQueue.peekNext(telemetry,cursor,RecordInFlight)) { mqttQueue.mark(cursor,RecordQueued); }
+
+  mqttWindowCount = 0;
+  mqttSpillCursor = { };
+
+}
+
+
+/*
+ * A new session: anything unacknowledged in the last one is resent,
+ * as a duplicate, and the new socket starts between packets.
+ */
+void mqtt_window_reconnected() {
+
+  for (uint8_t i = 0; i < mqttWindowCount; i++) {
+
+    MQTTInFlight & entry = mqttWindow[i];
+
+    if (entry.isWritten && !entry.isAcked) { entry.isDuplicate = true; }
+
+    entry.isWritten = false;
+
+  }
+
+  mqttReadHeader = 0;
+
+}
+
+
+/*
+ * Find the RAM queue records of a packet for topic: pass over skip
+ * records with the given progress, then take up to limit of them,
+ * marking them in flight. In MQTTBatchMode the payload is an array in
+ * mqttBatchBuffer of as many as fit (or a message too big for one,
+ * alone), otherwise it is the record itself. Returns how many were
+ * taken.
+ */
+size_t mqtt_window_gather(
+  TopicID topic,
+  bool retain,
+  uint8_t progress,
+  size_t skip,
+  size_t limit,
+  const char * & payload,
+  size_t & payloadLength
+) {
+
+  Telemetry telemetry;
+  QueueCursor cursor = { };
+
+  size_t count = 0;
+
+  #if (MQTTBatchMode)
+  size_t length = 0;
+  bool isArray = true;
+  #else
+  limit = 1;
+  #endif
+
+  while (count < limit && mqttQueue.peekNext(telemetry,cursor,progress)) {
+
+    if (telemetry.topic != topic || telemetry.retain != retain) { continue; }
+
+    if (skip > 0) { skip--; continue; }
+
+    #if (MQTTBatchMode)
+    // stop at the first misfit - unless it comes first, when it goes alone
+    if (!mqtt_batch_append(length,count,telemetry,mqtt_batch_limit(topic))) {
+
+      if (count > 0) { break; }
+
+      isArray = false;
+      limit = 1;
+      payload = telemetry.payload;
+      payloadLength = telemetry.payloadLength;
+
+    }
+    #else
+    payload = telemetry.payload;
+    payloadLength = telemetry.payloadLength;
+    #endif
+
+    mqttQueue.mark(cursor,RecordInFlight);
+
+    count++;
+
+  }
+
+  #if (MQTTBatchMode)
+  if (count > 0 && isArray) {
+    mqtt_batch_close(length);
+    payload = mqttBatchBuffer;
+    payloadLength = length;
+  }
+  #endif
+
+  return count;
+
+}
+
+
+/*
+ * The payload of the packet at position in the window, as it was
+ * first sent.
+ */
+bool mqtt_window_contents(uint8_t position, const char * & payload, size_t & payloadLength) {
+
+  MQTTInFlight & entry = mqttWindow[position];
+
+  // backfill packets come first, one record each, in log order
+  if (entry.isBackfill) {
+
+    Telemetry telemetry;
+    SpillCursor cursor = { };
+
+    for (uint8_t i = 0; i <= position; i++) {
+      if (!spillLog.peekNext(telemetry,cursor)) { return false; }
+    }
+
+    payload = telemetry.payload;
+    payloadLength = telemetry.payloadLength;
+
+    return true;
+
+  }
+
+  // pass over the records taken by earlier packets for the topic
+  size_t skip = 0;
+
+  for (uint8_t i = 0; i < position; i++) {
+
+    const MQTTInFlight & earlier = mqttWindow[i];
+
+    if (!earlier.isBackfill && earlier.topic == entry.topic && earlier.retain == entry.retain) { skip += earlier.records; }
+
+  }
+
+  return mqtt_window_gather(entry.topic,entry.retain,RecordInFlight,skip,entry.records,payload,payloadLength) == entry.records;
+
+}
+
+
+/*
+ * Write a QoS 1 PUBLISH to the socket (MQTT 3.1.1 section 3.3).
+ * Returns false if the socket would not take all of it.
+ */
+bool mqtt_window_write(MQTTInFlight & entry, const char * payload, size_t payloadLength) {
+
+  const char * topic = topicForID(entry.topic);
+  size_t topicLength = strlen(topic);
+
+  size_t remaining = 2 + topicLength + 2 + payloadLength;
+
+  // fixed header, remaining length (7 bits a byte) and topic length
+  uint8_t header[1 + 4 + 2];
+  size_t length = 0;
+
+  header[length++] =
+    (MQTTPublishType << 4) |
+    (entry.isDuplicate ? 0x08 : 0) |
+    (MQTT_QOS_Telemetry << 1) |
+    (entry.retain ? 0x01 : 0);
+
+  do {
+    uint8_t digit = remaining & 0x7F;
+    remaining >>= 7;
+    header[length++] = digit | (remaining ? 0x80 : 0);
+  } while (remaining);
+
+  header[length++] = topicLength >> 8;
+  header[length++] = topicLength & 0xFF;
+
+  uint8_t packetID[2] = { (uint8_t)(entry.packetID >> 8), (uint8_t)(entry.packetID & 0xFF) };
+
+  #if (SerialDebugging)
+  Serial.printf(
+    "%s() - packet %u%s, %u messages, %u bytes on %s (%u in flight)\n",
+    __func__,
+    entry.packetID,
+    (entry.isDuplicate ? " (DUP)" : ""),
+    entry.records,
+    payloadLength,
+    topic,
+    mqttWindowCount
+  );
+  #endif
+
+  entry.isWritten = true;
+  entry.written_ms = millis();
+
+  return
+    (mqtt_WiFi_client.write(header,length) == length) &&
+    (mqtt_WiFi_client.write((const uint8_t *)topic,topicLength) == topicLength) &&
+    (mqtt_WiFi_client.write(packetID,sizeof(packetID)) == sizeof(packetID)) &&
+    (mqtt_WiFi_client.write((const uint8_t *)payload,payloadLength) == payloadLength);
+
+}
+
+
+/*
+ * Start the next packet at the back of the window. Returns false if
+ * there is nothing more to send for now.
+ */
+bool mqtt_window_add() {
+
+  MQTTInFlight & entry = mqttWindow[mqttWindowCount];
+  entry = { };
+
+  Telemetry telemetry;
+  const char * payload = nullptr;
+  size_t payloadLength = 0;
+
+  // backfill first - and never behind a packet from the RAM queue, so the log stays in order
+  bool isBackfillNext = !spillLog.isEmpty();
+
+  for (uint8_t i = 0; i < mqttWindowCount && isBackfillNext; i++) { isBackfillNext = mqttWindow[i].isBackfill; }
+
+  if (isBackfillNext) {
+
+    // the first goes through peek(), which steps over anything unreadable
+    if (mqttWindowCount == 0) {
+
+      if (!spillLog.peek(telemetry)) { return false; }
+
+      mqttSpillCursor = { };
+
+    }
+
+    entry.isBackfill = spillLog.peekNext(telemetry,mqttSpillCursor);
+
+  }
+
+  if (entry.isBackfill) {
+
+    entry.records = 1;
+    entry.topic = telemetry.topic;
+    entry.retain = telemetry.retain;
+    payload = telemetry.payload;
+    payloadLength = telemetry.payloadLength;
+
+  } else {
+
+    // the oldest queued message decides the topic
+    QueueCursor cursor = { };
+
+    if (!mqttQueue.peekNext(telemetry,cursor)) { return false; }
+
+    entry.topic = telemetry.topic;
+    entry.retain = telemetry.retain;
+    entry.records = mqtt_window_gather(entry.topic,entry.retain,RecordQueued,0,UINT8_MAX,payload,payloadLength);
+
+    // the oldest was just found
+    if (entry.records == 0) { fatalError(queuePopError,__func__); }
+
+  }
+
+  entry.packetID = mqtt_next_packet_id();
+
+  mqttWindowCount++;
+
+  return mqtt_window_write(entry,payload,payloadLength);
+
+}
+
+
+void mqtt_window_acknowledged(uint16_t packetID) {
+
+  for (uint8_t i = 0; i < mqttWindowCount; i++) {
+
+    MQTTInFlight & entry = mqttWindow[i];
+
+    if (entry.packetID == packetID && entry.isWritten) { entry.isAcked = true; }
+
+  }
+
+}
+
+
+void mqtt_window_read(uint8_t byte) {
+
+  // sense the start of a packet
+  if (mqttReadHeader == 0) {
+
+    mqttReadHeader = byte;
+    mqttReadIsLength = true;
+    mqttReadShift = 0;
+    mqttReadRemaining = 0;
+
+    return;
+
+  }
+
+  if (mqttReadIsLength) {
+
+    mqttReadRemaining |= (uint32_t)(byte & 0x7F) << mqttReadShift;
+    mqttReadShift += 7;
+
+    if (byte & 0x80) { return; }
+
+    mqttReadIsLength = false;
+
+    if (mqttReadRemaining == 0) { mqttReadHeader = 0; }
+
+    return;
+
+  }
+
+  // the last two bytes of a PUBACK are the packet ID
+  mqttReadPacketID = (mqttReadPacketID << 8) | byte;
+
+  if (--mqttReadRemaining > 0) { return; }
+
+  if ((mqttReadHeader >> 4) == MQTTPubAckType) { mqtt_window_acknowledged(mqttReadPacketID); }
+
+  mqttReadHeader = 0;
+
+}
+
+
+/*
+ * Take the acknowledged packets off the front of the window, and
+ * their records off the queues.
  */
-MQTT_State mqttState = MQTTIdleState;
+void mqtt_window_release() {
 
-// comms support
-WiFiClient mqtt_WiFi_client;
-MQTTClient mqtt_service(512);
-AsyncDelay mqtt_service_timer;
-const unsigned long MQTT_service_timeout_ms = 30*1000;
+  while (mqttWindowCount > 0 && mqttWindow[0].isAcked) {
 
-// MQTT topic+payload structure
-typedef struct {
-  char topic[255] = { 0 };
-  char payload[255] = { 0 };
-  bool retain = false;
-} Telemetry;
+    MQTTInFlight & entry = mqttWindow[0];
 
-// MQTT messages waiting to be sent
-cppQueue mqttQueue(sizeof(Telemetry),10,FIFO);
+    if (entry.isBackfill) {
 
+      spillLog.release();
 
-void try_to_enqueue (
-  const char * caller,
-  Telemetry* telemetry
-) {
+    } else {
 
-  // try to append to the queue
-  bool success = mqttQueue.push(telemetry);
+      // the oldest records in flight for its topic
+      Telemetry telemetry;
+      QueueCursor cursor = { };
 
-  #if (SerialDebugging)
-  // report outcome
-  Serial.printf(
-    "%s() %s in queuing MQTT message\n",
-    caller,
-    (success ? "succeeded" : "did not succeed")
-  );
-  #endif
+      for (size_t marked = 0; marked < entry.records && mqttQueue.peekNext(telemetry,cursor,RecordInFlight); ) {
 
-  if (!success) {
+        if (telemetry.topic != entry.topic || telemetry.retain != entry.retain) { continue; }
 
-    // something wrong - force restart - no return
-    fatalError(queuePushError,__func__);
+        mqttQueue.markSent(cursor);
 
-  }
+        marked++;
 
-}
+      }
 
+      mqttQueue.releaseSent();
 
-void do_mqttCheckConnectState () {
+    }
 
-  #if (SerialDebugging)
-  Serial.printf("%s()\n",__func__);
-  #endif
+    mqttRunPublished(entry.records);
 
-  // sense service already running
-  if (mqtt_service.connected()) {
-      
-    // yes! move to next state
-    mqttState = MQTTTransmitState;
+    mqttRecovery.succeeded();
+
+    mqttWindowCount--;
+    memmove(mqttWindow,mqttWindow + 1,mqttWindowCount * sizeof(MQTTInFlight));
 
-    // all done
-    return;
-      
   }
 
-  #if (SerialDebugging)
-  // report connection attempt
-  Serial.printf(
-    "Attempting MQTT connection with %s on port %ld as station %s\n",
-    MQTTHostFQDN_or_IP,
-    MQTTHostPort,
-    MQTTClientID
-  );
-  #endif
+}
 
-  // not connected, timer still running, define connection to MQTT server
-  mqtt_service.begin(MQTTHostFQDN_or_IP,MQTTHostPort,mqtt_WiFi_client);
 
-  // Attempt to connect (implied skip=false argument)
-  bool ignore =  mqtt_service.connect(MQTTClientID);
+// the session failed - close it, so the window is resent in the next one
+void mqtt_window_failed(const char * caller) {
 
-  // initialise a wait timer
-  mqtt_service_timer.start(MQTT_service_timeout_ms, AsyncDelay::MILLIS);
+  mqtt_service.disconnect();
+  mqtt_WiFi_client.stop();
 
-  // wait for MQTT to come up
-  mqttState = MQTTWaitConnectState;
-  
-  #if (SerialDebugging)
-  Serial.println("moving to MQTTWaitConnectState");
-  #endif
+  mqtt_recover(publishMQTTError,caller);
 
 }
 
 
-void do_mqttWaitConnectState () {
+/*
+ * Read whatever PUBACKs have arrived and release what they complete.
+ * Returns false if the session has failed.
+ */
+bool mqtt_window_service() {
 
-  /*
-    * Only three possibilities here: 
-    * 
-    * 1. MQTT is available - we move to transmit
-    * 2. The timeout expires and triggers a fatal error
-    * 3. We exit and the main loop brings us straight back
-    * 
-    */
-  
-  // has MQTT become available?
-  if (mqtt_service.connected()) {
+  // (finish any packet part-read when the window was abandoned)
+  if (mqttWindowCount == 0 && mqttReadHeader == 0) { return true; }
 
-    #if (SerialDebugging)
-    Serial.println("MQTT service connected");
-    #endif
+  while (mqtt_WiFi_client.available() > 0) {
 
-    // yes! proceed to next phase
-    mqttState = MQTTTransmitState;
+    int byte = mqtt_WiFi_client.read();
+
+    if (byte < 0) { break; }
+
+    mqtt_window_read(byte);
 
-    return;
-      
   }
 
-  // not connected. Has the timeout expired?
-  if (mqtt_service_timer.isExpired()) {
+  mqtt_window_release();
+
+  bool isOverdue = false;
+
+  for (uint8_t i = 0; i < mqttWindowCount; i++) {
+
+    const MQTTInFlight & entry = mqttWindow[i];
+
+    if (entry.isWritten && !entry.isAcked && millis() - entry.written_ms > MQTTAckTimeout_ms) { isOverdue = true; }
+
+  }
+
+  if (isOverdue || !mqtt_service.connected()) {
 
     #if (SerialDebugging)
-    Serial.printf(
-        "MQTT connection timeout expired, err=%d, rc=%d\n",
-        mqtt_service.lastError(),
-        mqtt_service.returnCode()
-    );
+    Serial.printf("%s() - %s, %u packets in flight\n",__func__,(isOverdue ? "PUBACK overdue" : "session lost"),mqttWindowCount);
     #endif
-        
-    // yes! nothing else we can do 
-    fatalError(connectMQTTError,__func__); // forces restart - no return
-          
+
+    mqtt_window_failed(__func__);
+
+    return false;
+
   }
 
-  // otherwise remain in this state until connected
-    
+  return true;
+
+}
+
+
+/*
+ * Resend anything not yet written in this session, as it was, then
+ * start new packets until the window is full or there is nothing
+ * left to send.
+ */
+void mqtt_window_fill() {
+
+  for (uint8_t i = 0; i < mqttWindowCount; i++) {
+
+    MQTTInFlight & entry = mqttWindow[i];
+
+    if (entry.isWritten || entry.isAcked) { continue; }
+
+    const char * payload = nullptr;
+    size_t payloadLength = 0;
+
+    // sense the records gone (they never should be)
+    if (!mqtt_window_contents(i,payload,payloadLength)) {
+
+      #if (SerialDebugging)
+      Serial.printf("%s() - packet %u can't be rebuilt\n",__func__,entry.packetID);
+      #endif
+
+      mqtt_window_abandon();
+
+      return;
+
+    }
+
+    if (!mqtt_window_write(entry,payload,payloadLength)) { mqtt_window_failed(__func__); return; }
+
+  }
+
+  while (mqttWindowCount < MQTTWindow) {
+
+    uint8_t before = mqttWindowCount;
+
+    bool success = mqtt_window_add();
+
+    if (mqttWindowCount == before) { return; }
+
+    if (!success) { mqtt_window_failed(__func__); return; }
+
+  }
+
+}
+
+#endif
+
+
+bool mqttShouldHold() {
+
+  unsigned long cycleCost_ms = mqttConnectCost_ms + mqttDisconnectCost_ms;
+
+  // no prediction, or no measurement yet - nothing to go on
+  bool hold =
+    (mqttNextTelemetry_ms != MQTTNoTelemetryExpected) &&
+    (mqttDisconnectCost_ms > 0) &&
+    (mqttNextTelemetry_ms / MQTTHoldCostRatio < cycleCost_ms);
+
+  #if (SerialDebugging)
+  Serial.printf(
+    "%s() - next message in %lu ms, cycle costs %lu ms - %s\n",
+    __func__,
+    mqttNextTelemetry_ms,
+    cycleCost_ms,
+    (hold ? "holding" : "disconnecting")
+  );
+  #endif
+
+  if (hold) {
+
+    mqttHoldCount++;
+    mqttHoldStart_ms = millis();
+    mqtt_hold_timer.start(mqttNextTelemetry_ms + MQTTHoldGrace_ms, AsyncDelay::MILLIS);
+
+  } else {
+
+    mqttDropCount++;
+
+  }
+
+  return hold;
+
 }
 
 
 void do_mqttTransmitState () {
 
-  // sense queue empty
-  if (mqttQueue.isEmpty()) {
+  #if (MQTTAtLeastOnce)
+  // collect PUBACKs first - they free records and room in the window
+  if (!mqtt_window_service()) { return; }
+  #endif
+
+  // sense both queues empty
+  if (spillLog.isEmpty() && mqttQueue.isEmpty()) {
       
     #if (SerialDebugging)
     Serial.printf("%s() - queue is now empty\n",__func__);
     #endif
 
-    // nothing else to send - start disconnecting
-    mqttState = MQTTStartDisconnectState;
+    mqttRunEnded();
+
+    // nothing else to send - hold the session or start disconnecting
+    mqttState = (mqttShouldHold() ? MQTTHoldState : MQTTStartDisconnectState);
 
     // shortstop
     return;
 
   }
 
+  #if (MQTTAtLeastOnce)
+
+  // keep the window full - backfill first, then the RAM queue
+  mqtt_window_fill();
+
+  #else
+
+  /*
+    * anything in the spill log predates the RAM queue so it goes
+    * first, spaced out so a long backfill doesn't starve the sensor
+    * and OTA handlers
+    */
+  bool isBackfill = !spillLog.isEmpty();
+
+  if (isBackfill && !spill_backfill_timer.isExpired()) { return; }
+
+  #if (MQTTBatchMode)
+  // the RAM queue goes in batches where possible
+  if (!isBackfill && try_to_publish_batch()) { return; }
+  #endif
+
   /*
-    * queue is not empty - dequeue the first entry
+    * queue is not empty - look at the first entry in place
     */
   Telemetry telemetry;
   
-  bool success = mqttQueue.pop(&telemetry);
+  bool success = (isBackfill ? spillLog.peek(telemetry) : mqttQueue.peek(telemetry));
+
+  // an unreadable spill record has been skipped - try again next pass
+  if (!success && isBackfill) { return; }
 
   if (!success) {
       
     #if (SerialDebugging)
-    Serial.println("mqttQueue.pop() returned false. Only just checked for non-empty queue. Weird!");
+    Serial.println("mqttQueue.peek() returned false. Only just checked for non-empty queue. Weird!");
     #endif
     
     fatalError(queuePopError,__func__); // forces restart - no return
 
   }
 
-  #if (SerialDebugging)
-  Serial.printf(
-    "mosquitto_pub%s-h %s -t %s -m '%s'\n",
-    (telemetry.retain ? " -r " : " "),
-    MQTTHostFQDN_or_IP,
-    telemetry.topic,
-    telemetry.payload
-  );
-  #endif
-
-  // try to transmit
   success =
-    mqtt_service.publish(
-      telemetry.topic,
+    try_to_publish(
+      topicForID(telemetry.topic),
       telemetry.payload,
-      telemetry.retain,
-      MQTT_QOS_AtMostOnce
+      telemetry.payloadLength,
+      telemetry.retain
     );
 
-  if (!success) {
+  // sense not acknowledged - the entry stays queued for the resend
+  if (!success) { return; }
 
-    #if (SerialDebugging)
-    Serial.printf(
-      "publish failed, err=%d, rc=%d\n",
-      mqtt_service.lastError(),
-      mqtt_service.returnCode()
-    );
-    #endif
-    
-    fatalError(publishMQTTError,__func__); // forces restart - no return
+  mqttRunPublished(1);
+      
+  // sent - the entry can be discarded
+  if (isBackfill) {
+
+    spillLog.release();
+
+    spill_backfill_timer.start(spillBackfillInterval_ms, AsyncDelay::MILLIS);
+
+  } else {
+
+    mqttQueue.release();
 
   }
-      
+
   /*
     * At this point there will either be more items in the queue or it is empty.
     * Either way, we stay in this state.
     */
+
+  #endif
     
 }
 
@@ -264,6 +1412,9 @@ void do_mqttStartDisconnectState () {
   );
   #endif
 
+  // start timing the disconnect
+  mqttCycleStart_ms = millis();
+
   // disconnect
   bool ignore = mqtt_service.disconnect();
 
@@ -296,8 +1447,8 @@ void do_mqttWaitDisconnectState () {
       );
       #endif
           
-      // yes! nothing else we can do 
-      fatalError(disconnectMQTTError,__func__);
+      // yes! back off and try again
+      mqtt_recover(disconnectMQTTError,__func__);
             
     }
 
@@ -310,8 +1461,10 @@ void do_mqttWaitDisconnectState () {
     *  MQTT disconnected
     */
 
+  mqttMeasureCost(mqttDisconnectCost_ms,millis() - mqttCycleStart_ms);
+
   #if (SerialDebugging)
-  Serial.println("MQTT service disconnected");
+  Serial.printf("MQTT service disconnected (%lu ms on average)\n",mqttDisconnectCost_ms);
   #endif
 
   // move to idle state
@@ -320,13 +1473,75 @@ void do_mqttWaitDisconnectState () {
 }
 
 
-void mqtt_handle() {
+void do_mqttHoldState () {
+
+  // sense the broker dropped the session while it was being held
+  if (!mqtt_service.connected()) {
+
+    #if (SerialDebugging)
+    Serial.printf("%s() - session lost\n",__func__);
+    #endif
+
+    mqttState = MQTTIdleState;
+
+    return;
+
+  }
+
+  // sense something to send - reuse the session
+  if (!mqttQueue.isEmpty() || !spillLog.isEmpty()) {
+
+    // what a cycle would have cost less what holding is reckoned to have cost
+    unsigned long cycleCost_ms = mqttConnectCost_ms + mqttDisconnectCost_ms;
+    unsigned long holdCost_ms = (millis() - mqttHoldStart_ms) / MQTTHoldCostRatio;
+
+    if (cycleCost_ms > holdCost_ms) { mqttHoldSaved_ms += cycleCost_ms - holdCost_ms; }
+
+    mqttHoldReusedCount++;
+
+    mqttRunStarted();
+
+    #if (SerialDebugging)
+    Serial.printf("%s() - reusing session (%lu ms saved so far)\n",__func__,mqttHoldSaved_ms);
+    #endif
+
+    mqttState = MQTTTransmitState;
+
+    return;
+
+  }
 
-  // give WiFi some guaranteed time
-  delay(1);
+  // sense the prediction was wrong - give up holding
+  if (mqtt_hold_timer.isExpired()) {
+
+    #if (SerialDebugging)
+    Serial.printf("%s() - nothing arrived, disconnecting\n",__func__);
+    #endif
+
+    mqttState = MQTTStartDisconnectState;
+
+  }
+
+}
+
+
+void do_mqttBackoffState () {
+
+  // start again once the backoff has run its course
+  if (!mqttRecovery.isBackingOff()) { mqttState = MQTTCheckConnectState; }
+
+}
+
+
+void mqtt_handle() {
 
   // give MQTT some time if it is connected
+  #if (MQTTAtLeastOnce)
+  // (but not while PUBACKs are due - loop() would read them)
+  if (mqttWindowCount == 0 && mqttReadHeader == 0 && mqtt_service.connected()) { mqtt_service.loop(); }
+  #else
   if (mqtt_service.connected()) { mqtt_service.loop(); }
+  #endif
 
   switch (mqttState) {
 
@@ -335,21 +1550,61 @@ void mqtt_handle() {
     case MQTTTransmitState:         do_mqttTransmitState();         break;
     case MQTTStartDisconnectState:  do_mqttStartDisconnectState();  break;
     case MQTTWaitDisconnectState:   do_mqttWaitDisconnectState();   break;
+    case MQTTHoldState:             do_mqttHoldState();             break;
+    case MQTTBackoffState:          do_mqttBackoffState();          break;
 
     default: // MQTTIdleState
 
-      // is the queue empty?
-      if (!mqttQueue.isEmpty()) {
+      // are the queues empty?
+      if (!mqttQueue.isEmpty() || !spillLog.isEmpty()) {
 
         #if (SerialDebugging)
         Serial.printf("%s() - queue contains messages\n",__func__);
         #endif
         
         // no! time to start a transmission run
+        mqttRunStarted();
+
         mqttState = MQTTCheckConnectState;
           
       }
 
   }
 
+  // when to come back
+  switch (mqttState) {
+
+    case MQTTIdleState:                                                     break;
+    case MQTTHoldState:             scheduleTimer(mqtt_hold_timer);         break;
+    case MQTTBackoffState:          scheduleTimer(mqttRecovery.backoffTimer()); break;
+
+    case MQTTWaitConnectState:
+    case MQTTWaitDisconnectState:   scheduleWithin(SchedulerPoll_ms);       break;
+
+    case MQTTTransmitState:
+
+      #if (MQTTAtLeastOnce)
+      // with the window full, only a PUBACK can move things on
+      if (mqttWindowCount > 0 || mqttReadHeader != 0) {
+        scheduleWithin(MQTTAckPoll_ms);
+      } else {
+        scheduleWithin(0);
+      }
+      #else
+      // a backfill is paced by its own timer
+      if (!spillLog.isEmpty()) {
+        scheduleTimer(spill_backfill_timer);
+      } else {
+        scheduleWithin(0);
+      }
+      #endif
+      break;
+
+    default:                        scheduleWithin(0);
+
+  }
+
+  // predictions are made afresh on every pass
+  mqttNextTelemetry_ms = MQTTNoTelemetryExpected;
+
 }
@@ -0,0 +1,109 @@
+#pragma once
+
+/*
+ *
+ *  Topic registry
+ *
+ *  The set of topics the sketch publishes to is fixed so each topic
+ *  string is built exactly once (when the module that owns it
+ *  registers it) and is referred to thereafter by a one-byte TopicID.
+ *  Queued telemetry only carries the TopicID. The string is looked up
+ *  when the message is actually published.
+ *
+ *  Topics have the form:
+ *
+ *      «MQTTTopicPrefix»/«MQTTClientID»/«key»[/«subkey»]
+ *
+ *  Registration sites should use topicLength() in a static_assert so
+ *  a prefix or client ID that is too long is caught by the compiler
+ *  rather than being silently truncated.
+ *
+ *  IDs are handed out in registration order, which depends on the
+ *  options in Defines.h (eg CompressedBacklog registers an extra topic
+ *  per sensor), so the same ID can mean a different topic after an
+ *  update. Anything which keeps TopicIDs across a restart (the spill
+ *  log and the warm restart snapshot) checks topicTableSignature() and
+ *  won't use records kept under a different table.
+ *
+ */
+
+
+typedef uint8_t TopicID;
+
+const TopicID InvalidTopicID = 0xFF;
+
+// registry dimensions
+const size_t MaxTopicCount = 12;
+const size_t MaxTopicLength = 63;             // excluding the terminating null
+
+
+constexpr size_t stringLength(const char * s) {
+
+  return (*s) ? 1 + stringLength(s + 1) : 0;
+
+}
+
+
+constexpr size_t topicLength(const char * key, const char * subkey = "") {
+
+  return
+    stringLength(MQTTTopicPrefix) + 1 +
+    stringLength(MQTTClientID) + 1 +
+    stringLength(key) +
+    (stringLength(subkey) ? 1 + stringLength(subkey) : 0);
+
+}
+
+
+// the registry
+char topicTable[MaxTopicCount][MaxTopicLength+1] = { };
+size_t topicCount = 0;
+
+
+TopicID registerTopic(const char * key, const char * subkey = "") {
+
+  // sense registry full
+  if (topicCount >= MaxTopicCount) { return InvalidTopicID; }
+
+  char * topic = topicTable[topicCount];
+
+  if (strlen(subkey) > 0) {
+    snprintf(topic,MaxTopicLength+1,"%s/%s/%s/%s",MQTTTopicPrefix,MQTTClientID,key,subkey);
+  } else {
+    snprintf(topic,MaxTopicLength+1,"%s/%s/%s",MQTTTopicPrefix,MQTTClientID,key);
+  }
+
+  return topicCount++;
+
+}
+
+
+// FNV-1a over every registered topic, in ID order
+uint32_t topicTableSignature() {
+
+  uint32_t hash = 2166136261;
+
+  for (size_t id = 0; id < topicCount; id++) {
+
+    // including the null, so the boundaries between topics count too
+    const char * topic = topicTable[id];
+
+    do {
+      hash = (hash ^ (uint8_t)*topic) * 16777619;
+    } while (*topic++);
+
+  }
+
+  return hash;
+
+}
+
+
+const char * topicForID(TopicID id) {
+
+  // an unknown ID maps to an empty topic, which any broker will reject
+  if (id >= topicCount) { return ""; }
+
+  return topicTable[id];
+
+}
@@ -51,6 +51,17 @@ void setup() {
   Serial.begin(74880); while (!Serial); Serial.println();
   #endif
 
+  // pick up any telemetry spilled to flash before the last reboot
+  spillLog.begin();
+
+  // recover queue and trend state saved by reboot()
+  restoreWarmRestartSnapshot();
+
+  #if (DeepSleepMode)
+  // report how long the previous cycle was awake
+  publish_deep_sleep_cycle();
+  #endif
+
   // were we just reset by the IDE?
   if (ESP.getResetInfoPtr()->reason == REASON_EXT_SYS_RST) {
 
@@ -83,29 +94,56 @@ void periodicRestartCheck(unsigned days) {
 }
 
 
+#if (DeepSleepMode)
+
+bool isCycleComplete() {
+
+  return
+    areSensorsIdle() &&                                              // readings taken
+    !(deepSleepStatusDue() && statusReportTimer.isExpired()) &&      // status sent if due
+    mqttQueue.isEmpty() && spillLog.isEmpty() &&                     // everything queued
+    (mqttState == MQTTIdleState);                                    // ... sent and disconnected
+
+}
+
+#endif
+
+
 void loop() {
     
   // start & maintain WiFi and OTA services
   wifi_handle();
 
+  #if (DeepSleepMode)
+  // each wake's readings are taken regardless - they wait in the queue if WiFi is down
+  sensor_handle();
+  #endif
+
   // is WiFi up?
   if (WiFi.status() == WL_CONNECTED) {
 
       // bung out a status report
       periodicStatusReport();
 
+      #if (!DeepSleepMode)
       // handle any sensors
       sensor_handle();
+      #endif
 
       // mqtt to handle any queued telemetry
       mqtt_handle();
 
   }
 
+  #if (DeepSleepMode)
+  // once this wake's work is done (or it has run out of time), sleep until the next reading
+  if (isCycleComplete() || deepSleepIsOverdue()) { deepSleepUntilNextCycle(); }
+  #else
   // an occasional clearing of the cobwebs (days)
   periodicRestartCheck(30);
+  #endif
 
-  // give WiFi some guaranteed time
-  delay(1);
+  // sleep until something next needs attention
+  scheduler_idle();
     
 }